@@ -37,7 +37,7 @@ extern "C" {
 
 /* ------------------- zlib-style API's */
 
-mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
+static mz_ulong mz_adler32_generic(mz_ulong adler, const mz_uint8 *ptr, size_t buf_len)
 {
     mz_uint32 i, s1 = (mz_uint32)(adler & 0xffff), s2 = (mz_uint32)(adler >> 16);
     size_t block_len = buf_len % 5552;
@@ -92,7 +92,7 @@ mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len);
 #else
 /* Faster, but larger CPU cache footprint.
  */
-mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+static mz_ulong mz_crc32_generic(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
 {
     static const mz_uint32 s_crc_table[256] =
         {
@@ -159,6 +159,553 @@ mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
 }
 #endif
 
+/* ------------------- Runtime CPU feature dispatch */
+
+#if defined(USE_EXTERNAL_MZCRC)
+#define MZ_CRC32_GENERIC mz_crc32
+#else
+#define MZ_CRC32_GENERIC mz_crc32_generic
+#endif
+
+#if !defined(MINIZ_NO_CPU_DISPATCH) && MINIZ_X86_OR_X64_CPU && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)) && !defined(__TINYC__)
+#define MINIZ_CPU_DISPATCH_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if !defined(MINIZ_NO_CPU_DISPATCH) && defined(__aarch64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define MINIZ_CPU_DISPATCH_ARM_CRC 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MZ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MZ_TARGET(isa)
+#endif
+
+typedef struct
+{
+    mz_ulong (*m_crc32)(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len);
+    mz_ulong (*m_adler32)(mz_ulong adler, const mz_uint8 *ptr, size_t buf_len);
+    mz_uint (*m_match_len)(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len);
+    void (*m_match_copy)(mz_uint8 *pDst, const mz_uint8 *pSrc, size_t len);
+    mz_cpu_level m_level;
+} mz_cpu_kernels;
+
+/* Returns the number of leading bytes that match in p and q, up to max_len. */
+static mz_uint mz_match_len_generic(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len)
+{
+    mz_uint len = 0;
+    while ((len < max_len) && (p[len] == q[len]))
+        ++len;
+    return len;
+}
+
+/* Copies an LZ77 match forwards, byte by byte, so overlapping source and destination repeat the pattern. */
+static void mz_match_copy_generic(mz_uint8 *pDst, const mz_uint8 *pSrc, size_t len)
+{
+    while (len--)
+        *pDst++ = *pSrc++;
+}
+
+#if defined(MINIZ_CPU_DISPATCH_X86) || defined(MINIZ_CPU_DISPATCH_ARM_CRC)
+static MZ_FORCEINLINE mz_uint mz_ctz32(mz_uint32 v)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return (mz_uint)idx;
+#else
+    return (mz_uint)__builtin_ctz(v);
+#endif
+}
+#endif
+
+#ifdef MINIZ_CPU_DISPATCH_X86
+MZ_TARGET("sse2") static mz_uint mz_match_len_sse2(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len)
+{
+    mz_uint len = 0;
+    while (len + 16 <= max_len)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + len));
+        __m128i b = _mm_loadu_si128((const __m128i *)(q + len));
+        mz_uint32 mask = (mz_uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xFFFFU;
+        if (mask)
+            return len + mz_ctz32(mask);
+        len += 16;
+    }
+    return len + mz_match_len_generic(p + len, q + len, max_len - len);
+}
+
+MZ_TARGET("avx2") static mz_uint mz_match_len_avx2(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len)
+{
+    mz_uint len = 0;
+    while (len + 32 <= max_len)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + len));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(q + len));
+        mz_uint32 mask = ~(mz_uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (mask)
+            return len + mz_ctz32(mask);
+        len += 32;
+    }
+    return len + mz_match_len_sse2(p + len, q + len, max_len - len);
+}
+
+MZ_TARGET("sse2") static void mz_match_copy_sse2(mz_uint8 *pDst, const mz_uint8 *pSrc, size_t len)
+{
+    /* 16 byte chunks only give the same result as a byte copy if each chunk reads bytes that are already final. */
+    if ((pSrc > pDst) || ((size_t)(pDst - pSrc) >= 16))
+    {
+        while (len >= 16)
+        {
+            _mm_storeu_si128((__m128i *)pDst, _mm_loadu_si128((const __m128i *)pSrc));
+            pDst += 16;
+            pSrc += 16;
+            len -= 16;
+        }
+    }
+    else if (pDst - pSrc == 1)
+    {
+        memset(pDst, *pSrc, len);
+        return;
+    }
+    mz_match_copy_generic(pDst, pSrc, len);
+}
+
+/* Adler-32 over 32 byte blocks using SSSE3 multiply-adds, after the Chromium zlib implementation. */
+MZ_TARGET("ssse3") static mz_ulong mz_adler32_ssse3(mz_ulong adler, const mz_uint8 *ptr, size_t buf_len)
+{
+    mz_uint32 s1 = (mz_uint32)(adler & 0xffff), s2 = (mz_uint32)(adler >> 16);
+    size_t blocks = buf_len / 32;
+    if (!ptr)
+        return MZ_ADLER32_INIT;
+    buf_len -= blocks * 32;
+    while (blocks)
+    {
+        const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+        const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        /* At most 5552 bytes can be summed before s2 has to be reduced modulo 65521. */
+        mz_uint32 n = (mz_uint32)MZ_MIN(blocks, (size_t)(5552 / 32));
+        __m128i v_ps = _mm_set_epi32(0, 0, 0, (int)(s1 * n));
+        __m128i v_s2 = _mm_set_epi32(0, 0, 0, (int)s2);
+        __m128i v_s1 = _mm_setzero_si128();
+        blocks -= n;
+        do
+        {
+            const __m128i bytes1 = _mm_loadu_si128((const __m128i *)ptr);
+            const __m128i bytes2 = _mm_loadu_si128((const __m128i *)(ptr + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+            ptr += 32;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += (mz_uint32)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = (mz_uint32)_mm_cvtsi128_si32(v_s2);
+        s1 %= 65521U, s2 %= 65521U;
+    }
+    return mz_adler32_generic((s2 << 16) + s1, ptr, buf_len);
+}
+
+/* CRC-32 folding with carry-less multiplication, see Intel's "Fast CRC Computation for Generic Polynomials */
+/* Using PCLMULQDQ Instruction". buf_len must be a multiple of 16 and at least 64. crc is the inverted CRC. */
+MZ_TARGET("sse4.1,pclmul") static mz_uint32 mz_crc32_fold_pclmul(const mz_uint8 *ptr, size_t buf_len, mz_uint32 crc)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(ptr + 0x00)), _mm_cvtsi32_si128((int)crc));
+    x2 = _mm_loadu_si128((const __m128i *)(ptr + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(ptr + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(ptr + 0x30));
+    ptr += 64;
+    buf_len -= 64;
+
+    /* Fold 64 bytes at a time into four accumulators. */
+    x0 = k1k2;
+    while (buf_len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x5), _mm_loadu_si128((const __m128i *)(ptr + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, x0, 0x11), x6), _mm_loadu_si128((const __m128i *)(ptr + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, x0, 0x11), x7), _mm_loadu_si128((const __m128i *)(ptr + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, x0, 0x11), x8), _mm_loadu_si128((const __m128i *)(ptr + 0x30)));
+        ptr += 64;
+        buf_len -= 64;
+    }
+
+    /* Fold the four accumulators into one, then any remaining 16 byte blocks. */
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x4), x5);
+    while (buf_len >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), _mm_loadu_si128((const __m128i *)ptr)), x5);
+        ptr += 16;
+        buf_len -= 16;
+    }
+
+    /* Fold 128 bits to 64 bits, then Barrett reduce to 32 bits. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = k5k0;
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), x0, 0x00), x2);
+    x0 = poly;
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), x0, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (mz_uint32)_mm_extract_epi32(x1, 1);
+}
+
+static mz_ulong mz_crc32_pclmul(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    if (buf_len >= 64)
+    {
+        size_t fold_len = buf_len & ~(size_t)15;
+        crc = (mz_uint32)~mz_crc32_fold_pclmul(ptr, fold_len, (mz_uint32)~crc);
+        ptr += fold_len;
+        buf_len -= fold_len;
+    }
+    return MZ_CRC32_GENERIC(crc, ptr, buf_len);
+}
+
+static void mz_cpuid(mz_uint32 leaf, mz_uint32 subleaf, mz_uint32 regs[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    regs[0] = (mz_uint32)r[0], regs[1] = (mz_uint32)r[1], regs[2] = (mz_uint32)r[2], regs[3] = (mz_uint32)r[3];
+#else
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static mz_uint64 mz_xgetbv0(void)
+{
+#ifdef _MSC_VER
+    return (mz_uint64)_xgetbv(0);
+#else
+    mz_uint32 eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((mz_uint64)edx << 32) | eax;
+#endif
+}
+#endif /* MINIZ_CPU_DISPATCH_X86 */
+
+#ifdef MINIZ_CPU_DISPATCH_ARM_CRC
+#ifdef __clang__
+#define MZ_TARGET_ARM_CRC MZ_TARGET("crc")
+#else
+#define MZ_TARGET_ARM_CRC MZ_TARGET("+crc")
+#endif
+MZ_TARGET_ARM_CRC static mz_ulong mz_crc32_armv8(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    mz_uint32 crc32 = (mz_uint32)crc ^ 0xFFFFFFFF;
+    while ((buf_len) && ((size_t)ptr & 7))
+        crc32 = __crc32b(crc32, *ptr++), --buf_len;
+    while (buf_len >= 8)
+    {
+        mz_uint64 v;
+        memcpy(&v, ptr, sizeof(v));
+        crc32 = __crc32d(crc32, v);
+        ptr += 8;
+        buf_len -= 8;
+    }
+    while (buf_len--)
+        crc32 = __crc32b(crc32, *ptr++);
+    return ~crc32;
+}
+#endif /* MINIZ_CPU_DISPATCH_ARM_CRC */
+
+static mz_cpu_level mz_cpu_detect_max_level(void)
+{
+#if defined(MINIZ_CPU_DISPATCH_X86)
+    mz_uint32 regs[4], max_leaf, ecx1, edx1;
+    mz_cpuid(0, 0, regs);
+    max_leaf = regs[0];
+    if (max_leaf < 1)
+        return MZ_CPU_LEVEL_GENERIC;
+    mz_cpuid(1, 0, regs);
+    ecx1 = regs[2], edx1 = regs[3];
+    if (!(edx1 & (1U << 26)))
+        return MZ_CPU_LEVEL_GENERIC;
+    /* SSSE3 (bit 9), SSE4.1 (bit 19) and PCLMULQDQ (bit 1). */
+    if ((ecx1 & ((1U << 9) | (1U << 19) | (1U << 1))) != ((1U << 9) | (1U << 19) | (1U << 1)))
+        return MZ_CPU_LEVEL_SSE2;
+    /* AVX2 also needs the OS to save the YMM registers (OSXSAVE, bit 27, and XCR0 bits 1 and 2). */
+    if ((max_leaf >= 7) && (ecx1 & (1U << 27)) && ((mz_xgetbv0() & 6) == 6))
+    {
+        mz_cpuid(7, 0, regs);
+        if (regs[1] & (1U << 5))
+            return MZ_CPU_LEVEL_AVX2;
+    }
+    return MZ_CPU_LEVEL_SSE41;
+#elif defined(MINIZ_CPU_DISPATCH_ARM_CRC)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) ? MZ_CPU_LEVEL_ARMV8_CRC : MZ_CPU_LEVEL_GENERIC;
+#else
+    return MZ_CPU_LEVEL_GENERIC;
+#endif
+}
+
+static mz_bool mz_cpu_level_in_range(mz_cpu_level level, mz_cpu_level max_level)
+{
+    if (level == MZ_CPU_LEVEL_GENERIC)
+        return MZ_TRUE;
+    if (max_level == MZ_CPU_LEVEL_ARMV8_CRC)
+        return level == MZ_CPU_LEVEL_ARMV8_CRC;
+    return (level != MZ_CPU_LEVEL_ARMV8_CRC) && (level <= max_level);
+}
+
+static void mz_cpu_fill_kernels(mz_cpu_kernels *pKernels, mz_cpu_level level)
+{
+    pKernels->m_crc32 = MZ_CRC32_GENERIC;
+    pKernels->m_adler32 = mz_adler32_generic;
+    pKernels->m_match_len = mz_match_len_generic;
+    pKernels->m_match_copy = mz_match_copy_generic;
+    pKernels->m_level = level;
+#if defined(MINIZ_CPU_DISPATCH_X86)
+    if ((level == MZ_CPU_LEVEL_SSE2) || (level == MZ_CPU_LEVEL_SSE41) || (level == MZ_CPU_LEVEL_AVX2))
+    {
+        pKernels->m_match_len = mz_match_len_sse2;
+        pKernels->m_match_copy = mz_match_copy_sse2;
+    }
+    if ((level == MZ_CPU_LEVEL_SSE41) || (level == MZ_CPU_LEVEL_AVX2))
+    {
+        pKernels->m_adler32 = mz_adler32_ssse3;
+#ifndef USE_EXTERNAL_MZCRC
+        pKernels->m_crc32 = mz_crc32_pclmul;
+#endif
+    }
+    if (level == MZ_CPU_LEVEL_AVX2)
+        pKernels->m_match_len = mz_match_len_avx2;
+#elif defined(MINIZ_CPU_DISPATCH_ARM_CRC) && !defined(USE_EXTERNAL_MZCRC)
+    if (level == MZ_CPU_LEVEL_ARMV8_CRC)
+        pKernels->m_crc32 = mz_crc32_armv8;
+#endif
+}
+
+static mz_ulong mz_crc32_init_stub(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len);
+static mz_ulong mz_adler32_init_stub(mz_ulong adler, const mz_uint8 *ptr, size_t buf_len);
+static mz_uint mz_match_len_init_stub(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len);
+static void mz_match_copy_init_stub(mz_uint8 *pDst, const mz_uint8 *pSrc, size_t len);
+
+/* The table starts out pointing at stubs which probe the CPU on first use and then forward to the selected kernel. */
+/* Concurrent first calls all store the same pointers, so no locking is needed. */
+static mz_cpu_kernels g_mz_kernels = { mz_crc32_init_stub, mz_adler32_init_stub, mz_match_len_init_stub, mz_match_copy_init_stub, MZ_CPU_LEVEL_GENERIC };
+static mz_cpu_level g_mz_cpu_max_level = MZ_CPU_LEVEL_GENERIC;
+static volatile int g_mz_cpu_initialized = 0;
+
+static mz_cpu_level mz_cpu_parse_level_name(const char *pName, mz_cpu_level default_level)
+{
+    int level;
+    for (level = MZ_CPU_LEVEL_GENERIC; level <= MZ_CPU_LEVEL_ARMV8_CRC; ++level)
+    {
+        if (!strcmp(pName, mz_cpu_get_level_name((mz_cpu_level)level)))
+            return (mz_cpu_level)level;
+    }
+    return default_level;
+}
+
+static void mz_cpu_init(void)
+{
+    mz_cpu_kernels kernels;
+    mz_cpu_level max_level, level;
+    const char *pEnv;
+    if (g_mz_cpu_initialized)
+        return;
+    max_level = mz_cpu_detect_max_level();
+    level = max_level;
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4996)
+#endif
+    pEnv = getenv("MINIZ_CPU_LEVEL");
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+    if ((pEnv) && (*pEnv))
+    {
+        level = mz_cpu_parse_level_name(pEnv, max_level);
+        if (!mz_cpu_level_in_range(level, max_level))
+            level = max_level;
+    }
+    mz_cpu_fill_kernels(&kernels, level);
+    g_mz_cpu_max_level = max_level;
+    g_mz_kernels = kernels;
+    g_mz_cpu_initialized = 1;
+}
+
+static mz_ulong mz_crc32_init_stub(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    mz_cpu_init();
+    return g_mz_kernels.m_crc32(crc, ptr, buf_len);
+}
+
+static mz_ulong mz_adler32_init_stub(mz_ulong adler, const mz_uint8 *ptr, size_t buf_len)
+{
+    mz_cpu_init();
+    return g_mz_kernels.m_adler32(adler, ptr, buf_len);
+}
+
+static mz_uint mz_match_len_init_stub(const mz_uint8 *p, const mz_uint8 *q, mz_uint max_len)
+{
+    mz_cpu_init();
+    return g_mz_kernels.m_match_len(p, q, max_len);
+}
+
+static void mz_match_copy_init_stub(mz_uint8 *pDst, const mz_uint8 *pSrc, size_t len)
+{
+    mz_cpu_init();
+    g_mz_kernels.m_match_copy(pDst, pSrc, len);
+}
+
+mz_cpu_level mz_cpu_get_level(void)
+{
+    mz_cpu_init();
+    return g_mz_kernels.m_level;
+}
+
+mz_cpu_level mz_cpu_get_max_level(void)
+{
+    mz_cpu_init();
+    return g_mz_cpu_max_level;
+}
+
+mz_bool mz_cpu_is_level_supported(mz_cpu_level level)
+{
+    return mz_cpu_level_in_range(level, mz_cpu_get_max_level());
+}
+
+mz_bool mz_cpu_set_level(mz_cpu_level level)
+{
+    mz_cpu_kernels kernels;
+    if (!mz_cpu_is_level_supported(level))
+        return MZ_FALSE;
+    mz_cpu_fill_kernels(&kernels, level);
+    g_mz_kernels = kernels;
+    return MZ_TRUE;
+}
+
+const char *mz_cpu_get_level_name(mz_cpu_level level)
+{
+    switch (level)
+    {
+        case MZ_CPU_LEVEL_GENERIC:
+            return "generic";
+        case MZ_CPU_LEVEL_SSE2:
+            return "sse2";
+        case MZ_CPU_LEVEL_SSE41:
+            return "sse41";
+        case MZ_CPU_LEVEL_AVX2:
+            return "avx2";
+        case MZ_CPU_LEVEL_ARMV8_CRC:
+            return "armv8crc";
+    }
+    return "unknown";
+}
+
+mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
+{
+    return g_mz_kernels.m_adler32(adler, ptr, buf_len);
+}
+
+#ifndef USE_EXTERNAL_MZCRC
+mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    return g_mz_kernels.m_crc32(crc, ptr, buf_len);
+}
+#endif
+
+/* Appending zeros is linear in the CRC register, so it can be done by squaring the operator for one zero bit
+   (as zlib's crc32_combine does) in O(log n) steps rather than reading n zero bytes. */
+static mz_uint32 mz_crc32_gf2_times(const mz_uint32 *mat, mz_uint32 vec)
+{
+    mz_uint32 sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void mz_crc32_gf2_square(mz_uint32 *square, const mz_uint32 *mat)
+{
+    int n;
+    for (n = 0; n < 32; n++)
+        square[n] = mz_crc32_gf2_times(mat, mat[n]);
+}
+
+mz_ulong mz_crc32_zeros(mz_ulong crc, size_t len)
+{
+    mz_uint32 even[32], odd[32], reg = ~(mz_uint32)crc;
+    mz_uint32 row = 1;
+    int n;
+
+    if (!len)
+        return crc;
+
+    /* The operator for one zero bit, then two and four */
+    odd[0] = 0xEDB88320UL;
+    for (n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    mz_crc32_gf2_square(even, odd);
+    mz_crc32_gf2_square(odd, even);
+
+    /* Apply the operators for each set bit of len, starting from one byte */
+    do
+    {
+        mz_crc32_gf2_square(even, odd);
+        if (len & 1)
+            reg = mz_crc32_gf2_times(even, reg);
+        len >>= 1;
+        if (!len)
+            break;
+        mz_crc32_gf2_square(odd, even);
+        if (len & 1)
+            reg = mz_crc32_gf2_times(odd, reg);
+        len >>= 1;
+    } while (len);
+
+    return ~reg;
+}
+
 void mz_free(void *p)
 {
     MZ_FREE(p);
@@ -1259,10 +1806,10 @@ static int tdefl_flush_block(tdefl_compressor *d, int flush)
     mz_uint8 *pSaved_output_buf;
     mz_bool comp_block_succeeded = MZ_FALSE;
     int n, use_raw_block = ((d->m_flags & TDEFL_FORCE_ALL_RAW_BLOCKS) != 0) && (d->m_lookahead_pos - d->m_lz_code_buf_dict_pos) <= d->m_dict_size;
-    mz_uint8 *pOutput_buf_start = ((d->m_pPut_buf_func == NULL) && ((*d->m_pOut_buf_size - d->m_out_buf_ofs) >= TDEFL_OUT_BUF_SIZE)) ? ((mz_uint8 *)d->m_pOut_buf + d->m_out_buf_ofs) : d->m_output_buf;
+    mz_uint8 *pOutput_buf_start = ((d->m_pPut_buf_func == NULL) && ((*d->m_pOut_buf_size - d->m_out_buf_ofs) >= d->m_out_buf_size)) ? ((mz_uint8 *)d->m_pOut_buf + d->m_out_buf_ofs) : d->m_output_buf;
 
     d->m_pOutput_buf = pOutput_buf_start;
-    d->m_pOutput_buf_end = d->m_pOutput_buf + TDEFL_OUT_BUF_SIZE - 16;
+    d->m_pOutput_buf_end = d->m_pOutput_buf + d->m_out_buf_size - 16;
 
     MZ_ASSERT(!d->m_output_flush_remaining);
     d->m_output_flush_ofs = 0;
@@ -1482,7 +2029,7 @@ static MZ_FORCEINLINE void tdefl_find_match(tdefl_compressor *d, mz_uint lookahe
 {
     mz_uint dist, pos = lookahead_pos & TDEFL_LZ_DICT_SIZE_MASK, match_len = *pMatch_len, probe_pos = pos, next_probe_pos, probe_len;
     mz_uint num_probes_left = d->m_max_probes[match_len >= 32];
-    const mz_uint8 *s = d->m_dict + pos, *p, *q;
+    const mz_uint8 *s = d->m_dict + pos;
     mz_uint8 c0 = d->m_dict[pos + match_len], c1 = d->m_dict[pos + match_len - 1];
     MZ_ASSERT(max_match_len <= TDEFL_MAX_MATCH_LEN);
     if (max_match_len <= match_len)
@@ -1506,11 +2053,7 @@ static MZ_FORCEINLINE void tdefl_find_match(tdefl_compressor *d, mz_uint lookahe
         }
         if (!dist)
             break;
-        p = s;
-        q = d->m_dict + probe_pos;
-        for (probe_len = 0; probe_len < max_match_len; probe_len++)
-            if (*p++ != *q++)
-                break;
+        probe_len = g_mz_kernels.m_match_len(s, d->m_dict + probe_pos, max_match_len);
         if (probe_len > match_len)
         {
             *pMatch_dist = dist;
@@ -1638,7 +2181,7 @@ static mz_bool tdefl_compress_fast(tdefl_compressor *d)
             MZ_ASSERT(lookahead_size >= cur_match_len);
             lookahead_size -= cur_match_len;
 
-            if (pLZ_code_buf > &d->m_lz_code_buf[TDEFL_LZ_CODE_BUF_SIZE - 8])
+            if (pLZ_code_buf > &d->m_lz_code_buf[d->m_lz_code_buf_size - 8])
             {
                 int n;
                 d->m_lookahead_pos = lookahead_pos;
@@ -1677,7 +2220,7 @@ static mz_bool tdefl_compress_fast(tdefl_compressor *d)
             cur_pos = (cur_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK;
             lookahead_size--;
 
-            if (pLZ_code_buf > &d->m_lz_code_buf[TDEFL_LZ_CODE_BUF_SIZE - 8])
+            if (pLZ_code_buf > &d->m_lz_code_buf[d->m_lz_code_buf_size - 8])
             {
                 int n;
                 d->m_lookahead_pos = lookahead_pos;
@@ -1749,6 +2292,83 @@ static MZ_FORCEINLINE void tdefl_record_match(tdefl_compressor *d, mz_uint match
     d->m_huff_count[0][s_tdefl_len_sym[match_len - TDEFL_MIN_MATCH_LEN]]++;
 }
 
+static MZ_FORCEINLINE mz_bool tdefl_is_run(const mz_uint8 *p, mz_uint n, mz_uint8 c)
+{
+    mz_uint i;
+    for (i = 0; i < n; i++)
+    {
+        if (p[i] != c)
+            return MZ_FALSE;
+    }
+    return MZ_TRUE;
+}
+
+/* Writes n copies of c into the dictionary from pos, including the copy past the end used by the match finder. */
+static void tdefl_fill_dict(tdefl_compressor *d, mz_uint pos, mz_uint8 c, mz_uint n)
+{
+    while (n)
+    {
+        mz_uint run = MZ_MIN(n, TDEFL_LZ_DICT_SIZE - pos);
+        memset(d->m_dict + pos, c, run);
+        if (pos < (TDEFL_MAX_MATCH_LEN - 1))
+            memset(d->m_dict + TDEFL_LZ_DICT_SIZE + pos, c, MZ_MIN(run, (TDEFL_MAX_MATCH_LEN - 1) - pos));
+        pos = (pos + run) & TDEFL_LZ_DICT_SIZE_MASK;
+        n -= run;
+    }
+}
+
+/* Fast path for long runs of one byte value (e.g. the zeros in sparse files). Each TDEFL_MAX_MATCH_LEN bytes of the
+   run are recorded as a maximum length match at distance 1 without searching the hash chains, and the bytes are
+   copied into the dictionary without inserting them into the chains. Stale chain entries are harmless, since the
+   match finder always compares the dictionary bytes. Each step checks that the next TDEFL_MAX_MATCH_LEN input bytes
+   equal the lookahead, which holds nothing but the run byte, and stops at the first step where they don't.
+   Precondition: called between tdefl_compress_normal steps, with a full lookahead and no saved match, in a
+   compressor that isn't forcing raw blocks or filtering matches.
+   Returns MZ_FALSE, having consumed nothing, if any of that doesn't hold, or if the byte before the lookahead, the
+   lookahead and the next TDEFL_MAX_MATCH_LEN input bytes aren't all the same value. Otherwise consumes the run, a
+   whole number of TDEFL_MAX_MATCH_LEN steps, and returns MZ_TRUE. *pFlush_result is non-zero if a block had to be
+   flushed part way through, in which case check m_prev_return_status and m_output_flush_remaining as after
+   tdefl_flush_block. */
+static mz_bool tdefl_compress_run(tdefl_compressor *d, const mz_uint8 **ppSrc, size_t *pSrc_buf_left, int *pFlush_result)
+{
+    mz_uint cur_pos = d->m_lookahead_pos & TDEFL_LZ_DICT_SIZE_MASK, filled = 0;
+    mz_uint8 c;
+
+    *pFlush_result = 0;
+    if ((d->m_saved_match_len) || (!d->m_dict_size) || (d->m_lookahead_size != TDEFL_MAX_MATCH_LEN) || (*pSrc_buf_left < TDEFL_MAX_MATCH_LEN) ||
+        (d->m_flags & (TDEFL_FORCE_ALL_RAW_BLOCKS | TDEFL_FILTER_MATCHES)))
+        return MZ_FALSE;
+
+    c = d->m_dict[(cur_pos - 1) & TDEFL_LZ_DICT_SIZE_MASK];
+    if ((!tdefl_is_run(d->m_dict + cur_pos, TDEFL_MAX_MATCH_LEN, c)) || (!tdefl_is_run(*ppSrc, TDEFL_MAX_MATCH_LEN, c)))
+        return MZ_FALSE;
+
+    do
+    {
+        tdefl_record_match(d, TDEFL_MAX_MATCH_LEN, 1);
+
+        /* Once the whole dictionary holds the run there's nothing left to write */
+        if (filled < TDEFL_LZ_DICT_SIZE + TDEFL_MAX_MATCH_LEN)
+        {
+            tdefl_fill_dict(d, (d->m_lookahead_pos + d->m_lookahead_size) & TDEFL_LZ_DICT_SIZE_MASK, c, TDEFL_MAX_MATCH_LEN);
+            filled += TDEFL_MAX_MATCH_LEN;
+        }
+        d->m_lookahead_pos += TDEFL_MAX_MATCH_LEN;
+        d->m_dict_size = MZ_MIN(d->m_dict_size + TDEFL_MAX_MATCH_LEN, (mz_uint)(TDEFL_LZ_DICT_SIZE - TDEFL_MAX_MATCH_LEN));
+        *ppSrc += TDEFL_MAX_MATCH_LEN;
+        *pSrc_buf_left -= TDEFL_MAX_MATCH_LEN;
+
+        if (d->m_pLZ_code_buf > &d->m_lz_code_buf[d->m_lz_code_buf_size - 8])
+        {
+            d->m_pSrc = *ppSrc;
+            d->m_src_buf_left = *pSrc_buf_left;
+            if ((*pFlush_result = tdefl_flush_block(d, 0)) != 0)
+                return MZ_TRUE;
+        }
+    } while ((*pSrc_buf_left >= TDEFL_MAX_MATCH_LEN) && (!memcmp(*ppSrc, d->m_dict + (d->m_lookahead_pos & TDEFL_LZ_DICT_SIZE_MASK), TDEFL_MAX_MATCH_LEN)));
+    return MZ_TRUE;
+}
+
 static mz_bool tdefl_compress_normal(tdefl_compressor *d)
 {
     const mz_uint8 *pSrc = d->m_pSrc;
@@ -1762,7 +2382,7 @@ static mz_bool tdefl_compress_normal(tdefl_compressor *d)
         if ((d->m_lookahead_size + d->m_dict_size) >= (TDEFL_MIN_MATCH_LEN - 1))
         {
             mz_uint dst_pos = (d->m_lookahead_pos + d->m_lookahead_size) & TDEFL_LZ_DICT_SIZE_MASK, ins_pos = d->m_lookahead_pos + d->m_lookahead_size - 2;
-            mz_uint hash = (d->m_dict[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] << TDEFL_LZ_HASH_SHIFT) ^ d->m_dict[(ins_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK];
+            mz_uint hash = (d->m_dict[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] << d->m_hash_shift) ^ d->m_dict[(ins_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK];
             mz_uint num_bytes_to_process = (mz_uint)MZ_MIN(src_buf_left, TDEFL_MAX_MATCH_LEN - d->m_lookahead_size);
             const mz_uint8 *pSrc_end = pSrc ? pSrc + num_bytes_to_process : NULL;
             src_buf_left -= num_bytes_to_process;
@@ -1773,7 +2393,7 @@ static mz_bool tdefl_compress_normal(tdefl_compressor *d)
                 d->m_dict[dst_pos] = c;
                 if (dst_pos < (TDEFL_MAX_MATCH_LEN - 1))
                     d->m_dict[TDEFL_LZ_DICT_SIZE + dst_pos] = c;
-                hash = ((hash << TDEFL_LZ_HASH_SHIFT) ^ c) & (TDEFL_LZ_HASH_SIZE - 1);
+                hash = ((hash << d->m_hash_shift) ^ c) & (d->m_hash_size - 1);
                 d->m_next[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] = d->m_hash[hash];
                 d->m_hash[hash] = (mz_uint16)(ins_pos);
                 dst_pos = (dst_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK;
@@ -1793,7 +2413,7 @@ static mz_bool tdefl_compress_normal(tdefl_compressor *d)
                 if ((++d->m_lookahead_size + d->m_dict_size) >= TDEFL_MIN_MATCH_LEN)
                 {
                     mz_uint ins_pos = d->m_lookahead_pos + (d->m_lookahead_size - 1) - 2;
-                    mz_uint hash = ((d->m_dict[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] << (TDEFL_LZ_HASH_SHIFT * 2)) ^ (d->m_dict[(ins_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK] << TDEFL_LZ_HASH_SHIFT) ^ c) & (TDEFL_LZ_HASH_SIZE - 1);
+                    mz_uint hash = ((d->m_dict[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] << (d->m_hash_shift * 2)) ^ (d->m_dict[(ins_pos + 1) & TDEFL_LZ_DICT_SIZE_MASK] << d->m_hash_shift) ^ c) & (d->m_hash_size - 1);
                     d->m_next[ins_pos & TDEFL_LZ_DICT_SIZE_MASK] = d->m_hash[hash];
                     d->m_hash[hash] = (mz_uint16)(ins_pos);
                 }
@@ -1803,6 +2423,16 @@ static mz_bool tdefl_compress_normal(tdefl_compressor *d)
         if ((!flush) && (d->m_lookahead_size < TDEFL_MAX_MATCH_LEN))
             break;
 
+        {
+            int n;
+            if (tdefl_compress_run(d, &pSrc, &src_buf_left, &n))
+            {
+                if (n != 0)
+                    return (n < 0) ? MZ_FALSE : MZ_TRUE;
+                continue;
+            }
+        }
+
         /* Simple lazy/greedy parsing state machine. */
         len_to_move = 1;
         cur_match_dist = 0;
@@ -1878,7 +2508,7 @@ static mz_bool tdefl_compress_normal(tdefl_compressor *d)
         d->m_lookahead_size -= len_to_move;
         d->m_dict_size = MZ_MIN(d->m_dict_size + len_to_move, (mz_uint)TDEFL_LZ_DICT_SIZE);
         /* Check if it's time to flush the current LZ codes to the internal output buffer. */
-        if ((d->m_pLZ_code_buf > &d->m_lz_code_buf[TDEFL_LZ_CODE_BUF_SIZE - 8]) ||
+        if ((d->m_pLZ_code_buf > &d->m_lz_code_buf[d->m_lz_code_buf_size - 8]) ||
             ((d->m_total_lz_bytes > 31 * 1024) && (((((mz_uint)(d->m_pLZ_code_buf - d->m_lz_code_buf) * 115) >> 7) >= d->m_total_lz_bytes) || (d->m_flags & TDEFL_FORCE_ALL_RAW_BLOCKS))))
         {
             int n;
@@ -1974,7 +2604,7 @@ tdefl_status tdefl_compress(tdefl_compressor *d, const void *pIn_buf, size_t *pI
         d->m_finished = (flush == TDEFL_FINISH);
         if (flush == TDEFL_FULL_FLUSH)
         {
-            MZ_CLEAR_ARR(d->m_hash);
+            memset(d->m_hash, 0, d->m_hash_size * sizeof(d->m_hash[0]));
             MZ_CLEAR_ARR(d->m_next);
             d->m_dict_size = 0;
         }
@@ -1997,8 +2627,29 @@ tdefl_status tdefl_init(tdefl_compressor *d, tdefl_put_buf_func_ptr pPut_buf_fun
     d->m_max_probes[0] = 1 + ((flags & 0xFFF) + 2) / 3;
     d->m_greedy_parsing = (flags & TDEFL_GREEDY_PARSING_FLAG) != 0;
     d->m_max_probes[1] = 1 + (((flags & 0xFFF) >> 2) + 2) / 3;
+    if (flags & TDEFL_LOW_MEMORY_FLAG)
+    {
+        d->m_hash_size = TDEFL_LOW_MEMORY_LZ_HASH_SIZE;
+        d->m_hash_shift = TDEFL_LOW_MEMORY_LZ_HASH_SHIFT;
+        d->m_lz_code_buf_size = TDEFL_LOW_MEMORY_LZ_CODE_BUF_SIZE;
+        d->m_out_buf_size = TDEFL_LOW_MEMORY_OUT_BUF_SIZE;
+    }
+    else
+    {
+        d->m_hash_size = TDEFL_LZ_HASH_SIZE;
+        d->m_hash_shift = TDEFL_LZ_HASH_SHIFT;
+        d->m_lz_code_buf_size = TDEFL_LZ_CODE_BUF_SIZE;
+        d->m_out_buf_size = TDEFL_OUT_BUF_SIZE;
+    }
+    d->m_hash = (mz_uint16 *)d->m_storage;
+    d->m_lz_code_buf = d->m_storage + d->m_hash_size * sizeof(mz_uint16);
+    d->m_output_buf = d->m_lz_code_buf + d->m_lz_code_buf_size;
     if (!(flags & TDEFL_NONDETERMINISTIC_PARSING_FLAG))
-        MZ_CLEAR_ARR(d->m_hash);
+    {
+        memset(d->m_hash, 0, d->m_hash_size * sizeof(d->m_hash[0]));
+        /* A reused compressor still has the last stream's hash chains, which change the matches found near the end of the input */
+        MZ_CLEAR_ARR(d->m_next);
+    }
     d->m_lookahead_pos = d->m_lookahead_size = d->m_dict_size = d->m_total_lz_bytes = d->m_lz_code_buf_dict_pos = d->m_bits_in = 0;
     d->m_output_flush_ofs = d->m_output_flush_remaining = d->m_finished = d->m_block_index = d->m_bit_buffer = d->m_wants_to_finish = 0;
     d->m_pLZ_code_buf = d->m_lz_code_buf + 1;
@@ -2025,6 +2676,13 @@ tdefl_status tdefl_init(tdefl_compressor *d, tdefl_put_buf_func_ptr pPut_buf_fun
     return TDEFL_STATUS_OKAY;
 }
 
+size_t tdefl_compressor_size(int flags)
+{
+    if (flags & TDEFL_LOW_MEMORY_FLAG)
+        return offsetof(tdefl_compressor, m_storage) + TDEFL_LOW_MEMORY_LZ_HASH_SIZE * sizeof(mz_uint16) + TDEFL_LOW_MEMORY_LZ_CODE_BUF_SIZE + TDEFL_LOW_MEMORY_OUT_BUF_SIZE;
+    return sizeof(tdefl_compressor);
+}
+
 tdefl_status tdefl_get_prev_return_status(tdefl_compressor *d)
 {
     return d->m_prev_return_status;
@@ -2794,6 +3452,12 @@ tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_nex
                     }
                     continue;
                 }
+                else if (counter >= 16)
+                {
+                    g_mz_kernels.m_match_copy(pOut_buf_cur, pSrc, counter);
+                    pOut_buf_cur += counter;
+                    continue;
+                }
 #if MINIZ_USE_UNALIGNED_LOADS_AND_STORES
                 else if ((counter >= 9) && (counter <= dist))
                 {
@@ -3482,6 +4146,89 @@ static MZ_FORCEINLINE mz_bool mz_zip_set_error(mz_zip_archive *pZip, mz_zip_erro
     return MZ_FALSE;
 }
 
+/* ------------------- Reusable entry state */
+
+static size_t mz_zip_scratch_slot_size(mz_zip_scratch_slot slot)
+{
+    switch (slot)
+    {
+#ifndef MINIZ_NO_INFLATE_APIS
+        case MZ_ZIP_SCRATCH_DECOMPRESSOR:
+            return sizeof(tinfl_decompressor);
+#endif
+        case MZ_ZIP_SCRATCH_READ_BUF:
+            return MZ_ZIP_MAX_IO_BUF_SIZE;
+        case MZ_ZIP_SCRATCH_DICT:
+            return TINFL_LZ_DICT_SIZE;
+        default:
+            return 0;
+    }
+}
+
+void mz_zip_entry_state_init(mz_zip_entry_state *pState)
+{
+    if (pState)
+        memset(pState, 0, sizeof(*pState));
+}
+
+static void mz_zip_scratch_free(mz_zip_entry_state *pState, mz_zip_scratch_slot slot)
+{
+    if (!pState->m_pSlots[slot])
+        return;
+    if (pState->m_pFree)
+        pState->m_pFree(pState->m_pAlloc_opaque, pState->m_pSlots[slot], pState->m_slot_sizes[slot]);
+    else
+        MZ_FREE(pState->m_pSlots[slot]);
+    pState->m_pSlots[slot] = NULL;
+    pState->m_slot_sizes[slot] = 0;
+}
+
+void mz_zip_entry_state_end(mz_zip_entry_state *pState)
+{
+    int i;
+    if (!pState)
+        return;
+    for (i = 0; i < MZ_ZIP_SCRATCH_TOTAL; i++)
+        mz_zip_scratch_free(pState, (mz_zip_scratch_slot)i);
+    memset(pState, 0, sizeof(*pState));
+}
+
+/* Returns the pooled buffer for slot if the archive has an entry state with that slot free, otherwise allocates size bytes with the archive's allocator. */
+/* Pooled buffers are at least mz_zip_scratch_slot_size() bytes, and are reallocated if a bigger one is needed (e.g. a full size compressor after a TDEFL_LOW_MEMORY_FLAG one). */
+static void *mz_zip_scratch_acquire(mz_zip_archive *pZip, mz_zip_scratch_slot slot, size_t size)
+{
+    mz_zip_entry_state *pState = pZip->m_pEntry_state;
+    if ((pState) && (!(pState->m_busy_mask & (1U << slot))))
+    {
+        if ((pState->m_pSlots[slot]) && (size <= pState->m_slot_sizes[slot]))
+            pState->m_reuse_count++;
+        else
+        {
+            size_t alloc_size = MZ_MAX(size, mz_zip_scratch_slot_size(slot));
+            mz_zip_scratch_free(pState, slot);
+            pState->m_pSlots[slot] = pState->m_pAlloc ? pState->m_pAlloc(pState->m_pAlloc_opaque, &alloc_size) : MZ_MALLOC(alloc_size);
+            if (!pState->m_pSlots[slot])
+                return NULL;
+            pState->m_slot_sizes[slot] = alloc_size;
+            pState->m_alloc_count++;
+        }
+        pState->m_busy_mask |= 1U << slot;
+        return pState->m_pSlots[slot];
+    }
+    return pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, size);
+}
+
+static void mz_zip_scratch_release(mz_zip_archive *pZip, mz_zip_scratch_slot slot, void *p)
+{
+    mz_zip_entry_state *pState = pZip->m_pEntry_state;
+    if (!p)
+        return;
+    if ((pState) && (p == pState->m_pSlots[slot]))
+        pState->m_busy_mask &= ~(1U << slot);
+    else
+        pZip->m_pFree(pZip->m_pAlloc_opaque, p);
+}
+
 static mz_bool mz_zip_reader_init_internal(mz_zip_archive *pZip, mz_uint flags)
 {
     (void)flags;
@@ -4573,7 +5320,7 @@ mz_bool mz_zip_reader_extract_to_mem_no_alloc1(mz_zip_archive *pZip, mz_uint fil
         if (((sizeof(size_t) == sizeof(mz_uint32))) && (read_buf_size > 0x7FFFFFFF))
             return mz_zip_set_error(pZip, MZ_ZIP_INTERNAL_ERROR);
 
-        if (NULL == (pRead_buf = pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, (size_t)read_buf_size)))
+        if (NULL == (pRead_buf = mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_READ_BUF, (size_t)read_buf_size)))
             return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
 
         read_buf_avail = 0;
@@ -4622,7 +5369,7 @@ mz_bool mz_zip_reader_extract_to_mem_no_alloc1(mz_zip_archive *pZip, mz_uint fil
     }
 
     if ((!pZip->m_pState->m_pMem) && (!pUser_read_buf))
-        pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+        mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
 
     return status == TINFL_STATUS_DONE;
 }
@@ -4708,6 +5455,7 @@ mz_bool mz_zip_reader_extract_to_callback(mz_zip_archive *pZip, mz_uint file_ind
     mz_zip_archive_file_stat file_stat;
     void *pRead_buf = NULL;
     void *pWrite_buf = NULL;
+    tinfl_decompressor *pInflator = NULL;
     mz_uint32 local_header_u32[(MZ_ZIP_LOCAL_DIR_HEADER_SIZE + sizeof(mz_uint32) - 1) / sizeof(mz_uint32)];
     mz_uint8 *pLocal_header = (mz_uint8 *)local_header_u32;
 
@@ -4751,7 +5499,7 @@ mz_bool mz_zip_reader_extract_to_callback(mz_zip_archive *pZip, mz_uint file_ind
     else
     {
         read_buf_size = MZ_MIN(file_stat.m_comp_size, (mz_uint64)MZ_ZIP_MAX_IO_BUF_SIZE);
-        if (NULL == (pRead_buf = pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, (size_t)read_buf_size)))
+        if (NULL == (pRead_buf = mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_READ_BUF, (size_t)read_buf_size)))
             return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
 
         read_buf_avail = 0;
@@ -4816,16 +5564,16 @@ mz_bool mz_zip_reader_extract_to_callback(mz_zip_archive *pZip, mz_uint file_ind
     }
     else
     {
-        tinfl_decompressor inflator;
-        tinfl_init(&inflator);
-
-        if (NULL == (pWrite_buf = pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, TINFL_LZ_DICT_SIZE)))
+        if ((NULL == (pInflator = (tinfl_decompressor *)mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_DECOMPRESSOR, sizeof(tinfl_decompressor)))) ||
+            (NULL == (pWrite_buf = mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_DICT, TINFL_LZ_DICT_SIZE))))
         {
             mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
             status = TINFL_STATUS_FAILED;
         }
         else
         {
+            tinfl_init(pInflator);
+
             do
             {
                 mz_uint8 *pWrite_buf_cur = (mz_uint8 *)pWrite_buf + (out_buf_ofs & (TINFL_LZ_DICT_SIZE - 1));
@@ -4845,7 +5593,7 @@ mz_bool mz_zip_reader_extract_to_callback(mz_zip_archive *pZip, mz_uint file_ind
                 }
 
                 in_buf_size = (size_t)read_buf_avail;
-                status = tinfl_decompress(&inflator, (const mz_uint8 *)pRead_buf + read_buf_ofs, &in_buf_size, (mz_uint8 *)pWrite_buf, pWrite_buf_cur, &out_buf_size, comp_remaining ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+                status = tinfl_decompress(pInflator, (const mz_uint8 *)pRead_buf + read_buf_ofs, &in_buf_size, (mz_uint8 *)pWrite_buf, pWrite_buf_cur, &out_buf_size, comp_remaining ? TINFL_FLAG_HAS_MORE_INPUT : 0);
                 read_buf_avail -= in_buf_size;
                 read_buf_ofs += in_buf_size;
 
@@ -4890,10 +5638,10 @@ mz_bool mz_zip_reader_extract_to_callback(mz_zip_archive *pZip, mz_uint file_ind
     }
 
     if (!pZip->m_pState->m_pMem)
-        pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+        mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
 
-    if (pWrite_buf)
-        pZip->m_pFree(pZip->m_pAlloc_opaque, pWrite_buf);
+    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_DECOMPRESSOR, pInflator);
+    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_DICT, pWrite_buf);
 
     return status == TINFL_STATUS_DONE;
 }
@@ -6039,6 +6787,14 @@ static mz_bool mz_zip_writer_add_put_buf_callback(const void *pBuf, int len, voi
     return MZ_TRUE;
 }
 
+static int mz_zip_writer_get_comp_flags(mz_uint level, mz_uint level_and_flags)
+{
+    int comp_flags = (int)tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY);
+    if (level_and_flags & MZ_ZIP_FLAG_LOW_MEMORY)
+        comp_flags |= TDEFL_LOW_MEMORY_FLAG;
+    return comp_flags;
+}
+
 #define MZ_ZIP64_MAX_LOCAL_EXTRA_FIELD_SIZE (sizeof(mz_uint16) * 2 + sizeof(mz_uint64) * 2)
 #define MZ_ZIP64_MAX_CENTRAL_EXTRA_FIELD_SIZE (sizeof(mz_uint16) * 2 + sizeof(mz_uint64) * 3)
 static mz_uint32 mz_zip_writer_create_zip64_extra_data(mz_uint8 *pBuf, mz_uint64 *pUncomp_size, mz_uint64 *pComp_size, mz_uint64 *pLocal_header_ofs)
@@ -6195,6 +6951,26 @@ static mz_bool mz_zip_writer_write_zeros(mz_zip_archive *pZip, mz_uint64 cur_fil
     return MZ_TRUE;
 }
 
+mz_bool mz_zip_writer_reserve(mz_zip_archive *pZip, mz_uint num_files, mz_uint64 total_name_size)
+{
+    mz_zip_internal_state *pState;
+    mz_uint64 central_dir_size;
+
+    if ((!pZip) || (!pZip->m_pState) || (pZip->m_zip_mode != MZ_ZIP_MODE_WRITING))
+        return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
+
+    pState = pZip->m_pState;
+    central_dir_size = (mz_uint64)pState->m_central_dir.m_size + total_name_size + (mz_uint64)num_files * (MZ_ZIP_CENTRAL_DIR_HEADER_SIZE + MZ_ZIP64_MAX_CENTRAL_EXTRA_FIELD_SIZE);
+    if ((central_dir_size >= MZ_UINT32_MAX) || ((mz_uint64)pZip->m_total_files + num_files > MZ_UINT32_MAX))
+        return mz_zip_set_error(pZip, MZ_ZIP_TOO_MANY_FILES);
+
+    if ((!mz_zip_array_reserve(pZip, &pState->m_central_dir, (size_t)central_dir_size, MZ_FALSE)) ||
+        (!mz_zip_array_reserve(pZip, &pState->m_central_dir_offsets, pZip->m_total_files + num_files, MZ_FALSE)))
+        return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
+
+    return MZ_TRUE;
+}
+
 mz_bool mz_zip_writer_add_mem_ex(mz_zip_archive *pZip, const char *pArchive_name, const void *pBuf, size_t buf_size, const void *pComment, mz_uint16 comment_size, mz_uint level_and_flags,
                                  mz_uint64 uncomp_size, mz_uint32 uncomp_crc32)
 {
@@ -6217,6 +6993,7 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
     mz_uint32 extra_size = 0;
     mz_uint8 extra_data[MZ_ZIP64_MAX_CENTRAL_EXTRA_FIELD_SIZE];
     mz_uint16 bit_flags = 0;
+    mz_bool crc_while_compressing;
 
     if ((int)level_and_flags < 0)
         level_and_flags = MZ_DEFAULT_LEVEL;
@@ -6275,7 +7052,6 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
 
 	if (!(level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA))
 	{
-		uncomp_crc32 = (mz_uint32)mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)pBuf, buf_size);
 		uncomp_size = buf_size;
 		if (uncomp_size <= 3)
 		{
@@ -6284,6 +7060,13 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
 		}
 	}
 
+    /* With a progress callback, the CRC is worked out chunk by chunk as the data is compressed, so the input is only
+       read once and the callback can drop the pages that have been consumed (e.g. from a memory mapped file). The
+       local header doesn't need the CRC, it goes in the data descriptor. */
+    crc_while_compressing = (pZip->m_pProgress != NULL) && (!store_data_uncompressed) && (!(level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA));
+    if (!(level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA))
+        uncomp_crc32 = crc_while_compressing ? (mz_uint32)MZ_CRC32_INIT : (mz_uint32)mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)pBuf, buf_size);
+
     archive_name_size = strlen(pArchive_name);
     if (archive_name_size > MZ_UINT16_MAX)
         return mz_zip_set_error(pZip, MZ_ZIP_INVALID_FILENAME);
@@ -6323,13 +7106,13 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
 
     if ((!store_data_uncompressed) && (buf_size))
     {
-        if (NULL == (pComp = (tdefl_compressor *)pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, sizeof(tdefl_compressor))))
+        if (NULL == (pComp = (tdefl_compressor *)mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, tdefl_compressor_size(mz_zip_writer_get_comp_flags(level, level_and_flags)))))
             return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
     }
 
     if (!mz_zip_writer_write_zeros(pZip, cur_archive_file_ofs, num_alignment_padding_bytes))
     {
-        pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+        mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
         return MZ_FALSE;
     }
 
@@ -6366,7 +7149,7 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
 
         if (pZip->m_pWrite(pZip->m_pIO_opaque, cur_archive_file_ofs, pArchive_name, archive_name_size) != archive_name_size)
         {
-            pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
             return mz_zip_set_error(pZip, MZ_ZIP_FILE_WRITE_FAILED);
         }
         cur_archive_file_ofs += archive_name_size;
@@ -6393,7 +7176,7 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
 
         if (pZip->m_pWrite(pZip->m_pIO_opaque, cur_archive_file_ofs, pArchive_name, archive_name_size) != archive_name_size)
         {
-            pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
             return mz_zip_set_error(pZip, MZ_ZIP_FILE_WRITE_FAILED);
         }
         cur_archive_file_ofs += archive_name_size;
@@ -6411,7 +7194,7 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
     {
         if (pZip->m_pWrite(pZip->m_pIO_opaque, cur_archive_file_ofs, pBuf, buf_size) != buf_size)
         {
-            pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
             return mz_zip_set_error(pZip, MZ_ZIP_FILE_WRITE_FAILED);
         }
 
@@ -6426,10 +7209,63 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
         state.m_cur_archive_file_ofs = cur_archive_file_ofs;
         state.m_comp_size = 0;
 
-        if ((tdefl_init(pComp, mz_zip_writer_add_put_buf_callback, &state, tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY)) != TDEFL_STATUS_OKAY) ||
-            (tdefl_compress_buffer(pComp, pBuf, buf_size, TDEFL_FINISH) != TDEFL_STATUS_DONE))
+        size_t buf_ofs = 0;
+        tdefl_status status;
+
+        if (tdefl_init(pComp, mz_zip_writer_add_put_buf_callback, &state, mz_zip_writer_get_comp_flags(level, level_and_flags)) != TDEFL_STATUS_OKAY)
+        {
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
+            return mz_zip_set_error(pZip, MZ_ZIP_COMPRESSION_FAILED);
+        }
+
+        /* Without a progress callback the whole buffer goes in one call */
+        do
+        {
+            size_t n = buf_size - buf_ofs;
+            mz_uint64 zero_run = 0;
+            if (pZip->m_pProgress)
+                n = MZ_MIN(n, (size_t)MZ_ZIP_PROGRESS_CHUNK_SIZE);
+            if ((crc_while_compressing) && (pZip->m_pZero_run))
+                zero_run = pZip->m_pZero_run(pZip->m_pProgress_opaque, buf_ofs, buf_size);
+
+            if (zero_run)
+            {
+                /* Compress zeros from a static buffer instead of touching the input */
+                static mz_uint8 s_zeros[MZ_ZIP_MAX_IO_BUF_SIZE];
+                size_t zero_ofs = 0;
+                n = (size_t)MZ_MIN((mz_uint64)n, zero_run);
+                uncomp_crc32 = (mz_uint32)mz_crc32_zeros(uncomp_crc32, n);
+                do
+                {
+                    size_t z = MZ_MIN(n - zero_ofs, sizeof(s_zeros));
+                    zero_ofs += z;
+                    status = tdefl_compress_buffer(pComp, s_zeros, z, (buf_ofs + zero_ofs == buf_size) ? TDEFL_FINISH : TDEFL_NO_FLUSH);
+                } while ((zero_ofs < n) && (status == TDEFL_STATUS_OKAY));
+            }
+            else
+            {
+                if (crc_while_compressing)
+                    uncomp_crc32 = (mz_uint32)mz_crc32(uncomp_crc32, (const mz_uint8 *)pBuf + buf_ofs, n);
+
+                status = tdefl_compress_buffer(pComp, (const mz_uint8 *)pBuf + buf_ofs, n, (buf_ofs + n == buf_size) ? TDEFL_FINISH : TDEFL_NO_FLUSH);
+            }
+            buf_ofs += n;
+            if ((status != TDEFL_STATUS_OKAY) && (status != TDEFL_STATUS_DONE))
+            {
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
+                return mz_zip_set_error(pZip, MZ_ZIP_COMPRESSION_FAILED);
+            }
+
+            if ((pZip->m_pProgress) && (!pZip->m_pProgress(pZip->m_pProgress_opaque, buf_ofs, buf_size)))
+            {
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
+                return mz_zip_set_error(pZip, MZ_ZIP_ABORTED);
+            }
+        } while (status != TDEFL_STATUS_DONE && buf_ofs < buf_size);
+
+        if (status != TDEFL_STATUS_DONE)
         {
-            pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
             return mz_zip_set_error(pZip, MZ_ZIP_COMPRESSION_FAILED);
         }
 
@@ -6437,7 +7273,7 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
         cur_archive_file_ofs = state.m_cur_archive_file_ofs;
     }
 
-    pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
     pComp = NULL;
 
     if (uncomp_size)
@@ -6487,8 +7323,10 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
     return MZ_TRUE;
 }
 
-mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pArchive_name, mz_file_read_func read_callback, void* callback_opaque, mz_uint64 max_size, const MZ_TIME_T *pFile_time, const void *pComment, mz_uint16 comment_size, mz_uint level_and_flags,
-                                const char *user_extra_data, mz_uint user_extra_data_len, const char *user_extra_data_central, mz_uint user_extra_data_central_len)
+/* pUncomp_size and pUncomp_crc32 are only used with MZ_ZIP_FLAG_COMPRESSED_DATA, and are read after the callback has returned 0 */
+static mz_bool mz_zip_writer_add_read_buf_callback_impl(mz_zip_archive *pZip, const char *pArchive_name, mz_file_read_func read_callback, void* callback_opaque, mz_uint64 max_size, const MZ_TIME_T *pFile_time, const void *pComment, mz_uint16 comment_size, mz_uint level_and_flags,
+                                const char *user_extra_data, mz_uint user_extra_data_len, const char *user_extra_data_central, mz_uint user_extra_data_central_len,
+                                const mz_uint64 *pUncomp_size, const mz_uint32 *pUncomp_crc32)
 {
     mz_uint16 gen_flags;
     mz_uint uncomp_crc32 = MZ_CRC32_INIT, level, num_alignment_padding_bytes;
@@ -6501,6 +7339,7 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
     mz_uint8 extra_data[MZ_ZIP64_MAX_CENTRAL_EXTRA_FIELD_SIZE];
     mz_zip_internal_state *pState;
     mz_uint64 file_ofs = 0, cur_archive_header_file_ofs;
+    mz_bool compressed = (level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA) != 0;
 
     if ((int)level_and_flags < 0)
         level_and_flags = MZ_DEFAULT_LEVEL;
@@ -6524,8 +7363,8 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
         pState->m_zip64 = MZ_TRUE;
     }
 
-    /* We could support this, but why? */
-    if (level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA)
+    /* Already deflated data is copied through as it is, but the caller has to say what it decompresses to */
+    if ((compressed) && ((!pUncomp_size) || (!pUncomp_crc32)))
         return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
 
     if (!mz_zip_writer_validate_archive_name(pArchive_name))
@@ -6574,7 +7413,7 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
     }
 #endif
 
-    if (max_size <= 3)
+    if ((max_size <= 3) && (!compressed))
         level = 0;
 
     if (!mz_zip_writer_write_zeros(pZip, cur_archive_file_ofs, num_alignment_padding_bytes))
@@ -6590,7 +7429,7 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
         MZ_ASSERT((cur_archive_file_ofs & (pZip->m_file_offset_alignment - 1)) == 0);
     }
 
-    if (max_size && level)
+    if ((compressed) || (max_size && level))
     {
         method = MZ_DEFLATED;
     }
@@ -6661,13 +7500,13 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
 
     if (max_size)
     {
-        void *pRead_buf = pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, MZ_ZIP_MAX_IO_BUF_SIZE);
+        void *pRead_buf = mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_READ_BUF, MZ_ZIP_MAX_IO_BUF_SIZE);
         if (!pRead_buf)
         {
             return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
         }
 
-        if (!level)
+        if ((!level) || (compressed))
         {
             while (1)
             {
@@ -6677,29 +7516,39 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
 
                 if ((n > MZ_ZIP_MAX_IO_BUF_SIZE) || (file_ofs + n > max_size))
                 {
-                    pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+                    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
                     return mz_zip_set_error(pZip, MZ_ZIP_FILE_READ_FAILED);
                 }
                 if (pZip->m_pWrite(pZip->m_pIO_opaque, cur_archive_file_ofs, pRead_buf, n) != n)
                 {
-                    pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+                    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
                     return mz_zip_set_error(pZip, MZ_ZIP_FILE_WRITE_FAILED);
                 }
                 file_ofs += n;
-                uncomp_crc32 = (mz_uint32)mz_crc32(uncomp_crc32, (const mz_uint8 *)pRead_buf, n);
+                if (!compressed)
+                    uncomp_crc32 = (mz_uint32)mz_crc32(uncomp_crc32, (const mz_uint8 *)pRead_buf, n);
                 cur_archive_file_ofs += n;
             }
-            uncomp_size = file_ofs;
-            comp_size = uncomp_size;
+            comp_size = file_ofs;
+            uncomp_size = (compressed) ? *pUncomp_size : file_ofs;
+            if (compressed)
+            {
+                uncomp_crc32 = *pUncomp_crc32;
+                if (uncomp_size > max_size)
+                {
+                    mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
+                    return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
+                }
+            }
         }
         else
         {
             mz_bool result = MZ_FALSE;
             mz_zip_writer_add_state state;
-            tdefl_compressor *pComp = (tdefl_compressor *)pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, sizeof(tdefl_compressor));
+            tdefl_compressor *pComp = (tdefl_compressor *)mz_zip_scratch_acquire(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, tdefl_compressor_size(mz_zip_writer_get_comp_flags(level, level_and_flags)));
             if (!pComp)
             {
-                pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
                 return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
             }
 
@@ -6707,10 +7556,10 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
             state.m_cur_archive_file_ofs = cur_archive_file_ofs;
             state.m_comp_size = 0;
 
-            if (tdefl_init(pComp, mz_zip_writer_add_put_buf_callback, &state, tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY)) != TDEFL_STATUS_OKAY)
+            if (tdefl_init(pComp, mz_zip_writer_add_put_buf_callback, &state, mz_zip_writer_get_comp_flags(level, level_and_flags)) != TDEFL_STATUS_OKAY)
             {
-                pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
-                pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
                 return mz_zip_set_error(pZip, MZ_ZIP_INTERNAL_ERROR);
             }
 
@@ -6736,23 +7585,30 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
                     flush = TDEFL_FINISH;
 
                 status = tdefl_compress_buffer(pComp, pRead_buf, n, flush);
-                if (status == TDEFL_STATUS_DONE)
+                if ((status != TDEFL_STATUS_OKAY) && (status != TDEFL_STATUS_DONE))
                 {
-                    result = MZ_TRUE;
+                    mz_zip_set_error(pZip, MZ_ZIP_COMPRESSION_FAILED);
                     break;
                 }
-                else if (status != TDEFL_STATUS_OKAY)
+
+                if ((pZip->m_pProgress) && (n) && (!pZip->m_pProgress(pZip->m_pProgress_opaque, file_ofs, max_size)))
                 {
-                    mz_zip_set_error(pZip, MZ_ZIP_COMPRESSION_FAILED);
+                    mz_zip_set_error(pZip, MZ_ZIP_ABORTED);
+                    break;
+                }
+
+                if (status == TDEFL_STATUS_DONE)
+                {
+                    result = MZ_TRUE;
                     break;
                 }
             }
 
-            pZip->m_pFree(pZip->m_pAlloc_opaque, pComp);
+            mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_COMPRESSOR, pComp);
 
             if (!result)
             {
-                pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+                mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
                 return MZ_FALSE;
             }
 
@@ -6761,7 +7617,7 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
             cur_archive_file_ofs = state.m_cur_archive_file_ofs;
         }
 
-        pZip->m_pFree(pZip->m_pAlloc_opaque, pRead_buf);
+        mz_zip_scratch_release(pZip, MZ_ZIP_SCRATCH_READ_BUF, pRead_buf);
     }
 
     if (!(level_and_flags & MZ_ZIP_FLAG_WRITE_HEADER_SET_SIZE))
@@ -6847,6 +7703,24 @@ mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pA
     return MZ_TRUE;
 }
 
+mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, const char *pArchive_name, mz_file_read_func read_callback, void* callback_opaque, mz_uint64 max_size, const MZ_TIME_T *pFile_time, const void *pComment, mz_uint16 comment_size, mz_uint level_and_flags,
+                                const char *user_extra_data, mz_uint user_extra_data_len, const char *user_extra_data_central, mz_uint user_extra_data_central_len)
+{
+    /* We could support this, but why? */
+    if (level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA)
+        return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
+
+    return mz_zip_writer_add_read_buf_callback_impl(pZip, pArchive_name, read_callback, callback_opaque, max_size, pFile_time, pComment, comment_size, level_and_flags,
+                                                    user_extra_data, user_extra_data_len, user_extra_data_central, user_extra_data_central_len, NULL, NULL);
+}
+
+mz_bool mz_zip_writer_add_compressed_read_buf_callback(mz_zip_archive *pZip, const char *pArchive_name, mz_file_read_func read_callback, void* callback_opaque, mz_uint64 max_size,
+                                                       const MZ_TIME_T *pFile_time, mz_uint level_and_flags, const mz_uint64 *pUncomp_size, const mz_uint32 *pUncomp_crc32)
+{
+    return mz_zip_writer_add_read_buf_callback_impl(pZip, pArchive_name, read_callback, callback_opaque, max_size, pFile_time, NULL, 0, level_and_flags | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                                                    NULL, 0, NULL, 0, pUncomp_size, pUncomp_crc32);
+}
+
 #ifndef MINIZ_NO_STDIO
 
 static size_t mz_file_read_func_stdio(void *pOpaque, mz_uint64 file_ofs, void *pBuf, size_t n)
@@ -7341,6 +8215,64 @@ mz_bool mz_zip_writer_add_from_zip_reader(mz_zip_archive *pZip, mz_zip_archive *
     return MZ_TRUE;
 }
 
+mz_bool mz_zip_writer_reorder_central_dir(mz_zip_archive *pZip, const mz_uint *pOrder)
+{
+    mz_zip_internal_state *pState;
+    mz_zip_array new_central_dir, new_offsets;
+    mz_uint8 *pSeen;
+    mz_uint i;
+
+    if ((!pZip) || (!pZip->m_pState) || (pZip->m_zip_mode != MZ_ZIP_MODE_WRITING) || ((!pOrder) && (pZip->m_total_files)))
+        return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
+
+    pState = pZip->m_pState;
+    if (pZip->m_total_files < 2)
+        return MZ_TRUE;
+
+    /* Check pOrder is a permutation before touching anything */
+    if (NULL == (pSeen = (mz_uint8 *)pZip->m_pAlloc(pZip->m_pAlloc_opaque, 1, pZip->m_total_files)))
+        return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
+    memset(pSeen, 0, pZip->m_total_files);
+    for (i = 0; i < pZip->m_total_files; i++)
+    {
+        if ((pOrder[i] >= pZip->m_total_files) || (pSeen[pOrder[i]]))
+        {
+            pZip->m_pFree(pZip->m_pAlloc_opaque, pSeen);
+            return mz_zip_set_error(pZip, MZ_ZIP_INVALID_PARAMETER);
+        }
+        pSeen[pOrder[i]] = 1;
+    }
+    pZip->m_pFree(pZip->m_pAlloc_opaque, pSeen);
+
+    mz_zip_array_init(&new_central_dir, sizeof(mz_uint8));
+    mz_zip_array_init(&new_offsets, sizeof(mz_uint32));
+    if ((!mz_zip_array_reserve(pZip, &new_central_dir, pState->m_central_dir.m_size, MZ_FALSE)) ||
+        (!mz_zip_array_reserve(pZip, &new_offsets, pZip->m_total_files, MZ_FALSE)))
+    {
+        mz_zip_array_clear(pZip, &new_central_dir);
+        mz_zip_array_clear(pZip, &new_offsets);
+        return mz_zip_set_error(pZip, MZ_ZIP_ALLOC_FAILED);
+    }
+
+    for (i = 0; i < pZip->m_total_files; i++)
+    {
+        mz_uint index = pOrder[i];
+        mz_uint32 ofs = MZ_ZIP_ARRAY_ELEMENT(&pState->m_central_dir_offsets, mz_uint32, index);
+        size_t end = (index + 1 < pZip->m_total_files) ? MZ_ZIP_ARRAY_ELEMENT(&pState->m_central_dir_offsets, mz_uint32, index + 1) : pState->m_central_dir.m_size;
+        mz_uint32 new_ofs = (mz_uint32)new_central_dir.m_size;
+
+        /* Both arrays were reserved up front, so these can't fail */
+        mz_zip_array_push_back(pZip, &new_central_dir, (const mz_uint8 *)pState->m_central_dir.m_p + ofs, end - ofs);
+        mz_zip_array_push_back(pZip, &new_offsets, &new_ofs, 1);
+    }
+
+    mz_zip_array_clear(pZip, &pState->m_central_dir);
+    mz_zip_array_clear(pZip, &pState->m_central_dir_offsets);
+    pState->m_central_dir = new_central_dir;
+    pState->m_central_dir_offsets = new_offsets;
+    return MZ_TRUE;
+}
+
 mz_bool mz_zip_writer_finalize_archive(mz_zip_archive *pZip)
 {
     mz_zip_internal_state *pState;
@@ -7725,6 +8657,8 @@ const char *mz_zip_get_error_string(mz_zip_error mz_err)
             return "validation failed";
         case MZ_ZIP_WRITE_CALLBACK_FAILED:
             return "write callback failed";
+        case MZ_ZIP_ABORTED:
+            return "aborted by progress callback";
 	case MZ_ZIP_TOTAL_ERRORS:
             return "total errors";
         default:
@@ -244,6 +244,8 @@ MINIZ_EXPORT mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_
 #define MZ_CRC32_INIT (0)
 /* mz_crc32() returns the initial CRC-32 value to use when called with ptr==NULL. */
 MINIZ_EXPORT mz_ulong mz_crc32(mz_ulong crc, const unsigned char *ptr, size_t buf_len);
+/* mz_crc32_zeros() returns the CRC-32 of the data already covered by crc followed by len zero bytes, without reading them. */
+MINIZ_EXPORT mz_ulong mz_crc32_zeros(mz_ulong crc, size_t len);
 
 /* Compression strategies. */
 enum
@@ -626,6 +628,37 @@ extern MINIZ_EXPORT void *miniz_def_realloc_func(void *opaque, void *address, si
 #define MZ_UINT16_MAX (0xFFFFU)
 #define MZ_UINT32_MAX (0xFFFFFFFFU)
 
+/* ------------------- Runtime CPU feature dispatch */
+
+/* The CRC-32, Adler-32, deflate match length and inflate match copy kernels are selected at runtime from the */
+/* variants supported by the host CPU. The CPU is probed once, on the first call into a dispatched kernel. */
+/* The MINIZ_CPU_LEVEL environment variable (generic, sse2, sse41, avx2, armv8crc) or mz_cpu_set_level() force a */
+/* specific level, e.g. so every variant can be tested on one machine. Levels the host can't run are clamped to */
+/* the best supported level. Define MINIZ_NO_CPU_DISPATCH to only compile the portable C kernels. */
+typedef enum {
+    MZ_CPU_LEVEL_GENERIC = 0,
+    MZ_CPU_LEVEL_SSE2 = 1,      /* SSE2 match length and match copy. */
+    MZ_CPU_LEVEL_SSE41 = 2,     /* Adds SSSE3 Adler-32 and PCLMULQDQ CRC-32 folding (needs SSSE3, SSE4.1, PCLMULQDQ). */
+    MZ_CPU_LEVEL_AVX2 = 3,      /* Adds AVX2 match length. */
+    MZ_CPU_LEVEL_ARMV8_CRC = 4  /* ARMv8 CRC32 instructions (AArch64 Linux only). */
+} mz_cpu_level;
+
+/* Returns the level of the kernels currently in use. */
+MINIZ_EXPORT mz_cpu_level mz_cpu_get_level(void);
+
+/* Returns the best level supported by the host CPU (and this build). */
+MINIZ_EXPORT mz_cpu_level mz_cpu_get_max_level(void);
+
+/* Returns MZ_TRUE if the host CPU can run the kernels for the given level. */
+MINIZ_EXPORT mz_bool mz_cpu_is_level_supported(mz_cpu_level level);
+
+/* Switches the kernels to the given level. Returns MZ_FALSE (and keeps the current kernels) if the level isn't supported. */
+/* Not thread safe: call it before any other thread is compressing or decompressing. */
+MINIZ_EXPORT mz_bool mz_cpu_set_level(mz_cpu_level level);
+
+/* Returns the name of a level as accepted by the MINIZ_CPU_LEVEL environment variable. */
+MINIZ_EXPORT const char *mz_cpu_get_level_name(mz_cpu_level level);
+
 #ifdef __cplusplus
 }
 #endif
@@ -659,6 +692,7 @@ enum
 /* TDEFL_FILTER_MATCHES: Discards matches <= 5 chars if enabled. */
 /* TDEFL_FORCE_ALL_STATIC_BLOCKS: Disable usage of optimized Huffman tables. */
 /* TDEFL_FORCE_ALL_RAW_BLOCKS: Only use raw (uncompressed) deflate blocks. */
+/* TDEFL_LOW_MEMORY_FLAG: Use the smaller TDEFL_LESS_MEMORY hash table and LZ code/output buffers for this compressor only (slightly worse ratio, smaller blocks). The compressor only needs tdefl_compressor_size(flags) bytes. */
 /* The low 12 bits are reserved to control the max # of hash probes per dictionary lookup (see TDEFL_MAX_PROBES_MASK). */
 enum
 {
@@ -669,7 +703,8 @@ enum
     TDEFL_RLE_MATCHES = 0x10000,
     TDEFL_FILTER_MATCHES = 0x20000,
     TDEFL_FORCE_ALL_STATIC_BLOCKS = 0x40000,
-    TDEFL_FORCE_ALL_RAW_BLOCKS = 0x80000
+    TDEFL_FORCE_ALL_RAW_BLOCKS = 0x80000,
+    TDEFL_LOW_MEMORY_FLAG = 0x100000
 };
 
 /* High level compression functions: */
@@ -743,6 +778,16 @@ enum
 };
 #endif
 
+/* Buffer sizes used at runtime by compressors initialised with TDEFL_LOW_MEMORY_FLAG (the same as TDEFL_LESS_MEMORY). */
+enum
+{
+    TDEFL_LOW_MEMORY_LZ_CODE_BUF_SIZE = 24 * 1024,
+    TDEFL_LOW_MEMORY_OUT_BUF_SIZE = (TDEFL_LOW_MEMORY_LZ_CODE_BUF_SIZE * 13) / 10,
+    TDEFL_LOW_MEMORY_LZ_HASH_BITS = 12,
+    TDEFL_LOW_MEMORY_LZ_HASH_SHIFT = (TDEFL_LOW_MEMORY_LZ_HASH_BITS + 2) / 3,
+    TDEFL_LOW_MEMORY_LZ_HASH_SIZE = 1 << TDEFL_LOW_MEMORY_LZ_HASH_BITS
+};
+
 /* The low-level tdefl functions below may be used directly if the above helper functions aren't flexible enough. The low-level functions don't make any heap allocations, unlike the above helper functions. */
 typedef enum {
     TDEFL_STATUS_BAD_PARAM = -2,
@@ -781,12 +826,18 @@ typedef struct
     mz_uint16 m_huff_count[TDEFL_MAX_HUFF_TABLES][TDEFL_MAX_HUFF_SYMBOLS];
     mz_uint16 m_huff_codes[TDEFL_MAX_HUFF_TABLES][TDEFL_MAX_HUFF_SYMBOLS];
     mz_uint8 m_huff_code_sizes[TDEFL_MAX_HUFF_TABLES][TDEFL_MAX_HUFF_SYMBOLS];
-    mz_uint8 m_lz_code_buf[TDEFL_LZ_CODE_BUF_SIZE];
     mz_uint16 m_next[TDEFL_LZ_DICT_SIZE];
-    mz_uint16 m_hash[TDEFL_LZ_HASH_SIZE];
-    mz_uint8 m_output_buf[TDEFL_OUT_BUF_SIZE];
+    /* The hash table and LZ code/output buffers are sized at runtime by tdefl_init() and point into m_storage. */
+    /* A compressor initialised with TDEFL_LOW_MEMORY_FLAG only uses the start of m_storage, so it can be allocated with tdefl_compressor_size(). */
+    mz_uint16 *m_hash;
+    mz_uint8 *m_lz_code_buf, *m_output_buf;
+    mz_uint m_hash_size, m_hash_shift, m_lz_code_buf_size, m_out_buf_size;
+    mz_uint8 m_storage[TDEFL_LZ_HASH_SIZE * sizeof(mz_uint16) + TDEFL_LZ_CODE_BUF_SIZE + TDEFL_OUT_BUF_SIZE];
 } tdefl_compressor;
 
+/* Returns the number of bytes a compressor initialised with the given tdefl_init() flags needs (sizeof(tdefl_compressor) unless TDEFL_LOW_MEMORY_FLAG is set). */
+MINIZ_EXPORT size_t tdefl_compressor_size(int flags);
+
 /* Initializes the compressor. */
 /* There is no corresponding deinit() function because the tdefl API's do not dynamically allocate memory. */
 /* pBut_buf_func: If NULL, output data will be supplied to the specified callback. In this case, the user should call the tdefl_compress_buffer() API for compression. */
@@ -1074,7 +1125,8 @@ typedef enum {
     MZ_ZIP_FLAG_ASCII_FILENAME = 0x10000,
     /*After adding a compressed file, seek back
     to local file header and set the correct sizes*/
-    MZ_ZIP_FLAG_WRITE_HEADER_SET_SIZE = 0x20000
+    MZ_ZIP_FLAG_WRITE_HEADER_SET_SIZE = 0x20000,
+    MZ_ZIP_FLAG_LOW_MEMORY = 0x40000 /* compress with TDEFL_LOW_MEMORY_FLAG, use as level_and_flags with mz_zip_writer_add_* */
 } mz_zip_flags;
 
 typedef enum {
@@ -1121,9 +1173,58 @@ typedef enum {
     MZ_ZIP_ARCHIVE_TOO_LARGE,
     MZ_ZIP_VALIDATION_FAILED,
     MZ_ZIP_WRITE_CALLBACK_FAILED,
+    MZ_ZIP_ABORTED,
     MZ_ZIP_TOTAL_ERRORS
 } mz_zip_error;
 
+/* Scratch buffers the zip reader and writer need for each entry. */
+typedef enum
+{
+    MZ_ZIP_SCRATCH_COMPRESSOR = 0,   /* tdefl_compressor_size() bytes */
+    MZ_ZIP_SCRATCH_DECOMPRESSOR = 1, /* tinfl_decompressor */
+    MZ_ZIP_SCRATCH_READ_BUF = 2,     /* MZ_ZIP_MAX_IO_BUF_SIZE bytes */
+    MZ_ZIP_SCRATCH_DICT = 3,         /* TINFL_LZ_DICT_SIZE bytes */
+    MZ_ZIP_SCRATCH_TOTAL
+} mz_zip_scratch_slot;
+
+/* Caller-owned entry state. By default every mz_zip_writer_add_*() and mz_zip_reader_extract_*() call allocates a
+   fresh compressor or decompressor plus I/O buffers and frees them again when the entry is done. Pointing
+   mz_zip_archive::m_pEntry_state at one of these instead keeps the scratch buffers alive between entries (and between
+   archives), and they are just reset with tdefl_init()/tinfl_init(). A state can be shared by any number of archives,
+   but only from one thread at a time. A slot that is already in use (e.g. by a nested call) falls back to the
+   archive's allocator. The buffers are allocated with MZ_MALLOC unless m_pAlloc/m_pFree are set after
+   mz_zip_entry_state_init(), e.g. to back them with huge pages. m_pAlloc may round *pSize up, and m_pFree is passed the
+   rounded size. */
+typedef void *(*mz_zip_scratch_alloc_func)(void *opaque, size_t *pSize);
+typedef void (*mz_zip_scratch_free_func)(void *opaque, void *address, size_t size);
+
+typedef struct
+{
+    void *m_pSlots[MZ_ZIP_SCRATCH_TOTAL];
+    size_t m_slot_sizes[MZ_ZIP_SCRATCH_TOTAL];
+    mz_uint m_busy_mask;
+    mz_uint64 m_alloc_count;
+    mz_uint64 m_reuse_count;
+    mz_zip_scratch_alloc_func m_pAlloc;
+    mz_zip_scratch_free_func m_pFree;
+    void *m_pAlloc_opaque;
+} mz_zip_entry_state;
+
+MINIZ_EXPORT void mz_zip_entry_state_init(mz_zip_entry_state *pState);
+MINIZ_EXPORT void mz_zip_entry_state_end(mz_zip_entry_state *pState);
+
+/* Called while an entry is compressed, after each chunk of input has been consumed. bytes_done is the number of bytes
+   of the entry's input consumed so far (miniz won't read them again), bytes_total the size of the input (for the
+   mz_zip_writer_add_*_callback functions this is the maximum size passed in). Return MZ_FALSE to abort the add, which
+   then fails with MZ_ZIP_ABORTED. */
+#define MZ_ZIP_PROGRESS_CHUNK_SIZE (1024 * 1024)
+typedef mz_bool (*mz_zip_progress_func)(void *pOpaque, mz_uint64 bytes_done, mz_uint64 bytes_total);
+
+/* Called before each chunk of input is compressed, with the offset of the chunk in the entry's input. Returns the
+   number of bytes from there that are known to be zero (e.g. a hole in a sparse file), or 0. Those bytes are never
+   read: zeros are compressed in their place and the CRC is extended with mz_crc32_zeros(). */
+typedef mz_uint64 (*mz_zip_zero_run_func)(void *pOpaque, mz_uint64 ofs, mz_uint64 bytes_total);
+
 typedef struct
 {
     mz_uint64 m_archive_size;
@@ -1149,6 +1250,18 @@ typedef struct
 
     mz_zip_internal_state *m_pState;
 
+    /* Optional, see mz_zip_entry_state. NULL allocates the scratch buffers per entry. */
+    mz_zip_entry_state *m_pEntry_state;
+
+    /* Optional, see mz_zip_progress_func. With a progress callback, mz_zip_writer_add_mem*() compresses in
+       MZ_ZIP_PROGRESS_CHUNK_SIZE chunks and works out the CRC as it goes, rather than in one pass up front. */
+    mz_zip_progress_func m_pProgress;
+    void *m_pProgress_opaque;
+
+    /* Optional, see mz_zip_zero_run_func. Only used by mz_zip_writer_add_mem*() along with m_pProgress, and is passed
+       m_pProgress_opaque. */
+    mz_zip_zero_run_func m_pZero_run;
+
 } mz_zip_archive;
 
 typedef struct
@@ -1329,6 +1442,10 @@ MINIZ_EXPORT mz_bool mz_zip_end(mz_zip_archive *pZip);
 MINIZ_EXPORT mz_bool mz_zip_writer_init(mz_zip_archive *pZip, mz_uint64 existing_size);
 MINIZ_EXPORT mz_bool mz_zip_writer_init_v2(mz_zip_archive *pZip, mz_uint64 existing_size, mz_uint flags);
 
+/* Pre-sizes the central directory for num_files more entries whose archive names add up to total_name_size bytes, so it
+   isn't grown (and copied) again and again while a known list of files is added. Call after mz_zip_writer_init*(). */
+MINIZ_EXPORT mz_bool mz_zip_writer_reserve(mz_zip_archive *pZip, mz_uint num_files, mz_uint64 total_name_size);
+
 MINIZ_EXPORT mz_bool mz_zip_writer_init_heap(mz_zip_archive *pZip, size_t size_to_reserve_at_beginning, size_t initial_allocation_size);
 MINIZ_EXPORT mz_bool mz_zip_writer_init_heap_v2(mz_zip_archive *pZip, size_t size_to_reserve_at_beginning, size_t initial_allocation_size, mz_uint flags);
 
@@ -1367,6 +1484,12 @@ MINIZ_EXPORT mz_bool mz_zip_writer_add_read_buf_callback(mz_zip_archive *pZip, c
 	const MZ_TIME_T *pFile_time, const void *pComment, mz_uint16 comment_size, mz_uint level_and_flags, const char *user_extra_data_local, mz_uint user_extra_data_local_len,
 	const char *user_extra_data_central, mz_uint user_extra_data_central_len);
 
+/* Like mz_zip_writer_add_read_buf_callback(), except the callback supplies raw deflate data that is copied into the archive as it is. */
+/* *pUncomp_size and *pUncomp_crc32 are read once the callback has returned 0, so they can be filled in while the data is produced. */
+/* max_size must be at least both the compressed and the uncompressed size, it decides whether zip64 headers are needed. */
+MINIZ_EXPORT mz_bool mz_zip_writer_add_compressed_read_buf_callback(mz_zip_archive *pZip, const char *pArchive_name, mz_file_read_func read_callback, void* callback_opaque, mz_uint64 max_size,
+                                                                    const MZ_TIME_T *pFile_time, mz_uint level_and_flags, const mz_uint64 *pUncomp_size, const mz_uint32 *pUncomp_crc32);
+
 
 #ifndef MINIZ_NO_STDIO
 /* Adds the contents of a disk file to an archive. This function also records the disk file's modified time into the archive. */
@@ -1383,6 +1506,11 @@ MINIZ_EXPORT mz_bool mz_zip_writer_add_cfile(mz_zip_archive *pZip, const char *p
 /* This function fully clones the source file's compressed data (no recompression), along with its full filename, extra data (it may add or modify the zip64 local header extra data field), and the optional descriptor following the compressed data. */
 MINIZ_EXPORT mz_bool mz_zip_writer_add_from_zip_reader(mz_zip_archive *pZip, mz_zip_archive *pSource_zip, mz_uint src_file_index);
 
+/* Reorders the central directory records written so far, without moving any file data. */
+/* pOrder must hold m_total_files distinct indices: the record for entry pOrder[i] is written i'th. Indices refer to the order the entries were added. */
+/* Lets entries be added in whatever order is fastest to read them while keeping the listing order deterministic. */
+MINIZ_EXPORT mz_bool mz_zip_writer_reorder_central_dir(mz_zip_archive *pZip, const mz_uint *pOrder);
+
 /* Finalizes the archive by writing the central directory records followed by the end of central directory record. */
 /* After an archive is finalized, the only valid call on the mz_zip_archive struct is mz_zip_writer_end(). */
 /* An archive must be manually finalized by calling this function for it to be valid. */
@@ -0,0 +1,675 @@
+#include "BatchFileReader.h"
+#include "PageCache.h"
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <condition_variable>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_FEAT_RW_CUR_POS arrived in 5.6 along with the openat, statx, read and close operations
+#if defined(IORING_FEAT_RW_CUR_POS)
+#define SIMPLEZIPPER_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#if defined(SIMPLEZIPPER_HAVE_IO_URING)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int MaxQueueDepth = 1024;
+
+// Reading is I/O bound, but there's no point having more threads than the device can keep busy
+const int MaxReaderThreads = 16;
+
+// How long a reader waits for room in the memory budget before mapping the file instead
+const int MemoryWaitMs = 100;
+
+// Charge for what was actually read, which is more than was reserved for a file that doesn't know its size (e.g.,
+// in /proc), or any size for one that was read because it couldn't be mapped
+MemoryGovernor::LeasePtr chargeRead(MemoryGovernor* governor, const MemoryGovernor::LeasePtr& reserved, qint64 size)
+{
+    if (!governor || (reserved && reserved->size() == size)) {
+        return reserved;
+    }
+    return governor->charge(size);
+}
+
+}
+
+BatchFileReader::BatchFileReader(int queueDepth, Backend backend) :
+    mQueueDepth(std::max(1, std::min(queueDepth, MaxQueueDepth))),
+    mBackend(backend),
+    mMapThreshold(0),
+    mDropCache(false),
+    mGovernor(nullptr)
+{
+    if (mBackend != ThreadPool) {
+        mBackend = ioUringSupported() ? IoUring : ThreadPool;
+    }
+}
+
+void BatchFileReader::setMapThreshold(qint64 threshold)
+{
+    mMapThreshold = threshold;
+}
+
+void BatchFileReader::setDropCache(bool dropCache)
+{
+    mDropCache = dropCache;
+}
+
+void BatchFileReader::setMemoryGovernor(MemoryGovernor* governor)
+{
+    mGovernor = governor;
+}
+
+BatchFileReader::Backend BatchFileReader::backend() const
+{
+    return mBackend;
+}
+
+bool BatchFileReader::read(const QVector<ZipEntry>& entries, const Sink& sink)
+{
+    int next = 0;
+    return read([&](ZipEntry& entry) {
+        if (next >= entries.size()) {
+            return false;
+        }
+        entry = entries[next++];
+        return true;
+    }, sink);
+}
+
+bool BatchFileReader::read(const ZipEntrySource& source, const Sink& sink)
+{
+    if (mBackend == IoUring) {
+        return readWithIoUring(source, sink);
+    }
+    return readWithThreads(source, sink);
+}
+
+FileContents BatchFileReader::readFile(const QString& filename, qint64 mapThreshold, bool dropCache, MemoryGovernor* governor)
+{
+    FileContents contents;
+    QFile inFile(filename);
+    if (!inFile.open(QIODevice::ReadOnly)) {
+        return contents;
+    }
+
+    // Without room in the memory budget, map the file whatever its size
+    MemoryGovernor::LeasePtr lease;
+    bool map = mapThreshold > 0 && inFile.size() >= mapThreshold;
+    if (!map && governor) {
+        lease = governor->reserve(inFile.size(), MemoryWaitMs);
+        map = !lease;
+    }
+    if (map) {
+        std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+        if (mapping->open(filename, dropCache)) {
+            contents.ok = true;
+            contents.mapping = mapping;
+            return contents;
+        }
+    }
+
+    contents.data = inFile.readAll();
+    contents.ok = true;
+    contents.lease = chargeRead(governor, lease, contents.data.size());
+    if (dropCache) {
+        PageCache::drop(inFile.handle());
+    }
+    return contents;
+}
+
+bool BatchFileReader::readWithThreads(const ZipEntrySource& source, const Sink& sink)
+{
+    struct Slot {
+        bool ready = false;
+        ZipEntry entry;
+        FileContents contents;
+    };
+
+    // File i goes in slot i % depth, and can only be claimed once file i - depth has been handed to the sink. The
+    // source is called with the mutex held, so files are claimed in order.
+    const int depth = mQueueDepth;
+    std::vector<Slot> fileSlots(depth);
+    std::mutex mutex;
+    std::condition_variable readyCondition;
+    std::condition_variable spaceCondition;
+    int nextClaim = 0;
+    int emitted = 0;
+    bool exhausted = false;
+    bool stop = false;
+
+    auto worker = [&]() {
+        for (;;) {
+            int index;
+            ZipEntry entry;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                spaceCondition.wait(lock, [&] { return stop || exhausted || nextClaim < emitted + depth; });
+                if (stop || exhausted) {
+                    return;
+                }
+                if (!source(entry)) {
+                    exhausted = true;
+                    readyCondition.notify_all();
+                    spaceCondition.notify_all();
+                    return;
+                }
+                index = nextClaim++;
+            }
+
+            FileContents contents = readFile(entry.sourcePath, mMapThreshold, mDropCache, mGovernor);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            Slot& slot = fileSlots[index % depth];
+            slot.entry = std::move(entry);
+            slot.contents = std::move(contents);
+            slot.ready = true;
+            readyCondition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const int threadCount = std::min(depth, MaxReaderThreads);
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(worker);
+    }
+
+    bool ok = true;
+    for (int index = 0;; index++) {
+        ZipEntry entry;
+        FileContents contents;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            Slot& slot = fileSlots[index % depth];
+            readyCondition.wait(lock, [&] { return slot.ready || (exhausted && index >= nextClaim); });
+            if (!slot.ready) {
+                break;
+            }
+            entry = std::move(slot.entry);
+            contents = std::move(slot.contents);
+            slot.ready = false;
+            emitted = index + 1;
+            spaceCondition.notify_all();
+        }
+
+        if (!sink(index, entry, contents)) {
+            ok = false;
+            break;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        spaceCondition.notify_all();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return ok;
+}
+
+#if defined(SIMPLEZIPPER_HAVE_IO_URING)
+
+namespace {
+
+/*
+ * A minimal io_uring wrapper using the raw system calls, so there's no dependency on liburing.
+ */
+class Ring {
+public:
+    Ring() = default;
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    ~Ring()
+    {
+        if (mSqes) {
+            munmap(mSqes, mSqesSize);
+        }
+        if (mCqRing && mCqRing != mSqRing) {
+            munmap(mCqRing, mCqRingSize);
+        }
+        if (mSqRing) {
+            munmap(mSqRing, mSqRingSize);
+        }
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        mFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (mFd < 0) {
+            return false;
+        }
+
+        mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+        }
+
+        mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+        if (mSqRing == MAP_FAILED) {
+            mSqRing = nullptr;
+            return false;
+        }
+        if (singleMmap) {
+            mCqRing = mSqRing;
+        } else {
+            mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+            if (mCqRing == MAP_FAILED) {
+                mCqRing = nullptr;
+                return false;
+            }
+        }
+        mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        mSqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(mSqRing);
+        mSqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        mSqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        mSqEntries = params.sq_entries;
+        mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(mCqRing);
+        mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        mCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        mCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        mLocalTail = *mSqTail;
+        return true;
+    }
+
+    bool supports(const std::initializer_list<int>& ops)
+    {
+        const unsigned probeOps = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, mFd, IORING_REGISTER_PROBE, probe, probeOps) < 0) {
+            return false;
+        }
+        for (int op : ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Get the next free submission entry, or nullptr if the submission queue is full
+    io_uring_sqe* getSqe()
+    {
+        unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        if (mLocalTail - head >= mSqEntries) {
+            return nullptr;
+        }
+        io_uring_sqe* sqe = &mSqes[mLocalTail & mSqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        mSqArray[mLocalTail & mSqMask] = mLocalTail & mSqMask;
+        mLocalTail++;
+        mPending++;
+        return sqe;
+    }
+
+    // Submit the queued entries and wait for at least waitCount completions
+    bool submit(unsigned waitCount)
+    {
+        __atomic_store_n(mSqTail, mLocalTail, __ATOMIC_RELEASE);
+        for (;;) {
+            long ret = syscall(__NR_io_uring_enter, mFd, mPending, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret >= 0) {
+                mPending -= static_cast<unsigned>(ret);
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    bool peek(io_uring_cqe& cqe)
+    {
+        unsigned head = *mCqHead;
+        if (head == __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        cqe = mCqes[head & mCqMask];
+        __atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int mFd = -1;
+    void* mSqRing = nullptr;
+    void* mCqRing = nullptr;
+    size_t mSqRingSize = 0;
+    size_t mCqRingSize = 0;
+    io_uring_sqe* mSqes = nullptr;
+    size_t mSqesSize = 0;
+    unsigned* mSqHead = nullptr;
+    unsigned* mSqTail = nullptr;
+    unsigned* mSqArray = nullptr;
+    unsigned mSqMask = 0;
+    unsigned mSqEntries = 0;
+    unsigned* mCqHead = nullptr;
+    unsigned* mCqTail = nullptr;
+    unsigned mCqMask = 0;
+    io_uring_cqe* mCqes = nullptr;
+    unsigned mLocalTail = 0;
+    unsigned mPending = 0;
+};
+
+enum Operation {
+    OpOpen,
+    OpStat,
+    OpRead,
+    OpClose
+};
+
+const int OperationBits = 2;
+
+// Used when statx doesn't give a size (e.g., files in /proc report 0)
+const qint64 UnknownSizeBuffer = 64 * 1024;
+
+struct FileSlot {
+    ZipEntry entry;
+    QByteArray path;
+    int fd = -1;
+    struct statx stat;
+    QByteArray data;
+    MemoryGovernor::LeasePtr lease;
+    qint64 expected = 0;
+    qint64 filled = 0;
+    int inFlight = 0;
+    bool opened = false;
+    bool statted = false;
+    bool map = false;
+    bool failed = false;
+    bool done = false;
+};
+
+}
+
+bool BatchFileReader::ioUringSupported()
+{
+    static const bool supported = [] {
+        Ring ring;
+        return ring.init(4) && ring.supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE});
+    }();
+    return supported;
+}
+
+bool BatchFileReader::readWithIoUring(const ZipEntrySource& source, const Sink& sink)
+{
+    // Each file has at most two operations in flight (openat and statx), so the rings can never overflow
+    const int depth = mQueueDepth;
+    Ring ring;
+    if (!ring.init(static_cast<unsigned>(depth * 2))) {
+        qWarning() << "Failed to set up io_uring, reading files with threads instead";
+        return readWithThreads(source, sink);
+    }
+
+    std::vector<FileSlot> fileSlots(depth);
+    int nextStart = 0;
+    bool exhausted = false;
+    int inFlight = 0;
+    bool ringFailed = false;
+
+    auto queue = [&](FileSlot& slot, int slotIndex, Operation op) -> io_uring_sqe* {
+        io_uring_sqe* sqe = ring.getSqe();
+        if (!sqe && ring.submit(0)) {
+            sqe = ring.getSqe();
+        }
+        if (!sqe) {
+            ringFailed = true;
+            return nullptr;
+        }
+        sqe->user_data = (static_cast<__u64>(slotIndex) << OperationBits) | op;
+        slot.inFlight++;
+        inFlight++;
+        return sqe;
+    };
+
+    auto queueRead = [&](FileSlot& slot, int slotIndex) {
+        if (slot.filled == slot.data.size()) {
+            slot.data.resize(static_cast<int>(std::min<qint64>(std::max<qint64>(slot.data.size() * 2, UnknownSizeBuffer), 0x7fffffff)));
+        }
+        io_uring_sqe* sqe = queue(slot, slotIndex, OpRead);
+        if (sqe) {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = slot.fd;
+            sqe->addr = reinterpret_cast<__u64>(slot.data.data() + slot.filled);
+            sqe->len = static_cast<__u32>(std::min<qint64>(slot.data.size() - slot.filled, 0x7ffff000));
+            sqe->off = static_cast<__u64>(slot.filled);
+        }
+    };
+
+    auto queueClose = [&](FileSlot& slot, int slotIndex) {
+        io_uring_sqe* sqe = queue(slot, slotIndex, OpClose);
+        if (sqe) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.fd;
+        } else {
+            // The ring has failed, so nothing would close it later
+            close(slot.fd);
+        }
+        slot.fd = -1;
+    };
+
+    // Start reading the next file from the source, if there is one
+    auto startNext = [&]() {
+        ZipEntry entry;
+        if (exhausted || !source(entry)) {
+            exhausted = true;
+            return;
+        }
+        int slotIndex = nextStart++ % depth;
+        FileSlot& slot = fileSlots[slotIndex];
+        slot = FileSlot();
+        slot.entry = std::move(entry);
+        slot.path = QFile::encodeName(slot.entry.sourcePath);
+
+        io_uring_sqe* sqe = queue(slot, slotIndex, OpOpen);
+        if (sqe) {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<__u64>(slot.path.constData());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        sqe = queue(slot, slotIndex, OpStat);
+        if (sqe) {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<__u64>(slot.path.constData());
+            sqe->len = STATX_SIZE;
+            sqe->off = reinterpret_cast<__u64>(&slot.stat);
+            sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+        }
+    };
+
+    // Reserve room for a file in the memory budget, without waiting since the other files need handling meanwhile
+    auto reserve = [&](FileSlot& slot) {
+        if (!mGovernor) {
+            return true;
+        }
+        slot.lease = mGovernor->reserve(slot.expected);
+        return static_cast<bool>(slot.lease);
+    };
+
+    auto complete = [&](const io_uring_cqe& cqe) {
+        int slotIndex = static_cast<int>(cqe.user_data >> OperationBits);
+        Operation op = static_cast<Operation>(cqe.user_data & ((1 << OperationBits) - 1));
+        FileSlot& slot = fileSlots[slotIndex];
+        slot.inFlight--;
+        inFlight--;
+
+        switch (op) {
+        case OpOpen:
+            slot.opened = true;
+            if (cqe.res < 0) {
+                slot.failed = true;
+            } else {
+                slot.fd = cqe.res;
+            }
+            break;
+        case OpStat:
+            slot.statted = true;
+            slot.expected = cqe.res < 0 ? 0 : static_cast<qint64>(slot.stat.stx_size);
+            break;
+        case OpRead:
+            if (cqe.res < 0) {
+                slot.failed = true;
+                queueClose(slot, slotIndex);
+            } else if (cqe.res == 0 || (slot.expected > 0 && slot.filled + cqe.res < slot.data.size() && slot.filled + cqe.res >= slot.expected)) {
+                // End of file, or a short read once we have everything statx promised. Files without a size (procfs,
+                // sysfs, pipes) can return short reads anywhere, so they're read until a read returns nothing.
+                slot.filled += cqe.res;
+                slot.data.resize(static_cast<int>(slot.filled));
+                if (mDropCache) {
+                    PageCache::drop(slot.fd);
+                }
+                queueClose(slot, slotIndex);
+            } else {
+                slot.filled += cqe.res;
+                queueRead(slot, slotIndex);
+            }
+            return;
+        case OpClose:
+            break;
+        }
+
+        if (slot.opened && slot.statted && !slot.inFlight) {
+            if (slot.fd < 0) {
+                // Either the open failed or the file has been closed
+                slot.done = true;
+            } else if (slot.failed) {
+                queueClose(slot, slotIndex);
+            } else if ((mMapThreshold > 0 && slot.expected >= mMapThreshold) || !reserve(slot)) {
+                // Big files, and files there's no room for in the memory budget, are mapped by the sink's thread instead
+                slot.map = true;
+                queueClose(slot, slotIndex);
+            } else {
+                // Ask for one byte more than the file size, so a short read tells us we've reached the end
+                if (slot.expected >= 0x7fffffff) {
+                    slot.failed = true;
+                    queueClose(slot, slotIndex);
+                } else {
+                    slot.data.resize(static_cast<int>(slot.expected ? slot.expected + 1 : UnknownSizeBuffer));
+                    queueRead(slot, slotIndex);
+                }
+            }
+        }
+    };
+
+    bool ok = true;
+    int emitIndex = 0;
+    while (!ringFailed) {
+        // Keep the queue topped up, and stop once everything has been handed over
+        while (!exhausted && nextStart - emitIndex < depth) {
+            startNext();
+        }
+        if (emitIndex == nextStart) {
+            break;
+        }
+
+        if (!ring.submit(1)) {
+            ringFailed = true;
+            break;
+        }
+        io_uring_cqe cqe;
+        while (ring.peek(cqe)) {
+            complete(cqe);
+        }
+
+        // Hand over the finished files in order
+        while (emitIndex < nextStart && fileSlots[emitIndex % depth].done) {
+            FileSlot& slot = fileSlots[emitIndex % depth];
+            FileContents contents;
+            if (slot.map) {
+                contents = readFile(slot.entry.sourcePath, 1, mDropCache, mGovernor);
+            } else {
+                contents.ok = !slot.failed;
+                contents.data.swap(slot.data);
+                contents.lease = chargeRead(mGovernor, slot.lease, contents.data.size());
+                slot.lease.reset();
+            }
+            if (!sink(emitIndex, slot.entry, contents)) {
+                ok = false;
+                break;
+            }
+            emitIndex++;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    // Wait for anything still in flight, since the kernel may write into the fileSlots, then close any open files
+    while (inFlight > 0 && !ringFailed && ring.submit(1)) {
+        io_uring_cqe cqe;
+        while (ring.peek(cqe)) {
+            FileSlot& slot = fileSlots[static_cast<int>(cqe.user_data >> OperationBits)];
+            Operation op = static_cast<Operation>(cqe.user_data & ((1 << OperationBits) - 1));
+            if (op == OpOpen && cqe.res >= 0) {
+                slot.fd = cqe.res;
+            }
+            slot.inFlight--;
+            inFlight--;
+        }
+    }
+    for (auto& slot : fileSlots) {
+        if (slot.fd >= 0) {
+            close(slot.fd);
+        }
+    }
+
+    if (ringFailed) {
+        qWarning() << "io_uring failed, file reads may be incomplete";
+        return false;
+    }
+    return ok;
+}
+
+#else
+
+bool BatchFileReader::ioUringSupported()
+{
+    return false;
+}
+
+bool BatchFileReader::readWithIoUring(const ZipEntrySource& source, const Sink& sink)
+{
+    return readWithThreads(source, sink);
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef BATCHFILEREADER_H
+#define BATCHFILEREADER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include "MappedFile.h"
+#include "MemoryGovernor.h"
+#include "ZipEntry.h"
+
+/**
+ * @struct  FileContents
+ *
+ * @brief   The contents of a file, either read into memory or memory-mapped.
+ */
+struct FileContents {
+    /**
+     * @brief   Whether the file was opened and read successfully.
+     */
+    bool ok = false;
+
+    /**
+     * @brief   The contents of the file, if it was read into memory.
+     */
+    QByteArray data;
+
+    /**
+     * @brief   The mapping of the file, if it was memory-mapped.
+     */
+    std::shared_ptr<MappedFile> mapping;
+
+    /**
+     * @brief   The part of the memory budget held by data, shared by the copies and given back with the last one.
+     */
+    MemoryGovernor::LeasePtr lease;
+
+    /**
+     * @brief   Get a pointer to the contents.
+     */
+    const char* constData() const { return mapping ? mapping->data() : data.constData(); }
+
+    /**
+     * @brief   Get the size of the contents in bytes.
+     */
+    qint64 size() const { return mapping ? mapping->size() : data.size(); }
+};
+
+/**
+ * @class   BatchFileReader
+ *
+ * @brief   Reads a list of files with many reads in flight at once, handing the contents back in order.
+ *
+ * @details Opening, reading and closing small files one at a time leaves the disk idle while each system call
+ *          returns, so for folders with lots of small files the syscall latency, not the device, sets the speed.
+ *          This class keeps up to queueDepth files in flight. On Linux 5.6 and later it uses io_uring: the openat
+ *          and statx for each upcoming file are submitted together in one batch, followed by the read and close, so
+ *          many files cost a single io_uring_enter call. Elsewhere, or if io_uring isn't available (older kernels,
+ *          or blocked by seccomp in some containers), a small pool of threads reads the files with QFile.
+ *
+ *          Whichever backend is used, the sink is called on the calling thread for each file in the order of the
+ *          list, and at most queueDepth files are held in memory waiting for it. Files at least as big as the map
+ *          threshold are memory-mapped rather than read (see MappedFile).
+ *
+ *          With a MemoryGovernor, the files read into memory hold a lease on its budget, and files there isn't
+ *          room for are mapped instead.
+ */
+class BatchFileReader {
+public:
+    /**
+     * @brief   How the files are read.
+     */
+    enum Backend {
+        Auto,       ///< io_uring if supported, otherwise ThreadPool
+        IoUring,    ///< io_uring (Linux only), falls back to ThreadPool if not supported
+        ThreadPool  ///< A pool of threads using QFile
+    };
+
+    /**
+     * @brief   Called for each file, in order.
+     *
+     * @param   index The index of the file in the list.
+     * @param   entry The file.
+     * @param   contents The contents of the file, which the sink can move from.
+     *
+     * @return  True to carry on, false to stop reading.
+     */
+    typedef std::function<bool(int index, const ZipEntry& entry, FileContents& contents)> Sink;
+
+    /**
+     * @brief   Create a reader.
+     *
+     * @param   queueDepth The maximum number of files in flight (clamped to 1 - 1024).
+     * @param   backend The backend to use.
+     */
+    explicit BatchFileReader(int queueDepth, Backend backend = Auto);
+
+    /**
+     * @brief   Memory-map files of at least this size instead of reading them.
+     *
+     * @param   threshold The size in bytes, or 0 to read all files (the default).
+     */
+    void setMapThreshold(qint64 threshold);
+
+    /**
+     * @brief   Drop files from the page cache once they have been read (see PageCache).
+     *
+     * @param   dropCache Whether to drop the files, off by default.
+     */
+    void setDropCache(bool dropCache);
+
+    /**
+     * @brief   Count the files read into memory against a memory budget.
+     *
+     * @param   governor The governor, or null to read files whatever the memory use (the default).
+     */
+    void setMemoryGovernor(MemoryGovernor* governor);
+
+    /**
+     * @brief   Get the backend that will actually be used.
+     *
+     * @return  IoUring or ThreadPool.
+     */
+    Backend backend() const;
+
+    /**
+     * @brief   Read a list of files.
+     *
+     * @param   entries The files to read, using ZipEntry::sourcePath.
+     * @param   sink Called with the contents of each file in order.
+     *
+     * @return  True if the sink was called for every file, false if it asked to stop early.
+     */
+    bool read(const QVector<ZipEntry>& entries, const Sink& sink);
+
+    /**
+     * @brief   Read files as they are produced by a source.
+     *
+     * @details The source is only ever called from one thread at a time, but not necessarily the calling thread.
+     *
+     * @param   source Called to get each file to read.
+     * @param   sink Called with the contents of each file in order.
+     *
+     * @return  True if the sink was called for every file, false if it asked to stop early.
+     */
+    bool read(const ZipEntrySource& source, const Sink& sink);
+
+    /**
+     * @brief   Check whether the running kernel supports the io_uring operations used by this class.
+     *
+     * @details The check is only done once per process.
+     *
+     * @return  True if io_uring can be used, false otherwise.
+     */
+    static bool ioUringSupported();
+
+    /**
+     * @brief   Read or map a single file on the calling thread.
+     *
+     * @details If mapping the file fails, it is read instead. With a governor, a file that would be read waits
+     *          briefly for room in the budget, and is mapped if there isn't any.
+     *
+     * @param   filename The file to read.
+     * @param   mapThreshold Map the file if it is at least this big, or 0 to always read it.
+     * @param   dropCache Drop the file from the page cache once it has been read.
+     * @param   governor The memory budget to read the file within, or null.
+     *
+     * @return  The contents of the file.
+     */
+    static FileContents readFile(const QString& filename, qint64 mapThreshold, bool dropCache = false, MemoryGovernor* governor = nullptr);
+
+private:
+    bool readWithThreads(const ZipEntrySource& source, const Sink& sink);
+    bool readWithIoUring(const ZipEntrySource& source, const Sink& sink);
+
+    int mQueueDepth;
+    Backend mBackend;
+    qint64 mMapThreshold;
+    bool mDropCache;
+    MemoryGovernor* mGovernor;
+};
+
+#endif // BATCHFILEREADER_H
@@ -0,0 +1,147 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * @class   BoundedQueue
+ *
+ * @brief   A blocking first-in first-out queue with a limit on the number of items and the bytes they hold.
+ *
+ * @details Used to connect the stages of the zip pipeline. Producers block in push while the queue is full, and
+ *          consumers block in pop while it is empty. A single item larger than the byte limit is still accepted
+ *          when the queue is empty, so large files don't deadlock the pipeline. The producer calls close when it
+ *          has finished, after which pop drains the remaining items and then returns false. Either side can call
+ *          abort to stop the pipeline early, which discards the remaining items and makes push and pop return false.
+ *
+ * @tparam  T The item type, which must be movable.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * @brief   Create an empty queue.
+     *
+     * @param   maxItems The maximum number of items in the queue.
+     * @param   maxBytes The maximum total size of the items in the queue, or 0 for no limit.
+     */
+    explicit BoundedQueue(size_t maxItems, size_t maxBytes = 0) :
+        mMaxItems(maxItems ? maxItems : 1),
+        mMaxBytes(maxBytes),
+        mBytes(0),
+        mClosed(false),
+        mAborted(false)
+    {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief   Add an item to the back of the queue, blocking while the queue is full.
+     *
+     * @param   item The item to add.
+     * @param   bytes The size of the item counted against the byte limit.
+     *
+     * @return  True if the item was added, false if the queue has been aborted or closed.
+     */
+    bool push(T item, size_t bytes = 0)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [&] {
+            return mAborted || mClosed || (mItems.size() < mMaxItems && (!mMaxBytes || mItems.empty() || mBytes + bytes <= mMaxBytes));
+        });
+        if (mAborted || mClosed) {
+            return false;
+        }
+        mItems.push_back(std::make_pair(std::move(item), bytes));
+        mBytes += bytes;
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief   Remove an item from the front of the queue, blocking while the queue is empty.
+     *
+     * @param   item Set to the removed item.
+     *
+     * @return  True if an item was removed, false if the queue has been closed and is empty, or has been aborted.
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [&] { return mAborted || mClosed || !mItems.empty(); });
+        if (mAborted || mItems.empty()) {
+            return false;
+        }
+        item = std::move(mItems.front().first);
+        mBytes -= mItems.front().second;
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief   Signal that no more items will be pushed.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+    /**
+     * @brief   Stop the queue, discarding any remaining items and waking up all waiting threads.
+     */
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mAborted = true;
+        mItems.clear();
+        mBytes = 0;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+    /**
+     * @brief   Empty the queue and open it again after close or abort.
+     *
+     * @details Only call when no other threads are using the queue.
+     */
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = false;
+        mAborted = false;
+        mItems.clear();
+        mBytes = 0;
+    }
+
+    /**
+     * @brief   Check whether the queue has been aborted.
+     */
+    bool isAborted() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mAborted;
+    }
+
+private:
+    const size_t mMaxItems;
+    const size_t mMaxBytes;
+    size_t mBytes;
+    bool mClosed;
+    bool mAborted;
+    std::deque<std::pair<T, size_t>> mItems;
+    mutable std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,177 @@
+#include "CpuCount.h"
+#include <QFile>
+#include <QList>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+const char* const CpuCount::EnvironmentVariable = "SIMPLEZIPPER_THREADS";
+
+namespace {
+
+#if defined(__linux__)
+// Where the cgroup hierarchies are mounted, v1 mounts the cpu controller under one of these names
+const char* const CgroupRoot = "/sys/fs/cgroup";
+const char* const CgroupV1CpuDirs[] = {"/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpu"};
+
+QByteArray readSmallFile(const QString& path)
+{
+    // Files in /proc and /sys say they're empty, so they have to be read until the end rather than by size
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+// Take the smallest quota, 0 meaning none
+double tighterQuota(double a, double b)
+{
+    if (a <= 0) {
+        return b;
+    }
+    return b > 0 ? std::min(a, b) : a;
+}
+
+// Look for a quota in the cgroup and every cgroup above it, as a container's limit is often set on a parent. If
+// the process is in a cgroup namespace the path is just "/", and if it isn't but the container only has its own
+// part of the hierarchy mounted, the folders that don't exist are skipped on the way up to the mount.
+template <typename Reader>
+double quotaUpFrom(const QString& mount, QString path, Reader readQuota)
+{
+    double quota = 0;
+    for (;;) {
+        quota = tighterQuota(quota, readQuota(mount + path));
+        int slash = path.lastIndexOf('/');
+        if (slash < 0 || path == "/") {
+            return quota;
+        }
+        path = slash == 0 ? QString("/") : path.left(slash);
+    }
+}
+
+double cgroupQuota()
+{
+    // Each line is "<id>:<controllers>:<path>", cgroup v2 has the single line "0::<path>"
+    double quota = 0;
+    const QList<QByteArray> lines = readSmallFile("/proc/self/cgroup").split('\n');
+    for (const QByteArray& line : lines) {
+        int first = line.indexOf(':');
+        int second = line.indexOf(':', first + 1);
+        if (first < 0 || second < 0) {
+            continue;
+        }
+        const QByteArray id = line.left(first);
+        const QByteArray controllers = line.mid(first + 1, second - first - 1);
+        const QString path = QString::fromUtf8(line.mid(second + 1));
+        if (id == "0" && controllers.isEmpty()) {
+            quota = tighterQuota(quota, quotaUpFrom(CgroupRoot, path, [](const QString& dir) {
+                return CpuCount::parseCgroupV2(readSmallFile(dir + "/cpu.max"));
+            }));
+        } else if (controllers.split(',').contains("cpu")) {
+            for (const char* mount : CgroupV1CpuDirs) {
+                quota = tighterQuota(quota, quotaUpFrom(mount, path, [](const QString& dir) {
+                    return CpuCount::parseCgroupV1(readSmallFile(dir + "/cpu.cfs_quota_us"), readSmallFile(dir + "/cpu.cfs_period_us"));
+                }));
+            }
+        }
+    }
+    return quota;
+}
+#endif
+
+int affinityCount()
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+#elif defined(_WIN32)
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        int count = 0;
+        for (; processMask; processMask &= processMask - 1) {
+            count++;
+        }
+        return count;
+    }
+#endif
+    return 0;
+}
+
+}
+
+int CpuCount::available()
+{
+    return info().threads;
+}
+
+const CpuCount::Info& CpuCount::info()
+{
+    static const Info cached = detect();
+    return cached;
+}
+
+CpuCount::Info CpuCount::detect()
+{
+    Info info;
+    info.hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    info.affinity = affinityCount();
+#if defined(__linux__)
+    info.quota = cgroupQuota();
+#endif
+
+    bool ok = false;
+    int override = qgetenv(EnvironmentVariable).trimmed().toInt(&ok);
+    if (ok && override > 0) {
+        info.threads = override;
+        info.source = "environment";
+        return info;
+    }
+
+    info.threads = info.hardware;
+    info.source = "hardware";
+    if (info.affinity > 0 && info.affinity < info.threads) {
+        info.threads = info.affinity;
+        info.source = "affinity";
+    }
+
+    // Rounded down, as a thread that can only have part of a core gets throttled every period, which stalls
+    // whatever is waiting on its result
+    int quotaThreads = std::max(1, static_cast<int>(std::floor(info.quota)));
+    if (info.quota > 0 && quotaThreads < info.threads) {
+        info.threads = quotaThreads;
+        info.source = "cgroup";
+    }
+    return info;
+}
+
+double CpuCount::parseCgroupV2(const QByteArray& cpuMax)
+{
+    QList<QByteArray> fields = cpuMax.simplified().split(' ');
+    if (fields.size() != 2 || fields[0] == "max") {
+        return 0;
+    }
+    return parseCgroupV1(fields[0], fields[1]);
+}
+
+double CpuCount::parseCgroupV1(const QByteArray& quota, const QByteArray& period)
+{
+    bool quotaOk = false;
+    bool periodOk = false;
+    qint64 quotaUs = quota.trimmed().toLongLong(&quotaOk);
+    qint64 periodUs = period.trimmed().toLongLong(&periodOk);
+    if (!quotaOk || !periodOk || quotaUs <= 0 || periodUs <= 0) {
+        return 0;
+    }
+    return static_cast<double>(quotaUs) / static_cast<double>(periodUs);
+}
@@ -0,0 +1,81 @@
+#ifndef CPUCOUNT_H
+#define CPUCOUNT_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @class   CpuCount
+ *
+ * @brief   Works out how many threads the process can actually keep busy.
+ *
+ * @details The core count (std::thread::hardware_concurrency, or QThread::idealThreadCount in Qt 5) is the whole
+ *          machine's. In a container with a CPU quota, or a process pinned to a few cores with taskset, that's far
+ *          more threads than will ever run at once, and the extra ones just get throttled and fight over caches. So
+ *          the count is the smallest of:
+ *
+ *          - the cores the machine has
+ *          - the cores the process is allowed to run on (sched_getaffinity, or GetProcessAffinityMask on Windows)
+ *          - the cgroup CPU quota, rounded down, from cpu.max (cgroup v2) or cpu.cfs_quota_us / cpu.cfs_period_us
+ *            (cgroup v1), in the process's own cgroup or any cgroup above it
+ *
+ *          unless the SIMPLEZIPPER_THREADS environment variable is set to a positive number, which wins outright.
+ *          Everything that sizes a thread pool by the CPUs (ZipScheduler, the ZipJob pool and DirectoryWalker) uses
+ *          available().
+ */
+class CpuCount {
+public:
+    /**
+     * @brief   What the thread count was worked out from.
+     */
+    struct Info {
+        int threads = 1;    ///< The number of threads to use
+        int hardware = 0;   ///< The cores the machine has
+        int affinity = 0;   ///< The cores the process may run on, 0 if unknown
+        double quota = 0;   ///< The cgroup CPU quota in cores, 0 if there's no quota
+        QString source;     ///< What set the count: "environment", "cgroup", "affinity" or "hardware"
+    };
+
+    /**
+     * @brief   The environment variable that overrides the detected count.
+     */
+    static const char* const EnvironmentVariable;
+
+    /**
+     * @brief   Get the number of threads to use, worked out the first time it's called.
+     */
+    static int available();
+
+    /**
+     * @brief   Get how available() was worked out.
+     */
+    static const Info& info();
+
+    /**
+     * @brief   Work the count out again, e.g., after changing the environment variable.
+     *
+     * @details This doesn't change what available() returns.
+     */
+    static Info detect();
+
+    /**
+     * @brief   Parse a cgroup v2 cpu.max file.
+     *
+     * @param   cpuMax The contents, "<quota> <period>" in microseconds, or "max <period>" for no quota.
+     *
+     * @return  The quota in cores, or 0 if there's no quota or the contents don't make sense.
+     */
+    static double parseCgroupV2(const QByteArray& cpuMax);
+
+    /**
+     * @brief   Parse the cgroup v1 cpu.cfs_quota_us and cpu.cfs_period_us files.
+     *
+     * @param   quota The quota in microseconds, -1 for no quota.
+     * @param   period The period in microseconds.
+     *
+     * @return  The quota in cores, or 0 if there's no quota or the contents don't make sense.
+     */
+    static double parseCgroupV1(const QByteArray& quota, const QByteArray& period);
+};
+
+#endif // CPUCOUNT_H
@@ -0,0 +1,324 @@
+#include "DirectoryWalker.h"
+#include "CpuCount.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <functional>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+const int MaxWalkerThreads = 4;
+
+// Checks a name in the folder being read against the filter, empty if there isn't one
+typedef std::function<bool(const char* name, bool isDir)> KeepFunction;
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Resolve symlinks and unknown types with a stat, everything else comes straight from d_type
+void addEntry(int dirFd, const char* name, unsigned char type, const KeepFunction& keep, QStringList& files, QStringList& dirs)
+{
+    if (name[0] == '.') {
+        return;
+    }
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+        // Don't stat names that would be dropped whatever they turn out to be
+        if (keep && !keep(name, false) && !keep(name, true)) {
+            return;
+        }
+        struct stat st;
+        if (fstatat(dirFd, name, &st, 0) != 0) {
+            return;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+    }
+
+    if (type == DT_REG && (!keep || keep(name, false))) {
+        files.append(QFile::decodeName(name));
+    } else if (type == DT_DIR && (!keep || keep(name, true))) {
+        dirs.append(QFile::decodeName(name));
+    }
+}
+
+QByteArray directoryId(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return QByteArray();
+    }
+    return QByteArray::number(static_cast<qulonglong>(st.st_dev)) + ':' + QByteArray::number(static_cast<qulonglong>(st.st_ino));
+}
+
+#endif
+
+#if defined(__linux__)
+
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+bool readDirectory(const QString& path, const KeepFunction& keep, QByteArray& id, QStringList& files, QStringList& dirs)
+{
+    int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    id = directoryId(fd);
+
+    // One getdents64 call returns as many entries as fit in the buffer
+    alignas(8) char buffer[64 * 1024];
+    for (;;) {
+        long count = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (count <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < count;) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+            addEntry(fd, entry->d_name, entry->d_type, keep, files, dirs);
+            offset += entry->d_reclen;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+bool readDirectory(const QString& path, const KeepFunction& keep, QByteArray& id, QStringList& files, QStringList& dirs)
+{
+    DIR* dir = opendir(QFile::encodeName(path).constData());
+    if (!dir) {
+        return false;
+    }
+    int fd = dirfd(dir);
+    id = directoryId(fd);
+    while (struct dirent* entry = readdir(dir)) {
+        addEntry(fd, entry->d_name, entry->d_type, keep, files, dirs);
+    }
+    closedir(dir);
+    return true;
+}
+
+#else
+
+bool readDirectory(const QString& path, const KeepFunction& keep, QByteArray& id, QStringList& files, QStringList& dirs)
+{
+    QDir dir(path);
+    if (!dir.exists()) {
+        return false;
+    }
+    id = QFileInfo(path).canonicalFilePath().toUtf8();
+    files = dir.entryList(QDir::Files, QDir::NoSort);
+    dirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::NoSort);
+    if (keep) {
+        auto filter = [&keep](QStringList& names, bool isDir) {
+            QStringList kept;
+            for (const auto& name : names) {
+                if (keep(name.toUtf8().constData(), isDir)) {
+                    kept.append(name);
+                }
+            }
+            names = kept;
+        };
+        filter(files, false);
+        filter(dirs, true);
+    }
+    return true;
+}
+
+#endif
+
+void sortNames(QStringList& names)
+{
+    std::sort(names.begin(), names.end(), [](const QString& a, const QString& b) {
+        int result = a.compare(b, Qt::CaseInsensitive);
+        return result ? result < 0 : a < b;
+    });
+}
+
+}
+
+DirectoryWalker::DirectoryWalker(int threads) :
+    mThreadCount(threads > 0 ? threads : std::max(1, std::min(MaxWalkerThreads, CpuCount::available()))),
+    mStopping(false)
+{
+}
+
+DirectoryWalker::~DirectoryWalker()
+{
+    stop();
+}
+
+void DirectoryWalker::setFilter(std::shared_ptr<const PathFilter> filter)
+{
+    mFilter = filter && !filter->isEmpty() ? std::move(filter) : nullptr;
+}
+
+void DirectoryWalker::start(const QString& folder, const QString& prefix)
+{
+    stop();
+
+    std::shared_ptr<Node> root = std::make_shared<Node>();
+    root->path = folder;
+    root->prefix = prefix;
+    if (mFilter) {
+        root->scope = mFilter->rootScope();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = false;
+        mWork.assign(1, root);
+        mStack.assign(1, Cursor());
+        mStack.back().node = root;
+    }
+    for (int i = 0; i < mThreadCount; i++) {
+        mThreads.emplace_back(&DirectoryWalker::workerLoop, this);
+    }
+}
+
+bool DirectoryWalker::next(ZipEntry& entry)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStack.empty()) {
+        mListedCondition.wait(lock, [&] { return mStopping || mStack.back().node->listed; });
+        if (mStopping) {
+            return false;
+        }
+
+        // Depth first: this folder's files, then each subfolder in turn
+        Cursor& cursor = mStack.back();
+        Node& node = *cursor.node;
+        if (cursor.file < node.files.size()) {
+            entry = node.files[cursor.file++];
+            return true;
+        }
+        if (cursor.child < node.children.size()) {
+            Cursor child;
+            child.node = std::move(node.children[cursor.child++]);
+            mStack.push_back(std::move(child));
+            continue;
+        }
+        mStack.pop_back();
+    }
+    return false;
+}
+
+void DirectoryWalker::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+        mWorkCondition.notify_all();
+        mListedCondition.notify_all();
+    }
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+    mWork.clear();
+    mStack.clear();
+}
+
+QVector<ZipEntry> DirectoryWalker::list(const QString& folder, const QString& prefix, int threads, std::shared_ptr<const PathFilter> filter)
+{
+    QVector<ZipEntry> entries;
+    DirectoryWalker walker(threads);
+    walker.setFilter(std::move(filter));
+    walker.start(folder, prefix);
+    ZipEntry entry;
+    while (walker.next(entry)) {
+        entries.append(entry);
+    }
+    return entries;
+}
+
+void DirectoryWalker::workerLoop()
+{
+    for (;;) {
+        std::shared_ptr<Node> node;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkCondition.wait(lock, [&] { return mStopping || !mWork.empty(); });
+            if (mStopping) {
+                return;
+            }
+            node = std::move(mWork.back());
+            mWork.pop_back();
+        }
+        listNode(*node);
+    }
+}
+
+void DirectoryWalker::listNode(Node& node)
+{
+    // Names are matched against the path relative to the top folder, so the rules can be anchored
+    std::shared_ptr<const PathFilter::Scope> scope;
+    KeepFunction keep;
+    if (mFilter) {
+        scope = mFilter->enter(node.scope, node.path, node.relativePath);
+        keep = [&](const char* name, bool isDir) {
+            return mFilter->keep(scope.get(), node.relativePath + name, node.relativePath.size(), isDir);
+        };
+    }
+
+    QByteArray id;
+    QStringList files;
+    QStringList dirs;
+    if (!readDirectory(node.path, keep, id, files, dirs)) {
+        qWarning() << "Failed to read folder" << node.path;
+    } else if (!id.isEmpty() && std::find(node.ancestors.begin(), node.ancestors.end(), id) != node.ancestors.end()) {
+        qWarning() << "Skipping folder" << node.path << "which links back to one of its parents";
+        files.clear();
+        dirs.clear();
+    }
+
+    sortNames(files);
+    sortNames(dirs);
+    for (const auto& file : files) {
+        ZipEntry entry;
+        entry.sourcePath = node.path + "/" + file;
+        entry.archiveName = node.prefix + file;
+        node.files.append(entry);
+    }
+
+    std::vector<std::shared_ptr<Node>> children;
+    for (const auto& dir : dirs) {
+        std::shared_ptr<Node> child = std::make_shared<Node>();
+        child->path = node.path + "/" + dir;
+        child->prefix = node.prefix + dir + "/";
+        child->ancestors = node.ancestors;
+        child->ancestors.push_back(id);
+        if (mFilter) {
+            child->relativePath = node.relativePath + dir.toUtf8() + '/';
+            child->scope = scope;
+        }
+        children.push_back(child);
+    }
+
+    // The work list is a stack, so push the children in reverse to list them in the order they'll be needed
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        mWork.push_back(*it);
+    }
+    node.children = std::move(children);
+    node.listed = true;
+    mWorkCondition.notify_all();
+    mListedCondition.notify_all();
+}
@@ -0,0 +1,122 @@
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "PathFilter.h"
+#include "ZipEntry.h"
+
+/**
+ * @class   DirectoryWalker
+ *
+ * @brief   Finds the files in a folder and its subfolders, listing several folders at once.
+ *
+ * @details A pool of threads lists folders in parallel, while the caller takes files out with next as soon as they
+ *          have been found, so compression can start before the whole tree has been walked. On Linux the folders are
+ *          read with getdents64 and the entry types come from d_type, so the files themselves are never stat'ed
+ *          (only symlinks and file systems that don't fill in d_type need a stat). Other Unix systems use readdir,
+ *          which also gives d_type, and Windows uses QDir.
+ *
+ *          The order is the same whatever the number of threads: each folder's files in name order (ignoring case),
+ *          then each of its subfolders in turn. Symlinks are followed, but a folder that links back to one of its
+ *          own parents is skipped with a warning rather than walked forever. As with QDir's default filters,
+ *          hidden files and folders (starting with '.') are skipped.
+ *
+ *          If a PathFilter is set, each name is checked as the folder is read, before anything else is done with it:
+ *          excluded folders are never opened, and excluded symlinks are never stat'ed.
+ */
+class DirectoryWalker {
+public:
+    /**
+     * @brief   Create a walker.
+     *
+     * @param   threads The number of threads listing folders, or 0 to pick automatically.
+     */
+    explicit DirectoryWalker(int threads = 0);
+    ~DirectoryWalker();
+
+    DirectoryWalker(const DirectoryWalker&) = delete;
+    DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+    /**
+     * @brief   Set the include / exclude rules for the next walk.
+     *
+     * @param   filter The filter, or null to keep every file.
+     */
+    void setFilter(std::shared_ptr<const PathFilter> filter);
+
+    /**
+     * @brief   Start walking a folder.
+     *
+     * @param   folder The folder to walk.
+     * @param   prefix The prefix for the archive names of the files found.
+     */
+    void start(const QString& folder, const QString& prefix = QString());
+
+    /**
+     * @brief   Get the next file, waiting for it to be found if necessary.
+     *
+     * @details Only call from one thread at a time.
+     *
+     * @param   entry Set to the next file, with the path relative to the folder (plus the prefix) as its archive name.
+     *
+     * @return  True if there was another file, false when the walk has finished.
+     */
+    bool next(ZipEntry& entry);
+
+    /**
+     * @brief   Stop walking and wait for the threads to finish.
+     */
+    void stop();
+
+    /**
+     * @brief   Walk a folder and return all of the files in it.
+     *
+     * @param   folder The folder to walk.
+     * @param   prefix The prefix for the archive names of the files found.
+     * @param   threads The number of threads listing folders, or 0 to pick automatically.
+     * @param   filter The include / exclude rules, or null to keep every file.
+     *
+     * @return  The files, in the order described above.
+     */
+    static QVector<ZipEntry> list(const QString& folder, const QString& prefix = QString(), int threads = 0, std::shared_ptr<const PathFilter> filter = nullptr);
+
+private:
+    struct Node {
+        QString path;
+        QString prefix;
+        std::vector<QByteArray> ancestors;
+        QByteArray relativePath;
+        std::shared_ptr<const PathFilter::Scope> scope;
+        bool listed = false;
+        QVector<ZipEntry> files;
+        std::vector<std::shared_ptr<Node>> children;
+    };
+
+    struct Cursor {
+        std::shared_ptr<Node> node;
+        int file = 0;
+        size_t child = 0;
+    };
+
+    void workerLoop();
+    void listNode(Node& node);
+
+    int mThreadCount;
+    std::shared_ptr<const PathFilter> mFilter;
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mListedCondition;
+    std::vector<std::shared_ptr<Node>> mWork;
+    std::vector<Cursor> mStack;
+    bool mStopping;
+};
+
+#endif // DIRECTORYWALKER_H
@@ -0,0 +1,110 @@
+#include "DiskOrder.h"
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <cerrno>
+#endif
+
+QVector<int> DiskOrder::sort(QVector<ZipEntry>& entries, Order order)
+{
+    std::vector<std::pair<quint64, int>> keys;
+    while (order != NameOrder) {
+        bool supported = true;
+        keys.clear();
+        keys.reserve(entries.size());
+        for (int i = 0; i < entries.size() && supported; i++) {
+            keys.push_back(std::make_pair(key(entries[i].sourcePath, order, supported), i));
+        }
+        if (supported) {
+            break;
+        }
+
+        // Physical offsets and inode numbers can't be mixed, so start again with the fallback order
+        order = order == ExtentOrder ? InodeOrder : NameOrder;
+    }
+
+    QVector<int> indices;
+    indices.reserve(entries.size());
+    if (order == NameOrder) {
+        for (int i = 0; i < entries.size(); i++) {
+            indices.append(i);
+        }
+        return indices;
+    }
+
+    // Ties are broken by the original index, so the sort is stable
+    std::sort(keys.begin(), keys.end());
+
+    QVector<ZipEntry> sorted;
+    sorted.reserve(entries.size());
+    for (const auto& item : keys) {
+        indices.append(item.second);
+        sorted.append(entries[item.second]);
+    }
+    entries.swap(sorted);
+    return indices;
+}
+
+quint64 DiskOrder::key(const QString& filename, Order order, bool& supported)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (order == InodeOrder) {
+        struct stat st;
+        if (stat(QFile::encodeName(filename).constData(), &st) != 0) {
+            return 0;
+        }
+        return static_cast<quint64>(st.st_ino);
+    }
+#endif
+
+#if defined(__linux__)
+    if (order == ExtentOrder) {
+        int fd = open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+        if (fd < 0 && errno == EPERM) {
+            // O_NOATIME is only allowed for the file's owner
+            fd = open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd < 0) {
+            return 0;
+        }
+
+        // Only the first extent is needed
+        alignas(struct fiemap) char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+        memset(buffer, 0, sizeof(buffer));
+        struct fiemap* map = reinterpret_cast<struct fiemap*>(buffer);
+        map->fm_start = 0;
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+        int result = ioctl(fd, FS_IOC_FIEMAP, map);
+        int error = errno;
+        close(fd);
+
+        if (result != 0) {
+            if (error == ENOTTY || error == EOPNOTSUPP) {
+                supported = false;
+            }
+            return 0;
+        }
+        return map->fm_mapped_extents ? map->fm_extents[0].fe_physical : 0;
+    }
+#endif
+
+    Q_UNUSED(filename);
+    if (order != NameOrder) {
+        supported = false;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef DISKORDER_H
+#define DISKORDER_H
+
+#include <QString>
+#include <QVector>
+#include "ZipEntry.h"
+
+/**
+ * @class   DiskOrder
+ *
+ * @brief   Sorts files into the order they are laid out on disk.
+ *
+ * @details On a spinning disk, reading a folder's files in name order makes the heads seek all over the platter,
+ *          since files created at different times end up far apart. Reading them in the order of their inode
+ *          numbers, or better still of the physical offset of their first block (from the FIEMAP ioctl on Linux),
+ *          turns most of those seeks into short forward steps, which is often several times faster for trees of
+ *          many small files. On SSDs and in the page cache it makes no difference, so it is off by default.
+ *
+ *          Looking up the physical offsets costs an open and an ioctl for each file, but that only touches metadata.
+ *          On platforms without inode numbers or FIEMAP the order is left as it is.
+ */
+class DiskOrder {
+public:
+    /**
+     * @brief   The order to read files in.
+     */
+    enum Order {
+        NameOrder,   ///< The order the files were found in
+        InodeOrder,  ///< By inode number
+        ExtentOrder  ///< By the physical offset of the first block, falls back to InodeOrder if FIEMAP isn't supported
+    };
+
+    /**
+     * @brief   Sort files into disk order.
+     *
+     * @details Files the same distance along the disk (e.g., empty files, or ones that couldn't be looked up) keep
+     *          their original order.
+     *
+     * @param   entries The files to sort, using ZipEntry::sourcePath.
+     * @param   order The order to sort them into.
+     *
+     * @return  The original index of each file in the sorted list.
+     */
+    static QVector<int> sort(QVector<ZipEntry>& entries, Order order);
+
+    /**
+     * @brief   Get the key a file is sorted by.
+     *
+     * @param   filename The file.
+     * @param   order InodeOrder or ExtentOrder.
+     * @param   supported Set to false if the order isn't supported on this file system or platform.
+     *
+     * @return  The inode number or physical offset in bytes, or 0 if the file has no blocks or couldn't be looked up.
+     */
+    static quint64 key(const QString& filename, Order order, bool& supported);
+};
+
+#endif // DISKORDER_H
@@ -0,0 +1,148 @@
+#include "MappedFile.h"
+#include "PageCache.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace {
+
+// How much of the file to ask the kernel to start reading straight away
+const qint64 PrefetchSize = 2 * 1024 * 1024;
+
+// Holes smaller than this aren't worth handling separately
+const qint64 MinHoleSize = 64 * 1024;
+
+qint64 pageSize()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#elif defined(__unix__) || defined(__APPLE__)
+    return sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const QString& filename, bool dropCache)
+{
+    close();
+    mDropCache = dropCache;
+    mFile.setFileName(filename);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    mSize = mFile.size();
+    mData = mSize > 0 ? mFile.map(0, mSize) : nullptr;
+    if (!mData) {
+        close();
+        return false;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    madvise(mData, static_cast<size_t>(mSize), MADV_SEQUENTIAL);
+    madvise(mData, static_cast<size_t>(qMin(mSize, PrefetchSize)), MADV_WILLNEED);
+#endif
+    findHoles();
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData) {
+        mFile.unmap(mData);
+    }
+    if (mDropCache && mFile.isOpen()) {
+        PageCache::drop(mFile.handle());
+    }
+    if (mFile.isOpen()) {
+        mFile.close();
+    }
+    mData = nullptr;
+    mSize = 0;
+    mReleased = 0;
+    mHoles.clear();
+}
+
+void MappedFile::release(qint64 offset)
+{
+    static const qint64 page = pageSize();
+    qint64 end = qMin(offset, mSize) / page * page;
+    if (!mData || end <= mReleased) {
+        return;
+    }
+
+    // The mapping starts on a page boundary, so mReleased is always page aligned
+    uchar* start = mData + mReleased;
+    size_t length = static_cast<size_t>(end - mReleased);
+#if defined(_WIN32)
+    // Unlocking pages that aren't locked removes them from the working set, which is what we want
+    VirtualUnlock(start, length);
+#elif defined(__unix__) || defined(__APPLE__)
+    madvise(start, length, MADV_DONTNEED);
+    if (mDropCache) {
+        PageCache::drop(mFile.handle(), mReleased, end - mReleased);
+    }
+#else
+    Q_UNUSED(start);
+    Q_UNUSED(length);
+#endif
+    mReleased = end;
+}
+
+qint64 MappedFile::zeroRun(qint64 offset) const
+{
+    // Find the first hole ending after the offset
+    auto hole = std::upper_bound(mHoles.begin(), mHoles.end(), offset, [](qint64 value, const QPair<qint64, qint64>& range) {
+        return value < range.second;
+    });
+    if (hole == mHoles.end() || offset < hole->first) {
+        return 0;
+    }
+    return hole->second - offset;
+}
+
+void MappedFile::findHoles()
+{
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+    // Files with as many blocks allocated as their size can't have holes, so don't bother looking
+    int fd = mFile.handle();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<qint64>(st.st_blocks) * 512 >= mSize) {
+        return;
+    }
+
+    off_t offset = 0;
+    while (offset < mSize) {
+        off_t holeStart = lseek(fd, offset, SEEK_HOLE);
+        if (holeStart < 0 || holeStart >= mSize) {
+            break;
+        }
+        off_t holeEnd = lseek(fd, holeStart, SEEK_DATA);
+        if (holeEnd < 0) {
+            // No more data, the hole runs to the end of the file
+            holeEnd = mSize;
+        }
+        if (holeEnd - holeStart >= MinHoleSize) {
+            mHoles.append(qMakePair(static_cast<qint64>(holeStart), static_cast<qint64>(holeEnd)));
+        }
+        offset = holeEnd;
+    }
+#endif
+}
@@ -0,0 +1,91 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+/**
+ * @class   MappedFile
+ *
+ * @brief   A read-only memory mapping of a whole file, for compressing straight from the page cache.
+ *
+ * @details Reading a large file with QFile::readAll copies it into a heap buffer the size of the file before miniz
+ *          copies it again into its dictionary. Mapping the file avoids the heap buffer and the first copy. The
+ *          mapping is advised as sequential so the kernel reads ahead aggressively, and as the compressor moves
+ *          through the file, release drops the pages behind it (MADV_DONTNEED on Unix, removing them from the
+ *          working set on Windows), so the memory used stays bounded even for very large files.
+ *
+ *          Sparse files (e.g., preallocated simulation outputs) are checked for holes with SEEK_DATA / SEEK_HOLE when
+ *          they are opened. zeroRun reports the holes, so the compressor can use zeros in their place instead of
+ *          faulting in pages of the mapping that would only be zero-filled anyway.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief   Map a file.
+     *
+     * @param   filename The file to map.
+     * @param   dropCache Also drop released pages from the page cache (see PageCache).
+     *
+     * @return  True if the file was mapped, false otherwise (e.g., it is empty or can't be opened).
+     */
+    bool open(const QString& filename, bool dropCache = false);
+
+    /**
+     * @brief   Unmap the file.
+     */
+    void close();
+
+    /**
+     * @brief   Tell the operating system everything before an offset has been read and won't be needed again.
+     *
+     * @details Only whole pages are released, and offsets at or before the last call are ignored.
+     *
+     * @param   offset The offset the file has been consumed up to.
+     */
+    void release(qint64 offset);
+
+    /**
+     * @brief   Get the number of bytes from an offset that are known to be zero because they are in a hole.
+     *
+     * @param   offset The offset in the file.
+     *
+     * @return  The number of bytes to the end of the hole, or 0 if the offset isn't in a hole.
+     */
+    qint64 zeroRun(qint64 offset) const;
+
+    /**
+     * @brief   Check whether the file has any holes.
+     */
+    bool isSparse() const { return !mHoles.isEmpty(); }
+
+    /**
+     * @brief   Get a pointer to the start of the mapping.
+     */
+    const char* data() const { return reinterpret_cast<const char*>(mData); }
+
+    /**
+     * @brief   Get the size of the mapping in bytes.
+     */
+    qint64 size() const { return mSize; }
+
+private:
+    void findHoles();
+
+    QFile mFile;
+    uchar* mData = nullptr;
+    qint64 mSize = 0;
+    qint64 mReleased = 0;
+    bool mDropCache = false;
+    QVector<QPair<qint64, qint64>> mHoles;
+};
+
+#endif // MAPPEDFILE_H
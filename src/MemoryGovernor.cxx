@@ -0,0 +1,97 @@
+#include "MemoryGovernor.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// Files bigger than this fraction of the budget are always mapped, so one file can't take the whole budget
+const qint64 LargeFileFraction = 4;
+
+}
+
+MemoryGovernor::Lease::Lease(MemoryGovernor* governor, qint64 size) :
+    mGovernor(governor),
+    mSize(size)
+{
+}
+
+MemoryGovernor::Lease::~Lease()
+{
+    mGovernor->release(mSize);
+}
+
+MemoryGovernor::MemoryGovernor(qint64 budget)
+{
+    mStats.budget = std::max<qint64>(budget, 0);
+}
+
+MemoryGovernor* MemoryGovernor::instance()
+{
+    static MemoryGovernor governor;
+    return &governor;
+}
+
+void MemoryGovernor::setBudget(qint64 budget)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.budget = std::max<qint64>(budget, 0);
+    }
+    mCondition.notify_all();
+}
+
+qint64 MemoryGovernor::budget() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats.budget;
+}
+
+MemoryGovernor::LeasePtr MemoryGovernor::reserve(qint64 bytes, int waitMs)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto fits = [this, bytes] { return mStats.budget == 0 || mStats.current + bytes <= mStats.budget; };
+    if (mStats.budget > 0 && bytes > mStats.budget / LargeFileFraction) {
+        mStats.backoffs++;
+        return LeasePtr();
+    }
+
+    if (!fits() && waitMs > 0) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mStats.waits++;
+        mCondition.wait_for(lock, std::chrono::milliseconds(waitMs), fits);
+        mStats.waitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (!fits()) {
+        mStats.backoffs++;
+        return LeasePtr();
+    }
+    return grant(bytes);
+}
+
+MemoryGovernor::LeasePtr MemoryGovernor::charge(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return grant(bytes);
+}
+
+MemoryGovernor::Stats MemoryGovernor::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+MemoryGovernor::LeasePtr MemoryGovernor::grant(qint64 bytes)
+{
+    mStats.current += bytes;
+    mStats.peak = std::max(mStats.peak, mStats.current);
+    return LeasePtr(new Lease(this, bytes));
+}
+
+void MemoryGovernor::release(qint64 bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.current -= bytes;
+    }
+    mCondition.notify_all();
+}
@@ -0,0 +1,133 @@
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <QtGlobal>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/**
+ * @class   MemoryGovernor
+ *
+ * @brief   A byte budget for the file data that every zip job in the process holds in memory.
+ *
+ * @details Each job limits its own read-ahead (ZipOptions::readAheadBytes), but every job gets that much, so running
+ *          several jobs at once multiplies the memory use. The governor puts a single limit on all of them. Files
+ *          read into memory and compressed chunks waiting to be written hold a Lease on part of the budget, and the
+ *          lease is given back when the last copy of the data goes away.
+ *
+ *          Readers reserve a file's size before reading it. If the budget is used up they wait a little for another
+ *          job to give some back, then back off to memory-mapping the file instead: the pages of a mapping belong to
+ *          the page cache, which the kernel can reclaim, and they're dropped as the compressor gets through them (see
+ *          MappedFile). Files bigger than a quarter of the budget are always mapped. Compressed output is charged
+ *          without waiting, even if that goes over the budget, since writing it out is what frees the budget again;
+ *          the readers back off until it has been.
+ *
+ *          The budget is 0 (unlimited) by default, in which case the governor just keeps the statistics.
+ */
+class MemoryGovernor {
+public:
+    /**
+     * @brief   What the governor has seen since it was created.
+     */
+    struct Stats {
+        qint64 budget = 0;          ///< The budget in bytes, 0 for unlimited
+        qint64 current = 0;         ///< The bytes currently held
+        qint64 peak = 0;            ///< The most bytes held at once
+        quint64 waits = 0;          ///< Reservations that had to wait for room
+        qint64 waitNanoseconds = 0; ///< Total time spent waiting
+        quint64 backoffs = 0;       ///< Reservations refused, so the file was mapped instead
+    };
+
+    class Lease;
+    typedef std::shared_ptr<Lease> LeasePtr;
+
+    /**
+     * @brief   Create a governor.
+     *
+     * @param   budget The budget in bytes, or 0 for unlimited.
+     */
+    explicit MemoryGovernor(qint64 budget = 0);
+
+    MemoryGovernor(const MemoryGovernor&) = delete;
+    MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+    /**
+     * @brief   Get the process-wide governor, which jobs use unless ZipOptions::memoryGovernor says otherwise.
+     */
+    static MemoryGovernor* instance();
+
+    /**
+     * @brief   Change the budget, which applies to new reservations straight away.
+     *
+     * @param   budget The budget in bytes, or 0 for unlimited.
+     */
+    void setBudget(qint64 budget);
+
+    /**
+     * @brief   Get the budget in bytes, 0 for unlimited.
+     */
+    qint64 budget() const;
+
+    /**
+     * @brief   Reserve room for data that is about to be read into memory.
+     *
+     * @param   bytes The number of bytes.
+     * @param   waitMs How long to wait for room if the budget is used up.
+     *
+     * @return  The lease, or null if the data is too big for the budget or there wasn't room in time.
+     */
+    LeasePtr reserve(qint64 bytes, int waitMs = 0);
+
+    /**
+     * @brief   Charge for data that has to be held whatever the budget, without waiting.
+     *
+     * @param   bytes The number of bytes.
+     *
+     * @return  The lease.
+     */
+    LeasePtr charge(qint64 bytes);
+
+    /**
+     * @brief   Get the statistics.
+     */
+    Stats stats() const;
+
+private:
+    void release(qint64 bytes);
+    LeasePtr grant(qint64 bytes);
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    Stats mStats;
+};
+
+/**
+ * @class   MemoryGovernor::Lease
+ *
+ * @brief   Part of the budget, given back when the lease is destroyed.
+ *
+ * @details The governor must outlive its leases.
+ */
+class MemoryGovernor::Lease {
+public:
+    ~Lease();
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    /**
+     * @brief   Get the number of bytes held.
+     */
+    qint64 size() const { return mSize; }
+
+private:
+    friend class MemoryGovernor;
+
+    Lease(MemoryGovernor* governor, qint64 size);
+
+    MemoryGovernor* mGovernor;
+    qint64 mSize;
+};
+
+#endif // MEMORYGOVERNOR_H
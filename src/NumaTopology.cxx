@@ -0,0 +1,166 @@
+#include "NumaTopology.h"
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <algorithm>
+#include <thread>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* const NumaTopology::EnvironmentVariable = "SIMPLEZIPPER_NUMA";
+
+namespace {
+
+#if defined(__linux__)
+const char* const NodeRoot = "/sys/devices/system/node";
+
+// From linux/mempolicy.h, which libc doesn't have without libnuma
+const unsigned long MpolFNode = 1;
+const unsigned long MpolFAddr = 2;
+
+// Parse a cpulist file, e.g., "0-3,8-11"
+std::vector<int> parseCpuList(const QByteArray& list)
+{
+    std::vector<int> cpus;
+    const QList<QByteArray> ranges = list.trimmed().split(',');
+    for (const QByteArray& range : ranges) {
+        QList<QByteArray> ends = range.split('-');
+        bool firstOk = false;
+        bool lastOk = false;
+        int first = ends[0].toInt(&firstOk);
+        int last = ends.size() > 1 ? ends[1].toInt(&lastOk) : first;
+        if (!firstOk || (ends.size() > 1 && !lastOk)) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<NumaTopology::Node> readNodes()
+{
+    std::vector<NumaTopology::Node> nodes;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return nodes;
+    }
+
+    DIR* dir = opendir(NodeRoot);
+    if (!dir) {
+        return nodes;
+    }
+    while (dirent* entry = readdir(dir)) {
+        QByteArray name(entry->d_name);
+        bool ok = false;
+        int id = name.startsWith("node") ? name.mid(4).toInt(&ok) : -1;
+        if (!ok) {
+            continue;
+        }
+        QFile file(QString("%1/%2/cpulist").arg(NodeRoot, QString::fromUtf8(name)));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        NumaTopology::Node node;
+        node.id = id;
+        for (int cpu : parseCpuList(file.readAll())) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        if (!node.cpus.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    closedir(dir);
+
+    std::sort(nodes.begin(), nodes.end(), [](const NumaTopology::Node& a, const NumaTopology::Node& b) {
+        return a.id < b.id;
+    });
+    return nodes;
+}
+#endif
+
+}
+
+NumaTopology::NumaTopology()
+{
+#if defined(__linux__)
+    if (qgetenv(EnvironmentVariable).trimmed() != "0") {
+        mNodes = readNodes();
+    }
+#endif
+
+    // Not NUMA (or not known to be) is the same as one node with every core on it
+    if (mNodes.size() < 2) {
+        mNodes.assign(1, Node());
+        for (int cpu = 0; cpu < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); cpu++) {
+            mNodes[0].cpus.push_back(cpu);
+        }
+    }
+}
+
+const NumaTopology& NumaTopology::instance()
+{
+    static const NumaTopology topology;
+    return topology;
+}
+
+int NumaTopology::nodeCount() const
+{
+    return static_cast<int>(mNodes.size());
+}
+
+const NumaTopology::Node& NumaTopology::node(int index) const
+{
+    return mNodes[index];
+}
+
+int NumaTopology::indexOf(int id) const
+{
+    for (int i = 0; i < nodeCount(); i++) {
+        if (mNodes[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool NumaTopology::pinToNode(int index) const
+{
+#if defined(__linux__)
+    if (nodeCount() < 2) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : mNodes[index].cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    Q_UNUSED(index);
+    return false;
+#endif
+}
+
+int NumaTopology::nodeOf(const void* address)
+{
+#if defined(__linux__)
+    int node = -1;
+    if (address && syscall(SYS_get_mempolicy, &node, nullptr, 0, const_cast<void*>(address), MpolFNode | MpolFAddr) == 0) {
+        return node;
+    }
+#else
+    Q_UNUSED(address);
+#endif
+    return -1;
+}
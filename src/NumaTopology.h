@@ -0,0 +1,83 @@
+#ifndef NUMATOPOLOGY_H
+#define NUMATOPOLOGY_H
+
+#include <vector>
+
+/**
+ * @class   NumaTopology
+ *
+ * @brief   The machine's NUMA nodes and the cores the process can use on each of them.
+ *
+ * @details On a machine with more than one socket, memory is attached to one socket (node) or another, and reading
+ *          memory on the other node goes over the interconnect at a fraction of the bandwidth. ZipScheduler uses
+ *          this to pin each of its workers to one node's cores, so the compressor state and output buffers a worker
+ *          allocates are placed on its own node the first time it touches them (the kernel's default first-touch
+ *          policy), and to send each chunk of input to a worker on the node the input was read into (see nodeOf).
+ *
+ *          The nodes come from /sys/devices/system/node on Linux, keeping only the cores in the process's affinity
+ *          mask and only the nodes that have any. Everywhere else, and if SIMPLEZIPPER_NUMA is set to 0, there's
+ *          a single node with every core on it, and nothing is pinned or routed.
+ */
+class NumaTopology {
+public:
+    /**
+     * @brief   A node the process can run on.
+     */
+    struct Node {
+        int id = 0;             ///< The node's number in the system, as returned by nodeOf
+        std::vector<int> cpus;  ///< The cores on the node the process may run on
+    };
+
+    /**
+     * @brief   The environment variable that turns NUMA placement off when set to 0.
+     */
+    static const char* const EnvironmentVariable;
+
+    /**
+     * @brief   Get the topology, read the first time it's called.
+     */
+    static const NumaTopology& instance();
+
+    /**
+     * @brief   Get the number of nodes the process can run on, 1 if the machine isn't NUMA or placement is off.
+     */
+    int nodeCount() const;
+
+    /**
+     * @brief   Get a node by its index, from 0 to nodeCount() - 1.
+     */
+    const Node& node(int index) const;
+
+    /**
+     * @brief   Get the index of the node with a system node number.
+     *
+     * @return  The index, or -1 if the process doesn't run on that node.
+     */
+    int indexOf(int id) const;
+
+    /**
+     * @brief   Pin the calling thread to the cores of a node, leaving the kernel to balance it between them.
+     *
+     * @param   index The node's index.
+     *
+     * @return  True if the thread was pinned.
+     */
+    bool pinToNode(int index) const;
+
+    /**
+     * @brief   Get the system node number of the memory at an address.
+     *
+     * @details The page must already be in memory, e.g., a buffer a file has been read into (it's a single
+     *          get_mempolicy call). Only call this when nodeCount() > 1.
+     *
+     * @return  The node number, or -1 if it isn't known.
+     */
+    static int nodeOf(const void* address);
+
+private:
+    NumaTopology();
+
+    std::vector<Node> mNodes;
+};
+
+#endif // NUMATOPOLOGY_H
@@ -0,0 +1,137 @@
+#include "PageAllocator.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t HugePageSize = 2 * 1024 * 1024;
+
+size_t roundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+}
+
+#if defined(_WIN32)
+
+void* PageAllocator::allocate(size_t& size, bool hugePages)
+{
+    if (hugePages) {
+        SIZE_T largePageSize = GetLargePageMinimum();
+        if (largePageSize) {
+            size_t largeSize = roundUp(size, largePageSize);
+            void* block = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (block) {
+                size = largeSize;
+                return block;
+            }
+        }
+    }
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size = roundUp(size, info.dwPageSize);
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void PageAllocator::release(void* block, size_t)
+{
+    if (block) {
+        VirtualFree(block, 0, MEM_RELEASE);
+    }
+}
+
+size_t PageAllocator::hugePageSize()
+{
+    return GetLargePageMinimum();
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+void* PageAllocator::allocate(size_t& size, bool hugePages)
+{
+#if defined(MAP_ANONYMOUS)
+    const int anonymous = MAP_ANONYMOUS;
+#else
+    const int anonymous = MAP_ANON;
+#endif
+
+    if (hugePages) {
+        size_t hugeSize = roundUp(size, HugePageSize);
+
+#if defined(MAP_HUGETLB)
+        // Explicit huge pages, only works if the administrator has reserved some (vm.nr_hugepages)
+        void* block = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | anonymous | MAP_HUGETLB, -1, 0);
+        if (block != MAP_FAILED) {
+            size = hugeSize;
+            return block;
+        }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+        // Transparent huge pages, over-allocate by one huge page so the block can be aligned to a huge page boundary
+        size_t mappedSize = hugeSize + HugePageSize;
+        char* mapped = static_cast<char*>(mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | anonymous, -1, 0));
+        if (mapped != MAP_FAILED) {
+            char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(mapped), HugePageSize));
+            if (aligned > mapped) {
+                munmap(mapped, aligned - mapped);
+            }
+            size_t tail = (mapped + mappedSize) - (aligned + hugeSize);
+            if (tail) {
+                munmap(aligned + hugeSize, tail);
+            }
+            madvise(aligned, hugeSize, MADV_HUGEPAGE);
+            size = hugeSize;
+            return aligned;
+        }
+#endif
+    }
+
+    size = roundUp(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    void* block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | anonymous, -1, 0);
+    return block == MAP_FAILED ? nullptr : block;
+}
+
+void PageAllocator::release(void* block, size_t size)
+{
+    if (block) {
+        munmap(block, size);
+    }
+}
+
+size_t PageAllocator::hugePageSize()
+{
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+    return HugePageSize;
+#else
+    return 0;
+#endif
+}
+
+#else
+
+void* PageAllocator::allocate(size_t& size, bool)
+{
+    return calloc(1, size);
+}
+
+void PageAllocator::release(void* block, size_t)
+{
+    free(block);
+}
+
+size_t PageAllocator::hugePageSize()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PAGEALLOCATOR_H
+#define PAGEALLOCATOR_H
+
+#include <cstddef>
+
+/**
+ * @class   PageAllocator
+ *
+ * @brief   Allocates large blocks of memory directly from the operating system.
+ *
+ * @details Blocks are page aligned and zero filled, and are returned to the operating system as soon as they are
+ *          released rather than being kept by the C runtime heap. Optionally, blocks can be backed by 2 MB huge pages
+ *          to reduce TLB misses. On Linux this tries explicit huge pages (MAP_HUGETLB) first, then falls back to
+ *          transparent huge pages (MADV_HUGEPAGE). On Windows it tries large pages (MEM_LARGE_PAGES), which needs
+ *          the "Lock pages in memory" privilege, and otherwise falls back to normal pages.
+ */
+class PageAllocator {
+public:
+    /**
+     * @brief   Allocate a block of memory.
+     *
+     * @details The size is rounded up to a multiple of the page size (or the huge page size), and the rounded size
+     *          is written back so it can be passed to release.
+     *
+     * @param   size The minimum number of bytes to allocate, updated with the number of bytes actually allocated.
+     * @param   hugePages Whether to try and back the block with huge pages.
+     *
+     * @return  A pointer to the block, or nullptr if the allocation failed.
+     */
+    static void* allocate(size_t& size, bool hugePages = false);
+
+    /**
+     * @brief   Release a block of memory returned by allocate.
+     *
+     * @param   block The block to release.
+     * @param   size The size written back by allocate.
+     */
+    static void release(void* block, size_t size);
+
+    /**
+     * @brief   Get the size of a huge page on this platform.
+     *
+     * @return  The huge page size in bytes, or 0 if huge pages aren't supported.
+     */
+    static size_t hugePageSize();
+};
+
+#endif // PAGEALLOCATOR_H
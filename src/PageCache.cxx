@@ -0,0 +1,59 @@
+#include "PageCache.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+void PageCache::drop(int fd, qint64 offset, qint64 length)
+{
+#if defined(POSIX_FADV_DONTNEED)
+    if (fd >= 0) {
+        posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+    }
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+#endif
+}
+
+PageCache::WriteBehind::WriteBehind(int fd, qint64 window) :
+    mFd(fd),
+    mWindow(window),
+    mStarted(0),
+    mDropped(0)
+{
+}
+
+void PageCache::WriteBehind::written(qint64 end)
+{
+    if (mFd < 0 || end - mStarted < mWindow) {
+        return;
+    }
+
+#if defined(__linux__)
+    // Start writing back the new window, then wait for the one before it and drop it
+    sync_file_range(mFd, mStarted, end - mStarted, SYNC_FILE_RANGE_WRITE);
+    if (mStarted > mDropped) {
+        sync_file_range(mFd, mDropped, mStarted - mDropped, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        drop(mFd, mDropped, mStarted - mDropped);
+        mDropped = mStarted;
+    }
+#endif
+    mStarted = end;
+}
+
+void PageCache::WriteBehind::finish()
+{
+    if (mFd < 0) {
+        return;
+    }
+
+#if defined(__linux__)
+    // Dirty pages can't be dropped, so make sure everything has been written first
+    fdatasync(mFd);
+#endif
+    drop(mFd, 0, 0);
+    mStarted = mDropped = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <QtGlobal>
+
+/**
+ * @class   PageCache
+ *
+ * @brief   Helpers for keeping bulk zip jobs from filling the operating system's page cache.
+ *
+ * @details Every file read or written normally stays in the page cache afterwards, so zipping a very large tree
+ *          evicts the pages other processes on the same machine were relying on (e.g., a database's hot set). In
+ *          bulk mode (ZipOptions::bulkIo), inputs are dropped from the cache once they have been read, and the
+ *          output is written back and dropped a few megabytes behind the writer. These are only hints, on
+ *          platforms without posix_fadvise they do nothing.
+ */
+class PageCache {
+public:
+    /**
+     * @brief   Drop the cached pages of a file that has been read and won't be needed again.
+     *
+     * @param   fd The file descriptor (e.g., from QFile::handle).
+     * @param   offset The start of the range to drop.
+     * @param   length The length of the range to drop, or 0 for the rest of the file.
+     */
+    static void drop(int fd, qint64 offset = 0, qint64 length = 0);
+
+    /**
+     * @brief   Write back and drop an output file's pages behind the writer.
+     *
+     * @details Once a window's worth of data has been written, the kernel is asked to start writing it back
+     *          (sync_file_range on Linux). The window before that, which should have finished by then, is waited
+     *          for and dropped from the cache. So only about two windows of the output are cached at any time, and
+     *          the writer only blocks if the disk falls behind.
+     */
+    class WriteBehind {
+    public:
+        /**
+         * @brief   Create a write-behind tracker for a file.
+         *
+         * @param   fd The file descriptor of the output file.
+         * @param   window The size of each window in bytes.
+         */
+        explicit WriteBehind(int fd, qint64 window = DefaultWindow);
+
+        /**
+         * @brief   Tell the tracker data has been written up to an offset.
+         *
+         * @details Call after the data has been handed to the operating system (e.g., after QFile::flush).
+         *
+         * @param   end The offset just past the last byte written.
+         */
+        void written(qint64 end);
+
+        /**
+         * @brief   Write back and drop everything written so far.
+         */
+        void finish();
+
+        static const qint64 DefaultWindow = 8 * 1024 * 1024;
+
+    private:
+        int mFd;
+        qint64 mWindow;
+        qint64 mStarted;
+        qint64 mDropped;
+    };
+};
+
+#endif // PAGECACHE_H
@@ -0,0 +1,364 @@
+#include "ParallelDeflate.h"
+#include "NumaTopology.h"
+#include "PageAllocator.h"
+#include "ZipPipeline.h"
+#include <QDebug>
+#include <QThreadStorage>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+// Input is fed to the compressor in slices of this size, with a progress update and cancel check after each
+const qint64 SliceSize = MZ_ZIP_PROGRESS_CHUNK_SIZE;
+
+// Files this small are stored by miniz anyway
+const qint64 DirectSize = 3;
+
+// Tasks in flight for each worker, enough to keep the workers busy while the head entry is being written
+const int TasksPerWorker = 2;
+
+// Holes in sparse files are compressed from here instead of the mapping
+const mz_uint8 zeros[64 * 1024] = {};
+
+// One compressor per worker thread, allocated the first time the thread compresses something
+struct LocalCompressor {
+    LocalCompressor() :
+        compressor(nullptr),
+        size(0),
+        hugePages(false)
+    {
+    }
+
+    ~LocalCompressor()
+    {
+        PageAllocator::release(compressor, size);
+    }
+
+    tdefl_compressor* compressor;
+    size_t size;
+    bool hugePages;
+};
+
+QThreadStorage<LocalCompressor*> localCompressors;
+
+// Low-memory flags only need the start of the compressor, so it's reallocated when the flags need a different size
+tdefl_compressor* localCompressor(int flags, bool hugePages)
+{
+    if (!localCompressors.hasLocalData() || !localCompressors.localData()) {
+        localCompressors.setLocalData(new LocalCompressor);
+    }
+    LocalCompressor* local = localCompressors.localData();
+    const size_t size = tdefl_compressor_size(flags);
+    if (!local->compressor || local->hugePages != hugePages || local->size != size) {
+        PageAllocator::release(local->compressor, local->size);
+        local->size = size;
+        local->compressor = static_cast<tdefl_compressor*>(PageAllocator::allocate(local->size, hugePages));
+        local->hugePages = hugePages;
+    }
+    return local->compressor;
+}
+
+mz_bool appendOutput(const void* buffer, int length, void* user)
+{
+    static_cast<QByteArray*>(user)->append(static_cast<const char*>(buffer), length);
+    return MZ_TRUE;
+}
+
+// Compress part of a file as a raw deflate stream, which ends with a sync flush unless it's the end of the file
+bool deflateRange(const FileContents& contents, qint64 offset, qint64 length, bool last, int flags, bool hugePages,
+                  ZipProgress* progress, QByteArray& output, mz_uint32& crc)
+{
+    tdefl_compressor* compressor = localCompressor(flags, hugePages);
+    if (!compressor || tdefl_init(compressor, appendOutput, &output, flags) != TDEFL_STATUS_OKAY) {
+        return false;
+    }
+
+    MappedFile* mapping = contents.mapping.get();
+    const bool sparse = mapping && mapping->isSparse();
+    const mz_uint8* data = reinterpret_cast<const mz_uint8*>(contents.constData()) + offset;
+    const tdefl_flush lastFlush = last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH;
+    tdefl_status status = TDEFL_STATUS_OKAY;
+
+    qint64 done = 0;
+    while (done < length) {
+        if (progress && progress->isCanceled()) {
+            return false;
+        }
+
+        qint64 count = std::min(SliceSize, length - done);
+        qint64 zeroRun = sparse ? mapping->zeroRun(offset + done) : 0;
+        if (zeroRun) {
+            count = std::min(count, zeroRun);
+            crc = static_cast<mz_uint32>(mz_crc32_zeros(crc, static_cast<size_t>(count)));
+            for (qint64 zeroDone = 0; zeroDone < count && status == TDEFL_STATUS_OKAY;) {
+                qint64 size = std::min(count - zeroDone, static_cast<qint64>(sizeof(zeros)));
+                zeroDone += size;
+                status = tdefl_compress_buffer(compressor, zeros, static_cast<size_t>(size), (done + zeroDone == length) ? lastFlush : TDEFL_NO_FLUSH);
+            }
+        } else {
+            crc = static_cast<mz_uint32>(mz_crc32(crc, data + done, static_cast<size_t>(count)));
+            status = tdefl_compress_buffer(compressor, data + done, static_cast<size_t>(count), (done + count == length) ? lastFlush : TDEFL_NO_FLUSH);
+        }
+        done += count;
+
+        if (status != TDEFL_STATUS_OKAY && status != TDEFL_STATUS_DONE) {
+            return false;
+        }
+        if (progress) {
+            progress->addBytes(count);
+        }
+    }
+    return last ? status == TDEFL_STATUS_DONE : status == TDEFL_STATUS_OKAY;
+}
+
+}
+
+const qint64 ParallelDeflate::ChunkThreshold;
+const qint64 ParallelDeflate::ChunkSize;
+
+ParallelDeflate::ParallelDeflate(const ZipOptions& options, ZipScheduler* scheduler) :
+    mOptions(options),
+    mScheduler(scheduler ? scheduler : options.scheduler()),
+    mGroup(mScheduler->createGroup(options.priority)),
+    mShared(std::make_shared<Shared>()),
+    mInFlight(0),
+    mMaxInFlight(TasksPerWorker * mScheduler->workerCount()),
+    mQueuedBytes(0)
+{
+}
+
+ParallelDeflate::~ParallelDeflate()
+{
+    abort();
+}
+
+bool ParallelDeflate::add(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents)
+{
+    if (isCanceled()) {
+        abort();
+        return false;
+    }
+
+    Entry entry;
+    entry.archiveName = archiveName;
+    entry.contents = contents;
+    entry.direct = !mOptions.parallelCompression || (mOptions.levelAndFlags() & 0xF) == 0 || contents.size() <= DirectSize;
+    if (!entry.direct) {
+        entry.chunks = contents.size() > ChunkThreshold ? static_cast<int>((contents.size() + ChunkSize - 1) / ChunkSize) : 1;
+    }
+    mEntries.push_back(std::move(entry));
+    mQueuedBytes += contents.data.size();
+    submitChunks();
+
+    // Add what's ready, or wait for the oldest entry if there's too much in flight
+    while (!mEntries.empty()) {
+        const Entry& head = mEntries.front();
+        bool full = static_cast<int>(mEntries.size()) > mMaxInFlight || mQueuedBytes > mOptions.readAheadBytes;
+        bool ready = head.direct;
+        if (!ready && head.chunks == 1) {
+            std::lock_guard<std::mutex> lock(mShared->mutex);
+            ready = head.pieces[0]->done;
+        }
+        if (!full && !ready) {
+            break;
+        }
+        if (!writeHead(zip)) {
+            abort();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParallelDeflate::flush(mz_zip_archive* zip)
+{
+    while (!mEntries.empty()) {
+        if (!writeHead(zip)) {
+            abort();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ParallelDeflate::abort()
+{
+    mScheduler->wait(mGroup);
+    mEntries.clear();
+    mInFlight = 0;
+    mQueuedBytes = 0;
+}
+
+void ParallelDeflate::submitChunks()
+{
+    // Earlier entries first, so the one being written is never waiting behind later ones
+    const int flags = static_cast<int>(tdefl_create_comp_flags_from_zip_params(mOptions.levelAndFlags() & 0xF, -15, MZ_DEFAULT_STRATEGY))
+            | (mOptions.lowMemory ? TDEFL_LOW_MEMORY_FLAG : 0);
+    for (Entry& entry : mEntries) {
+        while (entry.submitted < entry.chunks) {
+            if (mInFlight >= mMaxInFlight) {
+                return;
+            }
+
+            // A mapped file is read as it's compressed, so each chunk waits for the read limits before it goes
+            qint64 offset = entry.submitted * ChunkSize;
+            qint64 length = entry.chunks == 1 ? entry.contents.size() : std::min(ChunkSize, entry.contents.size() - offset);
+            if (entry.contents.mapping && !mOptions.throttleRead(length)) {
+                return;
+            }
+
+            std::shared_ptr<Piece> piece = std::make_shared<Piece>();
+            entry.pieces.push_back(piece);
+            bool last = ++entry.submitted == entry.chunks;
+            mInFlight++;
+
+            FileContents contents = entry.contents;
+            std::shared_ptr<Shared> shared = mShared;
+            std::shared_ptr<ZipProgress> progress = mOptions.progress;
+            bool hugePages = mOptions.hugePages;
+            bool whole = entry.chunks == 1;
+            MemoryGovernor* governor = mOptions.governor();
+
+            // Input read into memory stays on the node the reader put it on, so compress it on that node
+            int node = -1;
+            if (mScheduler->nodeCount() > 1 && !contents.mapping) {
+                node = NumaTopology::nodeOf(contents.constData() + offset);
+            }
+            mScheduler->submit(mGroup, [=]() {
+                QByteArray output;
+                mz_uint32 crc = MZ_CRC32_INIT;
+                bool ok = deflateRange(contents, offset, length, last, flags, hugePages, progress.get(), output, crc);
+
+                // A whole file is only read by this task, so its pages can go now rather than once it's written
+                if (whole && contents.mapping) {
+                    contents.mapping->release(length);
+                }
+
+                MemoryGovernor::LeasePtr lease = governor->charge(output.size());
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                piece->data.swap(output);
+                piece->lease = std::move(lease);
+                piece->crc = crc;
+                piece->ok = ok;
+                piece->done = true;
+                shared->condition.notify_all();
+            }, length, node);
+        }
+    }
+}
+
+bool ParallelDeflate::writeHead(mz_zip_archive* zip)
+{
+    Entry& entry = mEntries.front();
+    const QString& archiveName = entry.archiveName;
+    bool ok;
+    if (entry.direct) {
+        ok = ZipPipeline::addContents(zip, archiveName, entry.contents, mOptions);
+    } else if (entry.chunks == 1) {
+        // Never submitted if the job was cancelled while waiting for the read limits
+        Piece* piece = entry.submitted ? entry.pieces[0].get() : nullptr;
+        ok = piece && waitFor(*piece);
+        mInFlight -= entry.submitted;
+        ok = ok && mz_zip_writer_add_mem_ex_v2(zip, archiveName.toUtf8().constData(), piece->data.constData(), static_cast<size_t>(piece->data.size()), nullptr, 0,
+                                               mOptions.levelAndFlags() | MZ_ZIP_FLAG_COMPRESSED_DATA, static_cast<mz_uint64>(entry.contents.size()), piece->crc,
+                                               nullptr, nullptr, 0, nullptr, 0);
+        if (ok && mOptions.progress) {
+            mOptions.progress->addEntry();
+        }
+    } else {
+        ok = addChunked(zip, entry);
+    }
+
+    if (!ok && !isCanceled()) {
+        qWarning() << "Failed to add file" << archiveName << "to zip archive";
+    }
+    mQueuedBytes -= entry.contents.data.size();
+    mEntries.pop_front();
+    if (ok) {
+        submitChunks();
+    }
+    return ok;
+}
+
+bool ParallelDeflate::addChunked(mz_zip_archive* zip, Entry& entry)
+{
+    // Bigger than the deflate output can possibly be, which also covers the uncompressed size
+    mz_uint64 size = static_cast<mz_uint64>(entry.contents.size());
+    mz_uint64 maxSize = size + size / 1024 + 1024;
+
+    Stream stream = {this, &entry, 0, 0, 0, MZ_CRC32_INIT};
+    MZ_TIME_T now = time(nullptr);
+    bool ok = mz_zip_writer_add_compressed_read_buf_callback(zip, entry.archiveName.toUtf8().constData(), readChunks, &stream, maxSize, &now,
+                                                              mOptions.levelAndFlags(), &stream.uncompSize, &stream.crc);
+
+    // Don't count chunks the stream didn't get to as in flight any more
+    mInFlight -= entry.submitted - stream.chunk;
+    ok = ok && stream.chunk == entry.chunks;
+    if (ok && mOptions.progress) {
+        mOptions.progress->addEntry();
+    }
+    return ok;
+}
+
+bool ParallelDeflate::waitFor(Piece& piece)
+{
+    std::unique_lock<std::mutex> lock(mShared->mutex);
+    mShared->condition.wait(lock, [&piece] { return piece.done; });
+    return piece.ok;
+}
+
+void ParallelDeflate::finishChunk(Stream& stream)
+{
+    Entry& entry = *stream.entry;
+    Piece& piece = *entry.pieces[stream.chunk];
+    qint64 length = std::min(ChunkSize, entry.contents.size() - stream.chunk * ChunkSize);
+
+    // crc(A + B) from crc(A) and crc(B), using the CRC of the same number of zeros to cancel out B's initial value
+    stream.crc = static_cast<mz_uint32>(mz_crc32_zeros(stream.crc, static_cast<size_t>(length)) ^ piece.crc ^ mz_crc32_zeros(MZ_CRC32_INIT, static_cast<size_t>(length)));
+    stream.uncompSize += static_cast<mz_uint64>(length);
+    if (entry.contents.mapping) {
+        entry.contents.mapping->release(stream.uncompSize);
+    }
+
+    // Free the chunk's output and start the next one
+    entry.pieces[stream.chunk].reset();
+    stream.chunk++;
+    stream.offset = 0;
+    mInFlight--;
+    submitChunks();
+}
+
+bool ParallelDeflate::isCanceled() const
+{
+    return mOptions.progress && mOptions.progress->isCanceled();
+}
+
+size_t ParallelDeflate::readChunks(void* opaque, mz_uint64, void* buffer, size_t size)
+{
+    Stream& stream = *static_cast<Stream*>(opaque);
+    Entry& entry = *stream.entry;
+    while (stream.chunk < entry.chunks) {
+        if (stream.chunk >= static_cast<int>(entry.pieces.size())) {
+            return size + 1;
+        }
+        Piece& piece = *entry.pieces[stream.chunk];
+        if (!stream.self->waitFor(piece)) {
+            // Returning more than was asked for makes miniz fail the entry, where 0 would end it early
+            return size + 1;
+        }
+
+        size_t count = std::min(size, static_cast<size_t>(piece.data.size() - stream.offset));
+        if (count) {
+            memcpy(buffer, piece.data.constData() + stream.offset, count);
+            stream.offset += static_cast<int>(count);
+            if (stream.offset == piece.data.size()) {
+                stream.self->finishChunk(stream);
+            }
+            return count;
+        }
+        stream.self->finishChunk(stream);
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef PARALLELDEFLATE_H
+#define PARALLELDEFLATE_H
+
+#include <QByteArray>
+#include <QString>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BatchFileReader.h"
+#include "ZipOptions.h"
+#include "ZipScheduler.h"
+#include "miniz.h"
+
+/**
+ * @class   ParallelDeflate
+ *
+ * @brief   Compresses entries on the ZipScheduler and adds them to an archive in order.
+ *
+ * @details Each entry is compressed into memory by a scheduler task while the calling thread adds the entries that
+ *          have finished, so a folder of files is compressed on every core. Files over ChunkThreshold are split into
+ *          chunks that are compressed in parallel as well, pigz style: each chunk is a separate deflate stream ending
+ *          on a byte boundary (a sync flush), so the pieces can be joined, and their CRC-32s are combined with
+ *          mz_crc32_zeros. Each chunk starts with an empty dictionary, which makes big files slightly bigger. The
+ *          chunks are streamed into the archive as they finish (mz_zip_writer_add_compressed_read_buf_callback), so
+ *          only the chunks in flight are held in memory.
+ *
+ *          The number of tasks in flight is limited to a couple per worker, and the input read into memory to
+ *          ZipOptions::readAheadBytes. The compressed chunks are charged to the job's MemoryGovernor until they
+ *          have been written, and the chunks of a memory-mapped file, which is read as it's compressed, wait for the
+ *          job's read limits before they're submitted. On a NUMA machine each task of input read into memory is
+ *          tagged with the node the memory is on, so a worker on that node compresses it. Stored entries (level 0)
+ *          and tiny files are added on the calling thread. If ZipOptions::parallelCompression is false, every entry
+ *          is added on the calling thread as it arrives.
+ *
+ *          Single-chunk entries compress to exactly the same bytes as mz_zip_writer_add_mem.
+ */
+class ParallelDeflate {
+public:
+    /**
+     * @brief   Files bigger than this are split into chunks.
+     */
+    static const qint64 ChunkThreshold = 8 * 1024 * 1024;
+
+    /**
+     * @brief   The size of the chunks big files are split into.
+     */
+    static const qint64 ChunkSize = 4 * 1024 * 1024;
+
+    /**
+     * @brief   Create a compressor with its own scheduler group.
+     *
+     * @param   options The job's options, including its level, progress and scheduler priority.
+     * @param   scheduler The scheduler to use, or null for the one the options pick (see ZipOptions::scheduler).
+     */
+    explicit ParallelDeflate(const ZipOptions& options, ZipScheduler* scheduler = nullptr);
+    ~ParallelDeflate();
+
+    ParallelDeflate(const ParallelDeflate&) = delete;
+    ParallelDeflate& operator=(const ParallelDeflate&) = delete;
+
+    /**
+     * @brief   Queue an entry, adding any earlier entries that are ready.
+     *
+     * @details Blocks while too much is in flight.
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     * @param   archiveName The name of the file inside the archive.
+     * @param   contents The contents of the file.
+     *
+     * @return  False if this or an earlier entry couldn't be added, or the job was cancelled.
+     */
+    bool add(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents);
+
+    /**
+     * @brief   Add all of the queued entries to the archive.
+     *
+     * @return  True if they were all added, false otherwise.
+     */
+    bool flush(mz_zip_archive* zip);
+
+    /**
+     * @brief   Drop the queued entries, waiting for any of their tasks that are running.
+     */
+    void abort();
+
+private:
+    // One chunk's compressed data, filled in by a task
+    struct Piece {
+        QByteArray data;
+        MemoryGovernor::LeasePtr lease;
+        mz_uint32 crc = MZ_CRC32_INIT;
+        bool done = false;
+        bool ok = false;
+    };
+
+    struct Entry {
+        QString archiveName;
+        FileContents contents;
+        bool direct = false;
+        int chunks = 0;
+        int submitted = 0;
+        std::vector<std::shared_ptr<Piece>> pieces;
+    };
+
+    // Where the read callback has got to in the entry being streamed
+    struct Stream {
+        ParallelDeflate* self;
+        Entry* entry;
+        int chunk;
+        int offset;
+        mz_uint64 uncompSize;
+        mz_uint32 crc;
+    };
+
+    // Lets the calling thread wait for the tasks, shared with them so it outlives a cancelled job
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    void submitChunks();
+    bool writeHead(mz_zip_archive* zip);
+    bool addChunked(mz_zip_archive* zip, Entry& entry);
+    bool waitFor(Piece& piece);
+    void finishChunk(Stream& stream);
+    bool isCanceled() const;
+    static size_t readChunks(void* opaque, mz_uint64 offset, void* buffer, size_t size);
+
+    ZipOptions mOptions;
+    ZipScheduler* mScheduler;
+    ZipScheduler::GroupPtr mGroup;
+    std::shared_ptr<Shared> mShared;
+    std::deque<Entry> mEntries;
+    int mInFlight;
+    int mMaxInFlight;
+    qint64 mQueuedBytes;
+};
+
+#endif // PARALLELDEFLATE_H
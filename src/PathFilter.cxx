@@ -0,0 +1,293 @@
+#include "PathFilter.h"
+#include <QFile>
+#include <cstring>
+
+namespace {
+
+bool hasWildcards(const char* begin, const char* end)
+{
+    for (const char* p = begin; p != end; p++) {
+        if (*p == '*' || *p == '?' || *p == '[' || *p == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Match a '[...]' class at p against c, setting p to just past the ']'. Returns -1 if the class isn't terminated
+int matchClass(const char*& p, const char* end, char c)
+{
+    const char* q = p + 1;
+    bool negated = q != end && (*q == '!' || *q == '^');
+    if (negated) {
+        q++;
+    }
+    bool matched = false;
+    bool first = true;
+    while (q != end && (*q != ']' || first)) {
+        first = false;
+        char low = *q;
+        if (low == '\\' && q + 1 != end) {
+            low = *++q;
+        }
+        char high = low;
+        if (q + 2 < end && q[1] == '-' && q[2] != ']') {
+            q += 2;
+            high = *q;
+            if (high == '\\' && q + 1 != end) {
+                high = *++q;
+            }
+        }
+        if (static_cast<unsigned char>(c) >= static_cast<unsigned char>(low) && static_cast<unsigned char>(c) <= static_cast<unsigned char>(high)) {
+            matched = true;
+        }
+        q++;
+    }
+    if (q == end) {
+        return -1;
+    }
+    p = q + 1;
+    return matched != negated ? 1 : 0;
+}
+
+bool globMatch(const char* p, const char* pe, const char* t, const char* te)
+{
+    while (p != pe) {
+        char c = *p;
+        if (c == '*') {
+            if (p + 1 != pe && p[1] == '*') {
+                p += 2;
+                if (p != pe && *p == '/') {
+                    // "**/" matches zero or more whole folders
+                    p++;
+                    for (const char* s = t;;) {
+                        if (globMatch(p, pe, s, te)) {
+                            return true;
+                        }
+                        s = static_cast<const char*>(std::memchr(s, '/', te - s));
+                        if (!s) {
+                            return false;
+                        }
+                        s++;
+                    }
+                }
+
+                // Anything else with "**" matches across folders
+                for (const char* s = t; s <= te; s++) {
+                    if (globMatch(p, pe, s, te)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // A single '*' stops at the end of the segment
+            p++;
+            for (const char* s = t;; s++) {
+                if (globMatch(p, pe, s, te)) {
+                    return true;
+                }
+                if (s == te || *s == '/') {
+                    return false;
+                }
+            }
+        }
+
+        if (t == te) {
+            return false;
+        }
+        if (c == '?') {
+            if (*t == '/') {
+                return false;
+            }
+            p++;
+        } else if (c == '[' && *t != '/') {
+            int result = matchClass(p, pe, *t);
+            if (result == 0) {
+                return false;
+            } else if (result < 0) {
+                // An unterminated class is just a '['
+                if (*t != '[') {
+                    return false;
+                }
+                p++;
+            }
+        } else {
+            if (c == '\\' && p + 1 != pe) {
+                c = *++p;
+            }
+            if (c != *t) {
+                return false;
+            }
+            p++;
+        }
+        t++;
+    }
+    return t == te;
+}
+
+}
+
+void PathFilter::Rules::add(const QByteArray& line)
+{
+    const char* begin = line.constData();
+    const char* end = begin + line.size();
+
+    // Trailing spaces are ignored unless escaped
+    while (end != begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r') && !(end - begin >= 2 && end[-2] == '\\')) {
+        end--;
+    }
+    if (begin == end || *begin == '#') {
+        return;
+    }
+
+    Pattern pattern;
+    pattern.negated = *begin == '!';
+    if (pattern.negated) {
+        begin++;
+    } else if (*begin == '\\' && end - begin >= 2 && (begin[1] == '!' || begin[1] == '#')) {
+        begin++;
+    }
+    pattern.directoryOnly = end != begin && end[-1] == '/';
+    if (pattern.directoryOnly) {
+        end--;
+    }
+    if (end - begin >= 3 && std::memcmp(begin, "**/", 3) == 0 && !std::memchr(begin + 3, '/', end - begin - 3)) {
+        // "**/name" is the same as "name"
+        begin += 3;
+    }
+    pattern.anchored = begin != end && std::memchr(begin, '/', end - begin);
+    if (pattern.anchored && *begin == '/') {
+        begin++;
+    }
+    if (begin == end) {
+        return;
+    }
+
+    // Sort out the patterns that don't need the general matcher
+    if (!hasWildcards(begin, end)) {
+        pattern.kind = Pattern::Literal;
+    } else if (!pattern.anchored && *begin == '*' && !hasWildcards(begin + 1, end)) {
+        pattern.kind = Pattern::Suffix;
+        begin++;
+    } else if (!pattern.anchored && end[-1] == '*' && !hasWildcards(begin, end - 1)) {
+        pattern.kind = Pattern::Prefix;
+        end--;
+    } else {
+        pattern.kind = Pattern::Glob;
+    }
+    pattern.text = QByteArray(begin, static_cast<int>(end - begin));
+    mPatterns.push_back(pattern);
+}
+
+void PathFilter::Rules::addLines(const QByteArray& lines)
+{
+    for (const QByteArray& line : lines.split('\n')) {
+        add(line);
+    }
+}
+
+int PathFilter::Rules::match(const QByteArray& path, int nameOffset, bool isDir) const
+{
+    const char* pathBegin = path.constData();
+    const char* pathEnd = pathBegin + path.size();
+    const char* name = pathBegin + nameOffset;
+    size_t nameLength = pathEnd - name;
+
+    // The last matching rule wins
+    for (auto it = mPatterns.rbegin(); it != mPatterns.rend(); ++it) {
+        const Pattern& pattern = *it;
+        if (pattern.directoryOnly && !isDir) {
+            continue;
+        }
+        const char* text = pattern.text.constData();
+        size_t length = pattern.text.size();
+        bool matched;
+        switch (pattern.kind) {
+        case Pattern::Literal:
+            matched = pattern.anchored ? path == pattern.text : nameLength == length && std::memcmp(name, text, length) == 0;
+            break;
+        case Pattern::Suffix:
+            matched = nameLength >= length && std::memcmp(name + nameLength - length, text, length) == 0;
+            break;
+        case Pattern::Prefix:
+            matched = nameLength >= length && std::memcmp(name, text, length) == 0;
+            break;
+        default:
+            matched = pattern.anchored ? ::globMatch(text, text + length, pathBegin, pathEnd) : ::globMatch(text, text + length, name, pathEnd);
+            break;
+        }
+        if (matched) {
+            return pattern.negated ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+PathFilter::PathFilter(const QStringList& excludePatterns, const QStringList& includePatterns, const QString& ignoreFileName) :
+    mIgnoreFileName(ignoreFileName)
+{
+    for (const auto& pattern : excludePatterns) {
+        mExcludes.add(pattern.toUtf8());
+    }
+    for (const auto& pattern : includePatterns) {
+        mIncludes.add(pattern.toUtf8());
+    }
+}
+
+bool PathFilter::isEmpty() const
+{
+    return mExcludes.isEmpty() && mIncludes.isEmpty() && mIgnoreFileName.isEmpty();
+}
+
+std::shared_ptr<const PathFilter::Scope> PathFilter::rootScope() const
+{
+    if (mExcludes.isEmpty()) {
+        return nullptr;
+    }
+    std::shared_ptr<Scope> scope = std::make_shared<Scope>();
+    scope->rules = mExcludes;
+    return scope;
+}
+
+std::shared_ptr<const PathFilter::Scope> PathFilter::enter(const std::shared_ptr<const Scope>& parent, const QString& folder, const QByteArray& relativePath) const
+{
+    if (mIgnoreFileName.isEmpty()) {
+        return parent;
+    }
+
+    // Most folders won't have one, so the failed open is the only cost
+    QFile file(folder + "/" + mIgnoreFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return parent;
+    }
+    std::shared_ptr<Scope> scope = std::make_shared<Scope>();
+    scope->rules.addLines(file.readAll());
+    if (scope->rules.isEmpty()) {
+        return parent;
+    }
+    scope->baseLength = relativePath.size();
+    scope->parent = parent;
+    return scope;
+}
+
+bool PathFilter::keep(const Scope* scope, const QByteArray& relativePath, int nameOffset, bool isDir) const
+{
+    // The closest ignore file with a matching rule decides
+    for (; scope; scope = scope->parent.get()) {
+        int result = scope->baseLength ?
+            scope->rules.match(QByteArray::fromRawData(relativePath.constData() + scope->baseLength, relativePath.size() - scope->baseLength), nameOffset - scope->baseLength, isDir) :
+            scope->rules.match(relativePath, nameOffset, isDir);
+        if (result > 0) {
+            return false;
+        } else if (result < 0) {
+            break;
+        }
+    }
+    return isDir || mIncludes.isEmpty() || mIncludes.match(relativePath, nameOffset, false) > 0;
+}
+
+bool PathFilter::globMatch(const QByteArray& pattern, const QByteArray& text)
+{
+    return ::globMatch(pattern.constData(), pattern.constData() + pattern.size(), text.constData(), text.constData() + text.size());
+}
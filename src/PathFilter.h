@@ -0,0 +1,145 @@
+#ifndef PATHFILTER_H
+#define PATHFILTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+/**
+ * @class   PathFilter
+ *
+ * @brief   Include and exclude rules for the files found while walking a folder.
+ *
+ * @details Exclude rules use .gitignore syntax: '*' and '?' match within a path segment, '**' matches across them,
+ *          '[...]' matches a character class, a leading '!' re-includes, a trailing '/' only matches folders, and a
+ *          pattern containing a '/' is matched against the path relative to the folder it applies to (otherwise just
+ *          against the name, at any depth). Later rules win over earlier ones. If an ignore file name is set (e.g.,
+ *          ".gitignore"), that file is read from each folder as it is walked, and its rules apply to that folder and
+ *          below, taking precedence over the rules from further up. Include rules use the same syntax, and if there
+ *          are any, only files matching one of them are kept. Folders are never dropped by include rules.
+ *
+ *          The rules are compiled once: patterns that are plain names, "*.ext" suffixes or "name*" prefixes are
+ *          matched with a single comparison, and only the rest go through the general glob matcher. The
+ *          DirectoryWalker applies the filter to each name as the folder is listed, so excluded folders are never
+ *          opened, and excluded names are never stat'ed.
+ */
+class PathFilter {
+public:
+    /**
+     * @brief   A compiled list of rules, from the filter itself or from one ignore file.
+     */
+    class Rules {
+    public:
+        /**
+         * @brief   Add a rule.
+         *
+         * @param   pattern The pattern, blank lines and lines starting with '#' are ignored.
+         */
+        void add(const QByteArray& pattern);
+
+        /**
+         * @brief   Add one rule per line of an ignore file.
+         */
+        void addLines(const QByteArray& lines);
+
+        /**
+         * @brief   Check a path against the rules.
+         *
+         * @param   path The path relative to the folder the rules apply to, using forward slashes.
+         * @param   nameOffset The offset of the last segment (the name) in the path.
+         * @param   isDir Whether the path is a folder.
+         *
+         * @return  1 if the last matching rule excludes the path, -1 if it re-includes it, 0 if no rule matches.
+         */
+        int match(const QByteArray& path, int nameOffset, bool isDir) const;
+
+        bool isEmpty() const { return mPatterns.empty(); }
+
+    private:
+        struct Pattern {
+            enum Kind { Literal, Suffix, Prefix, Glob };
+            Kind kind;
+            QByteArray text;
+            bool negated;
+            bool directoryOnly;
+            bool anchored;
+        };
+
+        std::vector<Pattern> mPatterns;
+    };
+
+    /**
+     * @brief   The rules in effect in one folder: its own ignore file (if any) and those of the folders above.
+     */
+    struct Scope {
+        Rules rules;
+        int baseLength = 0;
+        std::shared_ptr<const Scope> parent;
+    };
+
+    PathFilter() = default;
+
+    /**
+     * @brief   Create a filter.
+     *
+     * @param   excludePatterns The exclude rules.
+     * @param   includePatterns The include rules, or empty to keep every file that isn't excluded.
+     * @param   ignoreFileName The name of the ignore file to read from each folder, or empty for none.
+     */
+    PathFilter(const QStringList& excludePatterns, const QStringList& includePatterns, const QString& ignoreFileName);
+
+    /**
+     * @brief   Check whether the filter has no rules at all, so every file is kept.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief   Get the scope above the top folder being walked, holding the filter's own exclude rules.
+     *
+     * @return  The scope, or null if there are no exclude rules.
+     */
+    std::shared_ptr<const Scope> rootScope() const;
+
+    /**
+     * @brief   Get the scope for a folder, reading its ignore file if there is one.
+     *
+     * @param   parent The scope of the folder above (or the root scope for the top folder).
+     * @param   folder The path of the folder on disk.
+     * @param   relativePath The path of the folder relative to the top folder, with a trailing '/' (empty for the top
+     *          folder).
+     *
+     * @return  The new scope, or the parent scope if the folder has no ignore file.
+     */
+    std::shared_ptr<const Scope> enter(const std::shared_ptr<const Scope>& parent, const QString& folder, const QByteArray& relativePath) const;
+
+    /**
+     * @brief   Check whether a file or folder should be kept.
+     *
+     * @param   scope The scope of the folder containing it.
+     * @param   relativePath The path relative to the top folder, using forward slashes.
+     * @param   nameOffset The offset of the name in the path.
+     * @param   isDir Whether it is a folder.
+     *
+     * @return  True to keep it (or descend into it), false to leave it out.
+     */
+    bool keep(const Scope* scope, const QByteArray& relativePath, int nameOffset, bool isDir) const;
+
+    /**
+     * @brief   Match a glob pattern against a string.
+     *
+     * @param   pattern The pattern, without any of the .gitignore prefixes and suffixes.
+     * @param   text The string to match.
+     *
+     * @return  True if the whole string matches.
+     */
+    static bool globMatch(const QByteArray& pattern, const QByteArray& text);
+
+private:
+    Rules mExcludes;
+    Rules mIncludes;
+    QString mIgnoreFileName;
+};
+
+#endif // PATHFILTER_H
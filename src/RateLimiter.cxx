@@ -0,0 +1,89 @@
+#include "RateLimiter.h"
+#include "ZipProgress.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// How much the bucket holds, in seconds at the current rate
+const double BurstSeconds = 0.25;
+
+// Long sleeps are split up, so a cancelled job doesn't sleep through it
+const std::chrono::milliseconds MaxSleep(50);
+
+}
+
+RateLimiter::RateLimiter(qint64 bytesPerSecond) :
+    mRate(std::max<qint64>(bytesPerSecond, 0)),
+    mTokens(static_cast<double>(mRate) * BurstSeconds),
+    mLastRefill(Clock::now()),
+    mThrottledNanoseconds(0)
+{
+}
+
+RateLimiter* RateLimiter::reads()
+{
+    static RateLimiter limiter;
+    return &limiter;
+}
+
+RateLimiter* RateLimiter::writes()
+{
+    static RateLimiter limiter;
+    return &limiter;
+}
+
+void RateLimiter::setRate(qint64 bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRate = std::max<qint64>(bytesPerSecond, 0);
+    mTokens = static_cast<double>(mRate) * BurstSeconds;
+    mLastRefill = Clock::now();
+}
+
+qint64 RateLimiter::rate() const
+{
+    return mRate;
+}
+
+bool RateLimiter::acquire(qint64 bytes, const ZipProgress* progress)
+{
+    if (mRate == 0 || bytes <= 0) {
+        return true;
+    }
+
+    // Overdraw the bucket and sleep off the debt, so callers queue up in the order they arrived
+    Clock::time_point until;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        double rate = static_cast<double>(mRate);
+        if (rate == 0) {
+            return true;
+        }
+        Clock::time_point now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - mLastRefill).count();
+        mTokens = std::min(mTokens + elapsed * rate, rate * BurstSeconds) - static_cast<double>(bytes);
+        mLastRefill = now;
+        if (mTokens >= 0) {
+            return true;
+        }
+        until = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-mTokens / rate));
+    }
+
+    Clock::time_point start = Clock::now();
+    bool canceled = false;
+    for (Clock::time_point now = start; now < until; now = Clock::now()) {
+        if (progress && progress->isCanceled()) {
+            canceled = true;
+            break;
+        }
+        std::this_thread::sleep_for(std::min<Clock::duration>(until - now, MaxSleep));
+    }
+    mThrottledNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    return !canceled;
+}
+
+qint64 RateLimiter::throttledNanoseconds() const
+{
+    return mThrottledNanoseconds;
+}
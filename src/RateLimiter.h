@@ -0,0 +1,84 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+class ZipProgress;
+
+/**
+ * @class   RateLimiter
+ *
+ * @brief   A token bucket that limits how many bytes per second go through it, shared by any number of threads.
+ *
+ * @details Background jobs on a shared machine shouldn't use all of the disk. Each job can have its own read and
+ *          write limiters (ZipOptions::readLimit and writeLimit), and jobs that share a limiter share its rate, so
+ *          one limiter can be used for a whole type of job. Every job also goes through the process-wide reads()
+ *          and writes() limiters. They're all unlimited until setRate is called.
+ *
+ *          The bucket holds a quarter of a second's worth of bytes, so that much can go at full speed after an idle
+ *          spell. A request bigger than what's left still goes through, and the caller sleeps for the time it
+ *          overdrew by, so big files and small writes average out to the same rate.
+ */
+class RateLimiter {
+public:
+    /**
+     * @brief   Create a limiter.
+     *
+     * @param   bytesPerSecond The rate, or 0 for unlimited.
+     */
+    explicit RateLimiter(qint64 bytesPerSecond = 0);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    /**
+     * @brief   Get the process-wide limiter on bytes read by zip and unzip jobs.
+     */
+    static RateLimiter* reads();
+
+    /**
+     * @brief   Get the process-wide limiter on bytes written by zip and unzip jobs.
+     */
+    static RateLimiter* writes();
+
+    /**
+     * @brief   Change the rate.
+     *
+     * @param   bytesPerSecond The rate, or 0 for unlimited.
+     */
+    void setRate(qint64 bytesPerSecond);
+
+    /**
+     * @brief   Get the rate in bytes per second, 0 for unlimited.
+     */
+    qint64 rate() const;
+
+    /**
+     * @brief   Take bytes from the bucket, sleeping until the rate allows them.
+     *
+     * @param   bytes The number of bytes about to be (or just) read or written.
+     * @param   progress The job's progress, so a cancelled job stops sleeping, or null.
+     *
+     * @return  False if the job was cancelled while sleeping, true otherwise.
+     */
+    bool acquire(qint64 bytes, const ZipProgress* progress = nullptr);
+
+    /**
+     * @brief   Get the total time callers have spent sleeping in acquire.
+     */
+    qint64 throttledNanoseconds() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    mutable std::mutex mMutex;
+    std::atomic<qint64> mRate;
+    double mTokens;
+    Clock::time_point mLastRefill;
+    std::atomic<qint64> mThrottledNanoseconds;
+};
+
+#endif // RATELIMITER_H
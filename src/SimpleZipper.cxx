@@ -1,20 +1,50 @@
 #include "SimpleZipper.h"
+#include "ZipReader.h"
+#include "ZipLog.h"
+#include "ZipWriter.h"
 #include <QFile>
-#include <QIODevice>
+#include <QFileInfo>
 #include <QDir>
 #include <QDebug>
-#include <QDirIterator>
 
-bool SimpleZipper::unzipFile(const QString& zipFilename)
+namespace {
+
+// The default outputs sit next to the input with the same name
+QString defaultOutputFolder(const QString& zipFilename)
 {
     QFileInfo fileInfo(zipFilename);
-    QString outputFolder = fileInfo.absolutePath() + QString("/") + fileInfo.baseName();
-    return unzipFile(zipFilename, outputFolder);
+    return fileInfo.absolutePath() + QString("/") + fileInfo.baseName();
+}
+
+QString defaultZipFilenameForFile(const QString& filename)
+{
+    QFileInfo fileInfo(filename);
+    return fileInfo.absoluteDir().path() + "/" + fileInfo.baseName() + ".zip";
+}
+
+QString defaultZipFilenameForFolder(const QString& folder)
+{
+    QDir dir(folder);
+    QString zipFilename = dir.dirName() + ".zip";
+    dir.cdUp();
+    return dir.absolutePath() + "/" + zipFilename;
+}
+
+}
+
+bool SimpleZipper::unzipFile(const QString& zipFilename)
+{
+    return unzipFile(zipFilename, defaultOutputFolder(zipFilename));
 }
 
 bool SimpleZipper::unzipFile(const QString& zipFilename, const QString& outputFolder)
 {
-    qDebug() << "Unzipping file" << zipFilename << "to" << outputFolder;
+    return unzipFile(zipFilename, outputFolder, ZipOptions());
+}
+
+bool SimpleZipper::unzipFile(const QString& zipFilename, const QString& outputFolder, const ZipOptions& options)
+{
+    ZIP_LOG(ZipLog::DebugLevel) << "Unzipping file" << zipFilename << "to" << outputFolder;
 
     // Create output folder if it doesn't exist
     QDir dir(outputFolder);
@@ -22,165 +52,182 @@ bool SimpleZipper::unzipFile(const QString& zipFilename, const QString& outputFo
         dir.mkpath(".");
     }
 
-    // Open the zip file
-    mz_zip_archive zip;
-    memset(&zip, 0, sizeof(zip));
-    mz_bool result = mz_zip_reader_init_file(&zip, zipFilename.toUtf8().constData(), 0);
-    if (!result) {
-        qWarning() << "Failed to open zip file" << zipFilename;
+    // Open the zip file and extract each file in it
+    ZipReader reader(options);
+    if (!reader.open(zipFilename) || !reader.extractAll(outputFolder)) {
         return false;
     }
 
-    // Extract each file in the zip archive
-    mz_uint numFiles = mz_zip_reader_get_num_files(&zip);
-    qDebug() << "Zip file contains" << numFiles << "files";
-    for (uint i = 0; i < numFiles; i++) {
-        mz_zip_archive_file_stat file_stat;
-        if (!mz_zip_reader_file_stat(&zip, i, &file_stat)) {
-            qWarning() << "Failed to get file info for file" << i << "in zip file" << zipFilename;
-            mz_zip_reader_end(&zip);
-            return false;
-        }
-
-        QString filename = QString::fromUtf8(file_stat.m_filename);
-        QString outFile = outputFolder + "/" + filename;
-        qDebug() << "Extracting" << filename;
-
-        if (!QDir().mkpath(QFileInfo(outFile).path())) {
-            qWarning() << "Failed to create directory for file" << outFile;
-            mz_zip_reader_end(&zip);
-            return false;
-        }
-
-        if (!mz_zip_reader_extract_to_file(&zip, i, outFile.toUtf8().constData(), 0)) {
-            qWarning() << "Failed to extract file" << filename << "from zip file" << zipFilename;
-            mz_zip_reader_end(&zip);
-            return false;
-        }
-    }
-
     // Clean up
-    mz_zip_reader_end(&zip);
-    qDebug() << "Unzip complete";
+    reader.close();
+    ZIP_LOG(ZipLog::DebugLevel) << "Unzip complete, peak memory" << reader.peakMemory() << "bytes";
     return true;
 }
 
 bool SimpleZipper::zipFile(const QString& filename)
 {
-    QFileInfo fileInfo(filename);
-    QString zipFilename = fileInfo.absoluteDir().path() + "/" + fileInfo.baseName() + ".zip";
-    return zipFile(filename, zipFilename);
+    return zipFile(filename, defaultZipFilenameForFile(filename));
 }
 
 bool SimpleZipper::zipFile(const QString& filename, const QString& zipFilename)
 {
-    // Determine the output zip file name and path
-    QFileInfo fileInfo(filename);
-    qDebug() << "Zipping file" << filename << "to" << zipFilename;
+    return zipFile(filename, zipFilename, ZipOptions());
+}
 
-    // Open the input file
-    QFile inFile(filename);
-    if (!inFile.exists()) {
+bool SimpleZipper::zipFile(const QString& filename, const QString& zipFilename, const ZipOptions& options)
+{
+    ZIP_LOG(ZipLog::DebugLevel) << "Zipping file" << filename << "to" << zipFilename;
+
+    // Check the input file exists
+    if (!QFile::exists(filename)) {
         qWarning() << "File" << filename << "does not exist";
         return false;
     }
-    if (!inFile.open(QIODevice::ReadOnly)) {
-        qWarning() << "Failed to open file" << filename << "for reading";
-        return false;
-    }
-
-    // Read the contents of the input file into a QByteArray
-    QByteArray buffer = inFile.readAll();
 
-    // Create and open the output zip file
-    mz_zip_archive zip;
-    memset(&zip, 0, sizeof(zip));
-    if (!mz_zip_writer_init_file(&zip, zipFilename.toUtf8().constData(), 0)) {
-        qWarning() << "Failed to create output zip file" << zipFilename;
+    // Create the output zip file and add the input file to it
+    ZipWriter writer(options);
+    if (!writer.open(zipFilename)) {
         return false;
     }
-
-    // Add the input file contents to the zip archive
-    if (!mz_zip_writer_add_mem(&zip, fileInfo.fileName().toUtf8().constData(), buffer.constData(), buffer.size(), MZ_DEFAULT_COMPRESSION)) {
-        qWarning() << "Failed to add file" << filename << "to zip archive" << zipFilename;
-        mz_zip_writer_end(&zip);
+    if (!writer.addFile(filename, QFileInfo(filename).fileName())) {
+        writer.abort();
         return false;
     }
 
     // Clean up
-    mz_zip_writer_finalize_archive(&zip);
-    mz_zip_writer_end(&zip);
-    qDebug() << "Zip complete";
+    if (!writer.close()) {
+        return false;
+    }
+    ZIP_LOG(ZipLog::DebugLevel) << "Zip complete, peak memory" << writer.peakMemory() << "bytes";
     return true;
 }
 
 bool SimpleZipper::zipFolder(const QString& folder)
 {
-    QDir dir(folder);
-    QString zipFilename = dir.dirName() + ".zip";
-    dir.cdUp();
-    zipFilename = dir.absolutePath() + "/" + zipFilename;
-    return zipFolder(folder, zipFilename);
+    return zipFolder(folder, defaultZipFilenameForFolder(folder));
 }
 
 bool SimpleZipper::zipFolder(const QString& folder, const QString& zipFilename)
 {
-    qDebug() << "Zipping folder" << folder << "to" << zipFilename;
+    return zipFolder(folder, zipFilename, ZipOptions());
+}
+
+bool SimpleZipper::zipFolder(const QString& folder, const QString& zipFilename, const ZipOptions& options)
+{
+    ZIP_LOG(ZipLog::DebugLevel) << "Zipping folder" << folder << "to" << zipFilename;
 
-    // Create and open the output zip file
-    mz_zip_archive zip;
-    memset(&zip, 0, sizeof(zip));
-    if (!mz_zip_writer_init_file(&zip, zipFilename.toUtf8().constData(), 0)) {
-        qWarning() << "Failed to open output zip file" << zipFilename;
+    // Create the output zip file and add each file in the folder and its subfolders, compressing them as they are found
+    ZipWriter writer(options);
+    if (!writer.open(zipFilename)) {
         return false;
     }
-
-    // Add each file in the folder and its subfolders to the zip archive
-    if (!addFolderToZip(&zip, folder, "")) {
-        mz_zip_writer_end(&zip);
+    if (!writer.addFolder(folder)) {
+        writer.abort();
         return false;
     }
 
     // Clean up
-    mz_zip_writer_finalize_archive(&zip);
-    mz_zip_writer_end(&zip);
-    qDebug() << "Zip complete";
+    if (!writer.close()) {
+        return false;
+    }
+    ZIP_LOG(ZipLog::DebugLevel) << "Zip complete, peak memory" << writer.peakMemory() << "bytes";
     return true;
 }
 
-bool SimpleZipper::addFolderToZip(mz_zip_archive* zip, const QString& folder, const QString& prefix)
+bool SimpleZipper::zipFiles(const QString& zipFilename, const QVector<ZipEntry>& entries)
 {
-    // Get a list of all files and folders in the directory
-    QDir dir(folder);
-    QStringList files = dir.entryList(QDir::Files);
-    QStringList dirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-
-    // Add each file to the zip archive with the appropriate prefix
-    for (const auto& file : files) {
-        QString filename = folder + "/" + file;
-        QFile inFile(filename);
-        qDebug() << "Writing" << filename;
+    return zipFiles(zipFilename, entries, ZipOptions());
+}
 
-        if (!inFile.open(QIODevice::ReadOnly)) {
-            qWarning() << "Failed to open file" << filename << "for reading";
+bool SimpleZipper::zipFiles(const QString& zipFilename, const QVector<ZipEntry>& entries, const ZipOptions& options)
+{
+    ZIP_LOG(ZipLog::DebugLevel) << "Zipping" << entries.size() << "files to" << zipFilename;
+
+    // Size up the job before writing anything, a missing file fails it straight away
+    quint64 totalSize = 0;
+    quint64 totalNameSize = 0;
+    for (const auto& entry : entries) {
+        QFileInfo fileInfo(entry.sourcePath);
+        if (!fileInfo.isFile()) {
+            qWarning() << "File" << entry.sourcePath << "does not exist";
             return false;
         }
+        totalSize += static_cast<quint64>(fileInfo.size());
+        totalNameSize += static_cast<quint64>(entry.archiveName.toUtf8().size());
+    }
 
-        QByteArray buffer = inFile.readAll();
-        if (!mz_zip_writer_add_mem(zip, (prefix + file).toUtf8().constData(), buffer.constData(), buffer.size(), MZ_DEFAULT_COMPRESSION)) {
-            qWarning() << "Failed to add file" << file << "to zip archive";
-            return false;
-        }
+    // Decide on zip64 up front if the archive could need it, rather than switching part way through
+    mz_uint flags = 0;
+    if (static_cast<mz_uint>(entries.size()) >= MZ_UINT16_MAX || totalSize >= MZ_UINT32_MAX) {
+        flags |= MZ_ZIP_FLAG_WRITE_ZIP64;
     }
 
-    // Recursively add files in each subdirectory to the zip archive with the appropriate prefix
-    for (const auto& subdir : dirs) {
-        QString subfolder = folder + "/" + subdir;
-        QString subprefix = prefix + subdir + "/";
-        if (!addFolderToZip(zip, subfolder, subprefix)) {
-            return false;
-        }
+    if (options.progress) {
+        options.progress->setTotals(static_cast<qint64>(totalSize), entries.size());
     }
 
+    // Create the output zip file with room for all of the files, then add them in the order given
+    ZipWriter writer(options);
+    if (!writer.open(zipFilename, flags)) {
+        return false;
+    }
+    if (!writer.reserve(entries.size(), totalNameSize)) {
+        qWarning() << "Too many files for one zip archive";
+        writer.abort();
+        return false;
+    }
+    if (!writer.addEntries(entries)) {
+        writer.abort();
+        return false;
+    }
+
+    // Clean up
+    if (!writer.close()) {
+        return false;
+    }
+    ZIP_LOG(ZipLog::DebugLevel) << "Zip complete, peak memory" << writer.peakMemory() << "bytes";
     return true;
 }
+
+ZipJob* SimpleZipper::unzipFileAsync(const QString& zipFilename)
+{
+    return unzipFileAsync(zipFilename, defaultOutputFolder(zipFilename));
+}
+
+ZipJob* SimpleZipper::unzipFileAsync(const QString& zipFilename, const QString& folder, const ZipOptions& options)
+{
+    ZipJob* job = new ZipJob(options);
+    job->start([zipFilename, folder](const ZipOptions& jobOptions) { return unzipFile(zipFilename, folder, jobOptions); });
+    return job;
+}
+
+ZipJob* SimpleZipper::zipFileAsync(const QString& filename)
+{
+    return zipFileAsync(filename, defaultZipFilenameForFile(filename));
+}
+
+ZipJob* SimpleZipper::zipFileAsync(const QString& filename, const QString& zipFilename, const ZipOptions& options)
+{
+    ZipJob* job = new ZipJob(options);
+    job->start([filename, zipFilename](const ZipOptions& jobOptions) { return zipFile(filename, zipFilename, jobOptions); });
+    return job;
+}
+
+ZipJob* SimpleZipper::zipFolderAsync(const QString& folder)
+{
+    return zipFolderAsync(folder, defaultZipFilenameForFolder(folder));
+}
+
+ZipJob* SimpleZipper::zipFolderAsync(const QString& folder, const QString& zipFilename, const ZipOptions& options)
+{
+    ZipJob* job = new ZipJob(options);
+    job->start([folder, zipFilename](const ZipOptions& jobOptions) { return zipFolder(folder, zipFilename, jobOptions); });
+    return job;
+}
+
+ZipJob* SimpleZipper::zipFilesAsync(const QString& zipFilename, const QVector<ZipEntry>& entries, const ZipOptions& options)
+{
+    ZipJob* job = new ZipJob(options);
+    job->start([zipFilename, entries](const ZipOptions& jobOptions) { return zipFiles(zipFilename, entries, jobOptions); });
+    return job;
+}
@@ -2,7 +2,11 @@
 #define SIMPLEZIPPER_HPP
 
 #include <QString>
+#include <QVector>
 #include "miniz.h"
+#include "ZipEntry.h"
+#include "ZipJob.h"
+#include "ZipOptions.h"
 
 /**
  * @class   SimpleZipper
@@ -10,8 +14,16 @@
  * @brief   A class to provide simple zipping and unzipping functionality based on miniz and Qt.
  *
  * @details This class implements a very simple wrapper around the miniz high performance data compression library.
- *          Three static functions are provided to zip a file or folder, and to unzip a file. Basic debug information
- *          is displayed.
+ *          Static functions are provided to zip a file (zipFile), a folder (zipFolder) or a list of files with
+ *          their names in the archive (zipFiles), and to unzip a file (unzipFile), each with an overload taking
+ *          per-job ZipOptions. Each call opens, fills and closes an archive, they are thin wrappers around ZipWriter
+ *          and ZipReader, which can be used directly to keep an archive open across calls.
+ *
+ *          The Async variants start the same work on a background thread and return straight away with a ZipJob,
+ *          which reports progress and can be cancelled. The caller owns the job.
+ *
+ *          Progress messages go through ZipLog, one per job at debug level and one per file at trace level (off by
+ *          default, see ZipLog::setLevel). Failures are reported with qWarning.
  */
 class SimpleZipper {
 public:
@@ -41,6 +53,20 @@ public:
      */
     static bool unzipFile(const QString& zipFilename, const QString& folder);
 
+    /**
+     * @brief   Unzip a zip file using miniz and Qt.
+     *
+     * @details This function takes a zip file name, an output folder and a set of per-job options as inputs and
+     *          extracts the contents of the zip file using the miniz library and the Qt file abstraction classes.
+     *
+     * @param   zipFilename The name of the zip file to extract.
+     * @param   outFolder The name of the folder to extract the contents of the zip file to.
+     * @param   options The options for this job, e.g., huge page backed buffers.
+     *
+     * @return  True if the zip file was extracted successfully, false otherwise.
+     */
+    static bool unzipFile(const QString& zipFilename, const QString& folder, const ZipOptions& options);
+
     /**
      * @brief   Zip a single file using miniz and Qt.
      *
@@ -67,6 +93,20 @@ public:
      */
     static bool zipFile(const QString& filename, const QString& zipFilename);
 
+    /**
+     * @brief   Zip a single file using miniz and Qt.
+     *
+     * @details This function takes a file name, a zip file name and a set of per-job options as inputs and compresses
+     *          the file using the miniz library and the Qt file abstraction classes.
+     *
+     * @param   fileName The name of the file to compress.
+     * @param   zipFilename The name of the generated zip file.
+     * @param   options The options for this job, e.g., the low-memory compressor profile.
+     *
+     * @return  True if the file was compressed successfully, false otherwise.
+     */
+    static bool zipFile(const QString& filename, const QString& zipFilename, const ZipOptions& options);
+
     /**
      * @brief   Zip a folder and all its contents recursively using miniz and Qt.
      *
@@ -97,20 +137,133 @@ public:
      */
     static bool zipFolder(const QString& folder, const QString& zipFilename);
 
-private:
     /**
-     * @brief   Recursively add all files in a folder and its subfolders to a zip archive with the appropriate prefix.
+     * @brief   Zip a folder and all its contents recursively using miniz and Qt.
+     *
+     * @details This function takes a folder name, a zip file name and a set of per-job options as inputs and
+     *          compresses all the files in the folder and its subfolders into a zip file while preserving the
+     *          directory structure.
+     *
+     * @param   folder The name of the folder to compress.
+     * @param   zipFilename The name of the zip file to create.
+     * @param   options The options for this job, e.g., the low-memory compressor profile.
+     *
+     * @return  True if the folder was compressed successfully, false otherwise.
+     */
+    static bool zipFolder(const QString& folder, const QString& zipFilename, const ZipOptions& options);
+
+    /**
+     * @brief   Zip a list of files using miniz and Qt.
+     *
+     * @details This function takes a zip file name and a list of files, each with the name it should have inside
+     *          the archive, and compresses them into a zip file in the order given. No folders are traversed, so
+     *          this is the quickest way in when the files are already known (e.g., from a manifest). The default
+     *          compression level is used.
+     *
+     * @param   zipFilename The name of the zip file to create.
+     * @param   entries The files to compress.
+     *
+     * @return  True if all of the files were compressed successfully, false otherwise.
+     */
+    static bool zipFiles(const QString& zipFilename, const QVector<ZipEntry>& entries);
+
+    /**
+     * @brief   Zip a list of files using miniz and Qt.
+     *
+     * @details This function takes a zip file name, a list of files and a set of per-job options as inputs and
+     *          compresses the files into a zip file in the order given. Since the whole list is known up front, the
+     *          files are sized first, so the central directory is allocated once and the zip64 format is chosen
+     *          before anything is written if the archive will need it. The files then go through the same pipeline
+     *          as zipFolder.
+     *
+     * @param   zipFilename The name of the zip file to create.
+     * @param   entries The files to compress.
+     * @param   options The options for this job, e.g., the low-memory compressor profile.
+     *
+     * @return  True if all of the files were compressed successfully, false otherwise.
+     */
+    static bool zipFiles(const QString& zipFilename, const QVector<ZipEntry>& entries, const ZipOptions& options);
+
+    /**
+     * @brief   Unzip a zip file in the background into a folder with the same name as the zip file.
+     *
+     * @param   zipFilename The name of the zip file to extract.
+     *
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* unzipFileAsync(const QString& zipFilename);
+
+    /**
+     * @brief   Unzip a zip file in the background.
+     *
+     * @details Starts unzipFile on the ZipJob thread pool. The totals are read from the central directory before
+     *          anything is extracted, and if the job is cancelled the files extracted so far are deleted.
+     *
+     * @param   zipFilename The name of the zip file to extract.
+     * @param   folder The name of the folder to extract the contents of the zip file to.
+     * @param   options The options for this job.
+     *
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* unzipFileAsync(const QString& zipFilename, const QString& folder, const ZipOptions& options = ZipOptions());
+
+    /**
+     * @brief   Zip a single file in the background to a zip file with the same name next to it.
      *
-     * @details This function is used by zipFolder to traverse the directory tree and add all files and
-     *          subfolders to the zip archive with the appropriate directory structure.
+     * @param   filename The name of the file to compress.
      *
-     * @param   zip A pointer to the miniz zip archive object to add files to.
-     * @param   folder The name of the folder to add files from.
-     * @param   prefix The prefix to add to the file names in the zip archive to preserve the directory structure.
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* zipFileAsync(const QString& filename);
+
+    /**
+     * @brief   Zip a single file in the background.
+     *
+     * @details Starts zipFile on the ZipJob thread pool. If the job is cancelled the zip file is deleted.
+     *
+     * @param   filename The name of the file to compress.
+     * @param   zipFilename The name of the generated zip file.
+     * @param   options The options for this job.
+     *
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* zipFileAsync(const QString& filename, const QString& zipFilename, const ZipOptions& options = ZipOptions());
+
+    /**
+     * @brief   Zip a folder and all its contents recursively in the background to a zip file with the same name.
+     *
+     * @param   folder The name of the folder to compress.
+     *
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* zipFolderAsync(const QString& folder);
+
+    /**
+     * @brief   Zip a folder and all its contents recursively in the background.
+     *
+     * @details Starts zipFolder on the ZipJob thread pool. The folder is compressed while it is still being walked,
+     *          so the totals keep growing until the walk is done. If the job is cancelled the zip file is deleted.
+     *
+     * @param   folder The name of the folder to compress.
+     * @param   zipFilename The name of the zip file to create.
+     * @param   options The options for this job.
+     *
+     * @return  The running job, owned by the caller.
+     */
+    static ZipJob* zipFolderAsync(const QString& folder, const QString& zipFilename, const ZipOptions& options = ZipOptions());
+
+    /**
+     * @brief   Zip a list of files in the background.
+     *
+     * @details Starts zipFiles on the ZipJob thread pool. If the job is cancelled the zip file is deleted.
+     *
+     * @param   zipFilename The name of the zip file to create.
+     * @param   entries The files to compress.
+     * @param   options The options for this job.
      *
-     * @return  True if all files were added successfully, false otherwise.
+     * @return  The running job, owned by the caller.
      */
-    static bool addFolderToZip(mz_zip_archive* zip, const QString& folder, const QString& prefix);
+    static ZipJob* zipFilesAsync(const QString& zipFilename, const QVector<ZipEntry>& entries, const ZipOptions& options = ZipOptions());
 };
 
 #endif // SIMPLEZIPPER_HPP
@@ -3,7 +3,28 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QLabel>
+#include <QProgressBar>
 #include <QPushButton>
+#include <QSpinBox>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace {
+
+// How often the rows are redrawn, however many jobs are running or how fast they report
+const int UpdateIntervalMs = 250;
+
+QString formatDuration(qint64 seconds)
+{
+    if (seconds >= 3600) {
+        return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+}
 
 SimpleZipperUI::SimpleZipperUI(QWidget *parent)
     : QWidget(parent)
@@ -20,17 +41,45 @@ SimpleZipperUI::SimpleZipperUI(QWidget *parent)
     QPushButton* unzipButton = new QPushButton("Select file to unzip");
     connect(unzipButton, &QPushButton::clicked, this, &SimpleZipperUI::selectFileToUnzip);
 
-    // Add buttons to layout
+    // Create the number of jobs to run at once, any more wait in the queue
+    QSpinBox* parallelJobs = new QSpinBox();
+    parallelJobs->setRange(1, 16);
+    parallelJobs->setValue(ZipJob::threadPool()->maxThreadCount());
+    connect(parallelJobs, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, [](int count) {
+        ZipJob::threadPool()->setMaxThreadCount(count);
+    });
+    QPushButton* clearButton = new QPushButton("Clear finished");
+    connect(clearButton, &QPushButton::clicked, this, &SimpleZipperUI::clearFinished);
+    QHBoxLayout* queueLayout = new QHBoxLayout();
+    queueLayout->addWidget(new QLabel("Jobs at once"));
+    queueLayout->addWidget(parallelJobs);
+    queueLayout->addStretch();
+    queueLayout->addWidget(clearButton);
+
+    // Add buttons to layout, with the job rows underneath
+    mJobsLayout = new QVBoxLayout();
     QVBoxLayout *layout = new QVBoxLayout();
     layout->addWidget(zipFileButton);
     layout->addWidget(zipFolderButton);
     layout->addWidget(unzipButton);
+    layout->addLayout(queueLayout);
+    layout->addLayout(mJobsLayout);
+    layout->addStretch();
     setLayout(layout);
-    this->setMinimumWidth(300);
+    this->setMinimumWidth(400);
+
+    // Poll the jobs on a timer rather than redrawing for every progress signal, so the event loop never floods
+    mTimer = new QTimer(this);
+    connect(mTimer, &QTimer::timeout, this, &SimpleZipperUI::updateProgress);
+    mTimer->start(UpdateIntervalMs);
 }
 
 SimpleZipperUI::~SimpleZipperUI()
 {
+    // Deleting a job cancels it and waits for it to stop
+    for (auto& row : mRows) {
+        delete row.job;
+    }
 }
 
 void SimpleZipperUI::selectFileToZip()
@@ -40,7 +89,7 @@ void SimpleZipperUI::selectFileToZip()
 
     // Zip file using SimpleZipper
     if (!file.isEmpty()) {
-        SimpleZipper::zipFile(file);
+        addJob(SimpleZipper::zipFileAsync(file), "Zip " + QFileInfo(file).fileName());
     }
 }
 
@@ -51,7 +100,7 @@ void SimpleZipperUI::selectFolderToZip()
 
     // Zip folder using SimpleZipper
     if (!folder.isEmpty()) {
-        SimpleZipper::zipFolder(folder);
+        addJob(SimpleZipper::zipFolderAsync(folder), "Zip " + QFileInfo(folder).fileName());
     }
 }
 
@@ -62,6 +111,131 @@ void SimpleZipperUI::selectFileToUnzip()
 
     // Unzip file using SimpleZipper
     if (!zipFile.isEmpty()) {
-        SimpleZipper::unzipFile(zipFile);
+        addJob(SimpleZipper::unzipFileAsync(zipFile), "Unzip " + QFileInfo(zipFile).fileName());
+    }
+}
+
+void SimpleZipperUI::updateProgress()
+{
+    for (auto& row : mRows) {
+        if (row.finished) {
+            continue;
+        }
+        if (row.job->isFinished()) {
+            // In case finished never reaches us, e.g., the job was done before addJob connected to it
+            finishJob(row.job, row.job->result());
+        } else {
+            updateRow(row);
+        }
+    }
+}
+
+void SimpleZipperUI::clearFinished()
+{
+    for (int i = mRows.size() - 1; i >= 0; i--) {
+        if (mRows[i].finished) {
+            delete mRows[i].widget;
+            delete mRows[i].job;
+            mRows.remove(i);
+        }
+    }
+}
+
+void SimpleZipperUI::addJob(ZipJob* job, const QString& title)
+{
+    JobRow row;
+    row.job = job;
+    row.widget = new QWidget();
+    row.progressBar = new QProgressBar();
+    row.progressBar->setRange(0, 1000);
+    row.progressBar->setValue(0);
+    row.statusLabel = new QLabel("Queued");
+    row.cancelButton = new QPushButton("Cancel");
+    row.lastMs = 0;
+    row.lastBytes = 0;
+    row.lastEntries = 0;
+    row.bytesPerSecond = 0;
+    row.entriesPerSecond = 0;
+    row.finished = false;
+    row.timer.start();
+
+    QVBoxLayout* rowLayout = new QVBoxLayout(row.widget);
+    QHBoxLayout* topLayout = new QHBoxLayout();
+    topLayout->addWidget(new QLabel(title));
+    topLayout->addStretch();
+    topLayout->addWidget(row.cancelButton);
+    rowLayout->addLayout(topLayout);
+    rowLayout->addWidget(row.progressBar);
+    rowLayout->addWidget(row.statusLabel);
+    rowLayout->setContentsMargins(0, 0, 0, 0);
+    mJobsLayout->addWidget(row.widget);
+
+    connect(row.cancelButton, &QPushButton::clicked, job, &ZipJob::cancel);
+    connect(job, &ZipJob::finished, this, [this, job](bool ok) { finishJob(job, ok); });
+    mRows.append(row);
+}
+
+void SimpleZipperUI::finishJob(ZipJob* job, bool ok)
+{
+    for (auto& row : mRows) {
+        if (row.job != job) {
+            continue;
+        }
+        if (row.finished) {
+            // Already picked up by updateProgress
+            return;
+        }
+        updateRow(row);
+        row.finished = true;
+        row.cancelButton->setEnabled(false);
+        double seconds = row.timer.elapsed() / 1000.0;
+        if (ok) {
+            row.progressBar->setRange(0, 1000);
+            row.progressBar->setValue(1000);
+            ZipProgress::Snapshot progress = job->progress();
+            row.statusLabel->setText(QString("Done, %1 files in %2 s (%3 MB/s)")
+                .arg(progress.entriesDone)
+                .arg(seconds, 0, 'f', 1)
+                .arg(seconds > 0 ? progress.bytesDone / seconds / 1e6 : 0.0, 0, 'f', 1));
+        } else {
+            row.statusLabel->setText(job->isCanceled() ? "Cancelled" : "Failed");
+        }
+        return;
+    }
+}
+
+void SimpleZipperUI::updateRow(JobRow& row)
+{
+    ZipProgress::Snapshot progress = row.job->progress();
+    if (progress.entriesTotal == 0 && progress.bytesDone == 0) {
+        return;
+    }
+
+    // Smooth the rates, so the ETA doesn't jump around with each file
+    qint64 ms = row.timer.elapsed();
+    if (ms > row.lastMs) {
+        double seconds = (ms - row.lastMs) / 1000.0;
+        double bytesPerSecond = (progress.bytesDone - row.lastBytes) / seconds;
+        double entriesPerSecond = (progress.entriesDone - row.lastEntries) / seconds;
+        bool first = row.lastMs == 0;
+        row.bytesPerSecond = first ? bytesPerSecond : 0.7 * row.bytesPerSecond + 0.3 * bytesPerSecond;
+        row.entriesPerSecond = first ? entriesPerSecond : 0.7 * row.entriesPerSecond + 0.3 * entriesPerSecond;
+        row.lastMs = ms;
+        row.lastBytes = progress.bytesDone;
+        row.lastEntries = progress.entriesDone;
+    }
+
+    if (progress.bytesTotal > 0) {
+        row.progressBar->setValue(static_cast<int>(qMin<qint64>(progress.bytesDone * 1000 / progress.bytesTotal, 1000)));
+    }
+    QString eta = "--:--";
+    if (row.bytesPerSecond > 0 && progress.bytesTotal >= progress.bytesDone) {
+        eta = formatDuration(static_cast<qint64>((progress.bytesTotal - progress.bytesDone) / row.bytesPerSecond));
     }
+    row.statusLabel->setText(QString("%1 / %2 files, %3 MB/s, %4 files/s, ETA %5")
+        .arg(progress.entriesDone)
+        .arg(progress.entriesTotal)
+        .arg(row.bytesPerSecond / 1e6, 0, 'f', 1)
+        .arg(row.entriesPerSecond, 0, 'f', 0)
+        .arg(eta));
 }
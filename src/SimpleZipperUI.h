@@ -4,15 +4,25 @@
  * @brief   GUI for zipping and unzipping files and folders.
  *
  * @details Simple Qt GUI application with three buttons for selecting files and folders
- *          to zip and unzip using SimpleZipper.
+ *          to zip and unzip using SimpleZipper. Each selection starts a background job
+ *          (see ZipJob) and adds a row with a progress bar, the throughput, an ETA and a
+ *          cancel button, so the window stays responsive and several jobs can run at once.
  */
 
 #ifndef SIMPLEZIPPERUI_H
 #define SIMPLEZIPPERUI_H
 
+#include <QElapsedTimer>
+#include <QVector>
 #include <QWidget>
 #include "SimpleZipper.h"
 
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QTimer;
+class QVBoxLayout;
+
 class SimpleZipperUI : public QWidget
 {
     Q_OBJECT
@@ -23,19 +33,54 @@ public:
 
 private slots:
     /**
-     * @brief Select file and zip using SimpleZipper::zipFile.
+     * @brief Select file and zip using SimpleZipper::zipFileAsync.
      */
     void selectFileToZip();
 
     /**
-     * @brief Select folder and zip using SimpleZipper::zipFolder.
+     * @brief Select folder and zip using SimpleZipper::zipFolderAsync.
      */
     void selectFolderToZip();
 
     /**
-     * @brief Select file and unzip using SimpleZipper::unzipFile.
+     * @brief Select file and unzip using SimpleZipper::unzipFileAsync.
      */
     void selectFileToUnzip();
+
+    /**
+     * @brief Update the rows of the running jobs from their progress counters.
+     */
+    void updateProgress();
+
+    /**
+     * @brief Remove the rows of the jobs that have finished.
+     */
+    void clearFinished();
+
+private:
+    // One row in the job list, the rates are smoothed between updates
+    struct JobRow {
+        ZipJob* job;
+        QWidget* widget;
+        QProgressBar* progressBar;
+        QLabel* statusLabel;
+        QPushButton* cancelButton;
+        QElapsedTimer timer;
+        qint64 lastMs;
+        qint64 lastBytes;
+        int lastEntries;
+        double bytesPerSecond;
+        double entriesPerSecond;
+        bool finished;
+    };
+
+    void addJob(ZipJob* job, const QString& title);
+    void finishJob(ZipJob* job, bool ok);
+    void updateRow(JobRow& row);
+
+    QVBoxLayout* mJobsLayout;
+    QTimer* mTimer;
+    QVector<JobRow> mRows;
 };
 
 #endif // SIMPLEZIPPERUI_H
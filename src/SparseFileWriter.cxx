@@ -0,0 +1,116 @@
+#include "SparseFileWriter.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SPARSEFILEWRITER_SSE2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SPARSEFILEWRITER_NEON
+#endif
+
+SparseFileWriter::~SparseFileWriter()
+{
+    close();
+}
+
+bool SparseFileWriter::open(const QString& filename, qint64 blockSize)
+{
+    close();
+    mBlockSize = blockSize;
+    mSize = 0;
+    mHoleBytes = 0;
+    mFailed = false;
+    mFile.setFileName(filename);
+    return mFile.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+bool SparseFileWriter::write(qint64 offset, const char* data, qint64 size)
+{
+    if (mFailed || !mFile.isOpen() || offset != mSize) {
+        mFailed = true;
+        return false;
+    }
+
+    // Write runs of blocks with data in one go, and skip over the blocks that are all zero
+    qint64 pos = 0;
+    qint64 runStart = 0;
+    while (pos < size) {
+        qint64 blockEnd = qMin(size, pos + mBlockSize - ((offset + pos) & (mBlockSize - 1)));
+        bool wholeBlock = blockEnd - pos == mBlockSize;
+        if (wholeBlock && isZero(data + pos, mBlockSize)) {
+            if (pos > runStart && (!mFile.seek(offset + runStart) || mFile.write(data + runStart, pos - runStart) != pos - runStart)) {
+                mFailed = true;
+                return false;
+            }
+            mHoleBytes += mBlockSize;
+            runStart = blockEnd;
+        }
+        pos = blockEnd;
+    }
+    if (size > runStart && (!mFile.seek(offset + runStart) || mFile.write(data + runStart, size - runStart) != size - runStart)) {
+        mFailed = true;
+        return false;
+    }
+    mSize = offset + size;
+    return true;
+}
+
+bool SparseFileWriter::close()
+{
+    if (!mFile.isOpen()) {
+        return !mFailed;
+    }
+
+    // A hole at the end isn't covered by any write, so the size has to be set explicitly
+    if (!mFailed && mFile.size() != mSize && !mFile.resize(mSize)) {
+        mFailed = true;
+    }
+    mFile.close();
+    return !mFailed;
+}
+
+bool SparseFileWriter::isZero(const char* data, qint64 size)
+{
+    qint64 i = 0;
+#if defined(SPARSEFILEWRITER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#elif defined(SPARSEFILEWRITER_NEON)
+    for (; i + 64 <= size; i += 64) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data + i);
+        uint8x16_t any = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)), vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+        if (vmaxvq_u8(any) != 0) {
+            return false;
+        }
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word) {
+            return false;
+        }
+    }
+    for (; i < size; i++) {
+        if (data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t SparseFileWriter::writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size)
+{
+    SparseFileWriter* writer = static_cast<SparseFileWriter*>(opaque);
+    return writer->write(static_cast<qint64>(offset), static_cast<const char*>(buffer), static_cast<qint64>(size)) ? size : 0;
+}
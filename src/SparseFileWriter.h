@@ -0,0 +1,88 @@
+#ifndef SPARSEFILEWRITER_H
+#define SPARSEFILEWRITER_H
+
+#include <QFile>
+#include <QString>
+#include "miniz.h"
+
+/**
+ * @class   SparseFileWriter
+ *
+ * @brief   Writes a file sequentially, leaving holes where whole blocks are zero.
+ *
+ * @details Extracting a sparse file normally writes every zero byte, so a 64 GB file with 3 GB of real data takes
+ *          64 GB of disk writes and disk space. This writer checks each block-aligned block of the output for zeros
+ *          and seeks over the ones that are all zero instead of writing them, so on file systems that support holes
+ *          the output stays sparse. Only whole blocks are skipped, so the file is identical either way. On Windows
+ *          the skipped ranges are filled in by the file system unless the file has been marked sparse.
+ */
+class SparseFileWriter {
+public:
+    SparseFileWriter() = default;
+    ~SparseFileWriter();
+
+    SparseFileWriter(const SparseFileWriter&) = delete;
+    SparseFileWriter& operator=(const SparseFileWriter&) = delete;
+
+    /**
+     * @brief   Create (or truncate) the output file.
+     *
+     * @param   filename The file to write.
+     * @param   blockSize The size of the blocks to check for zeros, must be a power of two.
+     *
+     * @return  True if the file was opened, false otherwise.
+     */
+    bool open(const QString& filename, qint64 blockSize = DefaultBlockSize);
+
+    /**
+     * @brief   Write the next part of the file.
+     *
+     * @param   offset The offset of the data in the file, which must follow on from the previous write.
+     * @param   data The data to write.
+     * @param   size The number of bytes to write.
+     *
+     * @return  True if the data was written, false otherwise.
+     */
+    bool write(qint64 offset, const char* data, qint64 size);
+
+    /**
+     * @brief   Set the file size (covering any hole at the end) and close the file.
+     *
+     * @return  True if everything was written, false otherwise.
+     */
+    bool close();
+
+    /**
+     * @brief   Get the number of bytes skipped as holes so far.
+     */
+    qint64 holeBytes() const { return mHoleBytes; }
+
+    /**
+     * @brief   Check whether a buffer is all zeros.
+     *
+     * @details Uses SSE2 or NEON where available, checking 64 bytes per step.
+     *
+     * @param   data The buffer.
+     * @param   size The size of the buffer in bytes.
+     *
+     * @return  True if every byte is zero.
+     */
+    static bool isZero(const char* data, qint64 size);
+
+    /**
+     * @brief   Miniz extraction callback, for mz_zip_reader_extract_to_callback with a SparseFileWriter as the opaque
+     *          pointer.
+     */
+    static size_t writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size);
+
+    static const qint64 DefaultBlockSize = 4096;
+
+private:
+    QFile mFile;
+    qint64 mBlockSize = DefaultBlockSize;
+    qint64 mSize = 0;
+    qint64 mHoleBytes = 0;
+    bool mFailed = false;
+};
+
+#endif // SPARSEFILEWRITER_H
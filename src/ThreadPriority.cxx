@@ -0,0 +1,42 @@
+#include "ThreadPriority.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/resource.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+namespace {
+
+// From linux/ioprio.h, which older kernel headers don't have
+const int IoprioWhoProcess = 1;
+const int IoprioClassIdle = 3;
+const int IoprioClassShift = 13;
+
+// The lowest priority nice allows
+const int BackgroundNice = 19;
+
+}
+#endif
+
+bool ThreadPriority::setBackground()
+{
+#if defined(__linux__)
+    // On Linux both the I/O priority and the nice value belong to the thread, given by its thread ID
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    bool ioOk = syscall(SYS_ioprio_set, IoprioWhoProcess, tid, IoprioClassIdle << IoprioClassShift) == 0;
+    bool cpuOk = setpriority(PRIO_PROCESS, static_cast<id_t>(tid), BackgroundNice) == 0;
+    return ioOk && cpuOk;
+#elif defined(__APPLE__)
+    return setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG) == 0;
+#elif defined(_WIN32)
+    return SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef THREADPRIORITY_H
+#define THREADPRIORITY_H
+
+/**
+ * @class   ThreadPriority
+ *
+ * @brief   Puts the threads doing background jobs' work behind everything else on the machine.
+ *
+ * @details With ZipOptions::background, the pipeline's reader and writer threads and the workers of
+ *          ZipScheduler::backgroundInstance() are switched to the idle I/O class and the lowest CPU priority, so their
+ *          disk requests and CPU time only get used when nobody else wants them. Rate limits (see RateLimiter) give a
+ *          ceiling on top of that.
+ */
+class ThreadPriority {
+public:
+    /**
+     * @brief   Lower the calling thread to background priority.
+     *
+     * @details On Linux this is the idle I/O class (ioprio_set with IOPRIO_CLASS_IDLE) and nice 19, on macOS
+     *          PRIO_DARWIN_BG, and on Windows THREAD_MODE_BACKGROUND_BEGIN. An unprivileged thread can't raise its
+     *          priority again, so only call this on threads that only do background work.
+     *
+     * @return  True if the priority was lowered, false if the platform doesn't support it or refused.
+     */
+    static bool setBackground();
+};
+
+#endif // THREADPRIORITY_H
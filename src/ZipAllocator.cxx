@@ -0,0 +1,30 @@
+#include "ZipAllocator.h"
+
+void ZipAllocator::install(mz_zip_archive* zip)
+{
+    zip->m_pAlloc = allocFunc;
+    zip->m_pFree = freeFunc;
+    zip->m_pRealloc = reallocFunc;
+    zip->m_pAlloc_opaque = this;
+}
+
+void* ZipAllocator::allocFunc(void* opaque, size_t items, size_t size)
+{
+    if (size && items > static_cast<size_t>(-1) / size) {
+        return nullptr;
+    }
+    return static_cast<ZipAllocator*>(opaque)->allocate(items * size);
+}
+
+void ZipAllocator::freeFunc(void* opaque, void* address)
+{
+    static_cast<ZipAllocator*>(opaque)->deallocate(address);
+}
+
+void* ZipAllocator::reallocFunc(void* opaque, void* address, size_t items, size_t size)
+{
+    if (size && items > static_cast<size_t>(-1) / size) {
+        return nullptr;
+    }
+    return static_cast<ZipAllocator*>(opaque)->reallocate(address, items * size);
+}
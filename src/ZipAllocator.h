@@ -0,0 +1,63 @@
+#ifndef ZIPALLOCATOR_H
+#define ZIPALLOCATOR_H
+
+#include <cstddef>
+#include "miniz.h"
+
+/**
+ * @class   ZipAllocator
+ *
+ * @brief   Interface for custom memory allocators used by miniz.
+ *
+ * @details By default miniz allocates everything with malloc. Subclasses of ZipAllocator can be installed on a
+ *          mz_zip_archive using install, after which all of the archive's allocations (central directory arrays,
+ *          read buffers, compressor state, etc.) go through allocate, reallocate and deallocate. The allocator must
+ *          outlive the archive, i.e., it should only be destroyed after mz_zip_writer_end or mz_zip_reader_end.
+ */
+class ZipAllocator {
+public:
+    virtual ~ZipAllocator() {}
+
+    /**
+     * @brief   Install the allocator on a zip archive.
+     *
+     * @details Sets the m_pAlloc, m_pFree, m_pRealloc and m_pAlloc_opaque members. This must be called after the
+     *          archive is cleared with memset and before it is initialised.
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     */
+    void install(mz_zip_archive* zip);
+
+    /**
+     * @brief   Allocate a block of memory.
+     *
+     * @param   size The number of bytes to allocate.
+     *
+     * @return  A pointer to the block (aligned for any type), or nullptr if the allocation failed.
+     */
+    virtual void* allocate(size_t size) = 0;
+
+    /**
+     * @brief   Resize a block of memory, preserving its contents.
+     *
+     * @param   block The block to resize, or nullptr to allocate a new block.
+     * @param   size The new size in bytes.
+     *
+     * @return  A pointer to the resized block, or nullptr if the allocation failed (in which case block is unchanged).
+     */
+    virtual void* reallocate(void* block, size_t size) = 0;
+
+    /**
+     * @brief   Free a block of memory.
+     *
+     * @param   block The block to free, may be nullptr.
+     */
+    virtual void deallocate(void* block) = 0;
+
+private:
+    static void* allocFunc(void* opaque, size_t items, size_t size);
+    static void freeFunc(void* opaque, void* address);
+    static void* reallocFunc(void* opaque, void* address, size_t items, size_t size);
+};
+
+#endif // ZIPALLOCATOR_H
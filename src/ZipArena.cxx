@@ -0,0 +1,205 @@
+#include "ZipArena.h"
+#include "PageAllocator.h"
+#include <cstring>
+
+struct ZipArena::Chunk {
+    Chunk* prev;
+    Chunk* next;
+    size_t size;
+    size_t used;
+    bool dedicated;
+};
+
+struct ZipArena::BlockHeader {
+    size_t size;
+    Chunk* chunk;
+};
+
+namespace {
+
+const size_t Alignment = 16;
+
+size_t align(size_t size)
+{
+    return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+}
+
+// Chunk and block headers are padded so every block stays 16 byte aligned
+#define CHUNK_HEADER_SIZE align(sizeof(ZipArena::Chunk))
+#define BLOCK_HEADER_SIZE align(sizeof(ZipArena::BlockHeader))
+
+ZipArena::ZipArena(size_t chunkSize, bool hugePages) :
+    mChunkSize(chunkSize),
+    mHugePages(hugePages),
+    mCurrent(nullptr),
+    mDedicated(nullptr),
+    mBytesInUse(0),
+    mPeakBytesInUse(0),
+    mBytesReserved(0),
+    mPeakBytesReserved(0),
+    mAllocationCount(0)
+{
+}
+
+ZipArena::~ZipArena()
+{
+    reset();
+}
+
+void ZipArena::reset()
+{
+    while (mCurrent) {
+        Chunk* next = mCurrent->next;
+        releaseChunk(mCurrent);
+        mCurrent = next;
+    }
+    while (mDedicated) {
+        Chunk* next = mDedicated->next;
+        releaseChunk(mDedicated);
+        mDedicated = next;
+    }
+    mBytesInUse = 0;
+}
+
+ZipArena::Chunk* ZipArena::newChunk(size_t size, bool dedicated)
+{
+    size_t mappedSize = size;
+    Chunk* chunk = static_cast<Chunk*>(PageAllocator::allocate(mappedSize, mHugePages));
+    if (!chunk) {
+        return nullptr;
+    }
+
+    chunk->prev = nullptr;
+    chunk->next = nullptr;
+    chunk->size = mappedSize;
+    chunk->used = CHUNK_HEADER_SIZE;
+    chunk->dedicated = dedicated;
+
+    mBytesReserved += mappedSize;
+    if (mBytesReserved > mPeakBytesReserved) {
+        mPeakBytesReserved = mBytesReserved;
+    }
+    return chunk;
+}
+
+void ZipArena::releaseChunk(Chunk* chunk)
+{
+    mBytesReserved -= chunk->size;
+    PageAllocator::release(chunk, chunk->size);
+}
+
+void* ZipArena::newBlock(size_t size)
+{
+    size_t needed = BLOCK_HEADER_SIZE + align(size ? size : 1);
+    if (needed < size) {
+        return nullptr;
+    }
+
+    Chunk* chunk;
+    if (needed > mChunkSize / 2) {
+        // Large blocks get their own chunk so they can be returned to the OS as soon as they are freed
+        chunk = newChunk(CHUNK_HEADER_SIZE + needed, true);
+        if (!chunk) {
+            return nullptr;
+        }
+        chunk->next = mDedicated;
+        if (mDedicated) {
+            mDedicated->prev = chunk;
+        }
+        mDedicated = chunk;
+    } else {
+        if (!mCurrent || mCurrent->used + needed > mCurrent->size) {
+            chunk = newChunk(mChunkSize, false);
+            if (!chunk) {
+                return nullptr;
+            }
+            chunk->next = mCurrent;
+            mCurrent = chunk;
+        }
+        chunk = mCurrent;
+    }
+
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(reinterpret_cast<char*>(chunk) + chunk->used);
+    header->size = size;
+    header->chunk = chunk;
+    chunk->used += needed;
+
+    mAllocationCount++;
+    mBytesInUse += size;
+    if (mBytesInUse > mPeakBytesInUse) {
+        mPeakBytesInUse = mBytesInUse;
+    }
+    return reinterpret_cast<char*>(header) + BLOCK_HEADER_SIZE;
+}
+
+void* ZipArena::allocate(size_t size)
+{
+    return newBlock(size);
+}
+
+void* ZipArena::reallocate(void* block, size_t size)
+{
+    if (!block) {
+        return newBlock(size);
+    }
+
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(static_cast<char*>(block) - BLOCK_HEADER_SIZE);
+    Chunk* chunk = header->chunk;
+    size_t oldSize = header->size;
+    char* chunkEnd = reinterpret_cast<char*>(chunk) + chunk->used;
+    bool isLast = static_cast<char*>(block) + align(oldSize ? oldSize : 1) == chunkEnd;
+
+    // Shrink or grow in place if this is the last block in its chunk and there's room
+    if (isLast && size) {
+        size_t newUsed = chunk->used - align(oldSize ? oldSize : 1) + align(size);
+        if (newUsed <= chunk->size) {
+            chunk->used = newUsed;
+            header->size = size;
+            mBytesInUse = mBytesInUse - oldSize + size;
+            if (mBytesInUse > mPeakBytesInUse) {
+                mPeakBytesInUse = mBytesInUse;
+            }
+            return block;
+        }
+    }
+
+    void* newBlockPtr = newBlock(size);
+    if (!newBlockPtr) {
+        return nullptr;
+    }
+    memcpy(newBlockPtr, block, oldSize < size ? oldSize : size);
+    deallocate(block);
+    return newBlockPtr;
+}
+
+void ZipArena::deallocate(void* block)
+{
+    if (!block) {
+        return;
+    }
+
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(static_cast<char*>(block) - BLOCK_HEADER_SIZE);
+    Chunk* chunk = header->chunk;
+    mBytesInUse -= header->size;
+
+    if (chunk->dedicated) {
+        if (chunk->prev) {
+            chunk->prev->next = chunk->next;
+        } else {
+            mDedicated = chunk->next;
+        }
+        if (chunk->next) {
+            chunk->next->prev = chunk->prev;
+        }
+        releaseChunk(chunk);
+        return;
+    }
+
+    // Rewind the chunk if this was the most recent block, otherwise the space is reclaimed on reset
+    size_t blockSize = align(header->size ? header->size : 1);
+    if (static_cast<char*>(block) + blockSize == reinterpret_cast<char*>(chunk) + chunk->used) {
+        chunk->used -= BLOCK_HEADER_SIZE + blockSize;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef ZIPARENA_H
+#define ZIPARENA_H
+
+#include "ZipAllocator.h"
+
+/**
+ * @class   ZipArena
+ *
+ * @brief   A bump (arena) allocator for a single zip job.
+ *
+ * @details Memory is carved out of large chunks taken directly from the operating system with PageAllocator, so a
+ *          long-running process doesn't fragment its heap with miniz's per-archive allocations. Freeing or growing
+ *          the most recent allocation is done in place (miniz mostly allocates and frees in LIFO order, and grows
+ *          its central directory arrays with realloc), any other freed block is only reclaimed when the arena is
+ *          reset or destroyed. Requests larger than half a chunk get a chunk of their own which is released as soon
+ *          as the block is freed. All memory is released in one go when the arena is destroyed, so it should be
+ *          declared before (and so outlive) the archive it is installed on. The counters give the exact memory used
+ *          by the job. Buffers held by ZipStatePool are per thread rather than per job and aren't counted. The arena
+ *          is not thread safe.
+ */
+class ZipArena : public ZipAllocator {
+public:
+    static const size_t DefaultChunkSize = 1024 * 1024;
+
+    /**
+     * @brief   Create an empty arena, no memory is allocated until the first request.
+     *
+     * @param   chunkSize The size of each chunk requested from the operating system.
+     * @param   hugePages Whether to back the chunks with 2 MB huge pages where possible.
+     */
+    explicit ZipArena(size_t chunkSize = DefaultChunkSize, bool hugePages = false);
+    ~ZipArena() override;
+
+    ZipArena(const ZipArena&) = delete;
+    ZipArena& operator=(const ZipArena&) = delete;
+
+    void* allocate(size_t size) override;
+    void* reallocate(void* block, size_t size) override;
+    void deallocate(void* block) override;
+
+    /**
+     * @brief   Release all memory held by the arena, invalidating every block allocated from it.
+     */
+    void reset();
+
+    /**
+     * @brief   Get the number of bytes currently allocated (and not freed) by the caller.
+     */
+    size_t bytesInUse() const { return mBytesInUse; }
+
+    /**
+     * @brief   Get the highest value of bytesInUse since the arena was created.
+     */
+    size_t peakBytesInUse() const { return mPeakBytesInUse; }
+
+    /**
+     * @brief   Get the number of bytes currently requested from the operating system.
+     */
+    size_t bytesReserved() const { return mBytesReserved; }
+
+    /**
+     * @brief   Get the highest value of bytesReserved since the arena was created.
+     */
+    size_t peakBytesReserved() const { return mPeakBytesReserved; }
+
+    /**
+     * @brief   Get the number of calls to allocate (including reallocations that needed a new block).
+     */
+    size_t allocationCount() const { return mAllocationCount; }
+
+private:
+    struct Chunk;
+    struct BlockHeader;
+
+    Chunk* newChunk(size_t size, bool dedicated);
+    void releaseChunk(Chunk* chunk);
+    void* newBlock(size_t size);
+
+    size_t mChunkSize;
+    bool mHugePages;
+    Chunk* mCurrent;
+    Chunk* mDedicated;
+    size_t mBytesInUse;
+    size_t mPeakBytesInUse;
+    size_t mBytesReserved;
+    size_t mPeakBytesReserved;
+    size_t mAllocationCount;
+};
+
+#endif // ZIPARENA_H
@@ -0,0 +1,32 @@
+#ifndef ZIPENTRY_H
+#define ZIPENTRY_H
+
+#include <QString>
+#include <functional>
+
+/**
+ * @struct  ZipEntry
+ *
+ * @brief   A file to add to a zip archive.
+ */
+struct ZipEntry {
+    /**
+     * @brief   The path of the file on disk.
+     */
+    QString sourcePath;
+
+    /**
+     * @brief   The name of the file inside the archive, using forward slashes for folders.
+     */
+    QString archiveName;
+};
+
+/**
+ * @brief   Produces the files to add to an archive one at a time.
+ *
+ * @details Sets entry to the next file and returns true, or returns false when there are no more files. Used to
+ *          start compressing files while the rest are still being found (see DirectoryWalker).
+ */
+typedef std::function<bool(ZipEntry& entry)> ZipEntrySource;
+
+#endif // ZIPENTRY_H
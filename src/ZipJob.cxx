@@ -0,0 +1,139 @@
+#include "ZipJob.h"
+#include "CpuCount.h"
+#include <QMetaObject>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace {
+
+// Runs as many jobs at once as there are cores the process can use, where a plain QThreadPool goes by the machine's
+class ZipThreadPool : public QThreadPool {
+public:
+    ZipThreadPool()
+    {
+        setMaxThreadCount(CpuCount::available());
+    }
+};
+
+}
+
+Q_GLOBAL_STATIC(ZipThreadPool, zipThreadPool)
+
+namespace {
+
+// Runs a job's work and reports the result through the job's future, the job must outlive it (see ~ZipJob)
+class ZipRunnable : public QRunnable {
+public:
+    ZipRunnable(ZipJob* job, const QFutureInterface<bool>& futureInterface, ZipJob::Work work,
+                const ZipOptions& options, const std::shared_ptr<ZipProgress>& progress) :
+        mJob(job),
+        mInterface(futureInterface),
+        mWork(std::move(work)),
+        mOptions(options),
+        mProgress(progress)
+    {
+    }
+
+    void run() override
+    {
+        bool ok = false;
+        if (!mInterface.isCanceled()) {
+            ok = mWork(mOptions) && !mProgress->isCanceled();
+        }
+        mProgress->notify();
+
+        // Posted to the job's thread rather than emitted here, so a job that's done before the caller has connected
+        // to it still gets there. Qt drops the call if the job is deleted first.
+        QMetaObject::invokeMethod(mJob, "finished", Qt::QueuedConnection, Q_ARG(bool, ok));
+
+        // Nothing can touch the job after this, its destructor may be waiting for it
+        mInterface.reportResult(ok);
+        mInterface.reportFinished();
+    }
+
+private:
+    ZipJob* mJob;
+    QFutureInterface<bool> mInterface;
+    ZipJob::Work mWork;
+    ZipOptions mOptions;
+    std::shared_ptr<ZipProgress> mProgress;
+};
+
+}
+
+ZipJob::ZipJob(const ZipOptions& options, QObject* parent) :
+    QObject(parent),
+    mOptions(options),
+    mProgress(std::make_shared<ZipProgress>([this](const ZipProgress::Snapshot& snapshot) { reportProgress(snapshot); }))
+{
+    mOptions.progress = mProgress;
+    mInterface.setProgressRange(0, 1000);
+}
+
+ZipJob::~ZipJob()
+{
+    cancel();
+    waitForFinished();
+}
+
+void ZipJob::start(Work work)
+{
+    // Started here rather than on the pool, so waiting on the future works before the job gets a thread
+    mInterface.reportStarted();
+    threadPool()->start(new ZipRunnable(this, mInterface, std::move(work), mOptions, mProgress));
+}
+
+void ZipJob::cancel()
+{
+    mProgress->cancel();
+    mInterface.cancel();
+}
+
+bool ZipJob::isFinished() const
+{
+    return mInterface.isFinished();
+}
+
+bool ZipJob::isCanceled() const
+{
+    return mInterface.isCanceled() || mProgress->isCanceled();
+}
+
+void ZipJob::waitForFinished()
+{
+    mInterface.waitForFinished();
+}
+
+bool ZipJob::result()
+{
+    // A cancelled future drops its result, so there may be nothing to read
+    waitForFinished();
+    return !isCanceled() && mInterface.resultCount() > 0 && mInterface.future().result();
+}
+
+ZipProgress::Snapshot ZipJob::progress() const
+{
+    return mProgress->snapshot();
+}
+
+QFuture<bool> ZipJob::future()
+{
+    return mInterface.future();
+}
+
+QThreadPool* ZipJob::threadPool()
+{
+    return zipThreadPool();
+}
+
+void ZipJob::reportProgress(const ZipProgress::Snapshot& snapshot)
+{
+    // Pass on a cancel that came through the future, e.g., from a QFutureWatcher
+    if (mInterface.isCanceled()) {
+        mProgress->cancel();
+    }
+    if (snapshot.bytesTotal > 0) {
+        mInterface.setProgressValue(static_cast<int>(qMin<qint64>(snapshot.bytesDone * 1000 / snapshot.bytesTotal, 1000)));
+    }
+    emit progressChanged(snapshot.bytesDone, snapshot.bytesTotal, snapshot.entriesDone, snapshot.entriesTotal);
+}
@@ -0,0 +1,118 @@
+#ifndef ZIPJOB_H
+#define ZIPJOB_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QObject>
+#include <functional>
+#include <memory>
+#include "ZipOptions.h"
+#include "ZipProgress.h"
+
+class QThreadPool;
+
+/**
+ * @class   ZipJob
+ *
+ * @brief   A handle to a zip or unzip job running in the background.
+ *
+ * @details The async SimpleZipper functions return a ZipJob. The work runs on a dedicated thread pool (see threadPool)
+ *          rather than the global one, so long jobs don't starve anything else that uses QtConcurrent. Progress is
+ *          reported through progressChanged at most every 100 ms, and through the QFuture's progress value in
+ *          thousandths, so a QFutureWatcher can be used instead of the signals if that's more convenient.
+ *
+ *          cancel (or cancelling the QFuture) is cooperative: the job checks for it between 1 MB chunks of
+ *          compression and between entries, then fails and deletes what it has written so far. progressChanged is
+ *          emitted from the worker thread, so connect to it with the default (queued) connection from a GUI.
+ *          finished is posted to the thread the job was created on, so it's delivered by that thread's event loop
+ *          after the async call has returned and the caller has connected, however quickly the job finished. A
+ *          thread without an event loop should use result or the future instead. Deleting a ZipJob cancels it and
+ *          waits for it to stop.
+ */
+class ZipJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<bool(const ZipOptions& options)> Work;
+
+    /**
+     * @brief   Create a job that hasn't been started.
+     *
+     * @param   options The options passed to the work, ZipOptions::progress is replaced with the job's own counters.
+     * @param   parent The QObject parent.
+     */
+    explicit ZipJob(const ZipOptions& options = ZipOptions(), QObject* parent = nullptr);
+    ~ZipJob();
+
+    /**
+     * @brief   Run the work on the thread pool.
+     *
+     * @param   work A function that does the job with the given options and returns whether it succeeded.
+     */
+    void start(Work work);
+
+    /**
+     * @brief   Ask the job to stop, it finishes with a false result as soon as it next checks.
+     */
+    void cancel();
+
+    /**
+     * @brief   Check whether the job has finished, successfully or not.
+     */
+    bool isFinished() const;
+
+    /**
+     * @brief   Check whether the job has been cancelled.
+     */
+    bool isCanceled() const;
+
+    /**
+     * @brief   Wait for the job to finish.
+     */
+    void waitForFinished();
+
+    /**
+     * @brief   Wait for the job to finish and get its result.
+     *
+     * @return  True if the job succeeded, false if it failed or was cancelled.
+     */
+    bool result();
+
+    /**
+     * @brief   Get the current progress counters.
+     */
+    ZipProgress::Snapshot progress() const;
+
+    /**
+     * @brief   Get a future for the job, e.g., to watch with a QFutureWatcher.
+     */
+    QFuture<bool> future();
+
+    /**
+     * @brief   Get the thread pool the jobs run on, e.g., to change how many can run at once.
+     *
+     * @details It starts out running one job per core the process can use (see CpuCount).
+     */
+    static QThreadPool* threadPool();
+
+signals:
+    /**
+     * @brief   Emitted as the job makes progress, at most every 100 ms, and once more when it finishes.
+     */
+    void progressChanged(qint64 bytesDone, qint64 bytesTotal, int entriesDone, int entriesTotal);
+
+    /**
+     * @brief   Emitted when the job finishes, with its result, on the thread the job was created on.
+     */
+    void finished(bool ok);
+
+private:
+    void reportProgress(const ZipProgress::Snapshot& snapshot);
+
+    ZipOptions mOptions;
+    std::shared_ptr<ZipProgress> mProgress;
+    QFutureInterface<bool> mInterface;
+};
+
+#endif // ZIPJOB_H
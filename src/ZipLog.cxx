@@ -0,0 +1,241 @@
+#include "ZipLog.h"
+#include <QAtomicInt>
+#include <QByteArray>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const char* const ZipLog::EnvironmentVariable = "SIMPLEZIPPER_LOG";
+
+namespace {
+
+ZipLog::Level initialLevel()
+{
+    const QByteArray name = qgetenv(ZipLog::EnvironmentVariable).trimmed().toLower();
+    if (name == "trace") {
+        return ZipLog::TraceLevel;
+    } else if (name == "info") {
+        return ZipLog::InfoLevel;
+    } else if (name == "warning") {
+        return ZipLog::WarningLevel;
+    } else if (name == "off") {
+        return ZipLog::SilentLevel;
+    }
+    return ZipLog::DebugLevel;
+}
+
+QAtomicInt logLevel(initialLevel());
+
+// Messages waiting in the ring buffer for the delivery thread
+class AsyncRing {
+public:
+    AsyncRing() :
+        mHead(0),
+        mCount(0),
+        mDelivering(false),
+        mRunning(false),
+        mStopping(false),
+        mDropped(0)
+    {
+    }
+
+    ~AsyncRing()
+    {
+        stop();
+    }
+
+    void start(int capacity, const std::function<void(ZipLog::Level, const QString&)>& deliver)
+    {
+        stop();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRing.assign(static_cast<size_t>(qMax(1, capacity)), Record());
+        mHead = 0;
+        mCount = 0;
+        mStopping = false;
+        mRunning = true;
+        mThread = std::thread(&AsyncRing::run, this, deliver);
+    }
+
+    // Deliver what's left, then stop the thread
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mRunning) {
+                return;
+            }
+            mStopping = true;
+        }
+        mReady.notify_one();
+        mThread.join();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+        mRing.clear();
+    }
+
+    // False if the ring isn't running, so the caller should deliver the message itself
+    bool push(ZipLog::Level level, const QString& message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mRunning || mStopping) {
+                return false;
+            }
+            if (mCount == mRing.size()) {
+                mDropped++;
+                return true;
+            }
+            Record& record = mRing[(mHead + mCount) % mRing.size()];
+            record.level = level;
+            record.message = message;
+            mCount++;
+        }
+        mReady.notify_one();
+        return true;
+    }
+
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDrained.wait(lock, [this] { return !mRunning || (mCount == 0 && !mDelivering); });
+    }
+
+    quint64 dropped() const
+    {
+        return mDropped;
+    }
+
+private:
+    struct Record {
+        ZipLog::Level level = ZipLog::DebugLevel;
+        QString message;
+    };
+
+    void run(std::function<void(ZipLog::Level, const QString&)> deliver)
+    {
+        std::vector<Record> batch;
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;) {
+            mReady.wait(lock, [this] { return mCount > 0 || mStopping; });
+            if (mCount == 0) {
+                mDrained.notify_all();
+                return;
+            }
+
+            // Take everything at once, so writers only wait for the lock while records are moved out
+            batch.clear();
+            for (; mCount > 0; mCount--) {
+                batch.push_back(std::move(mRing[mHead]));
+                mHead = (mHead + 1) % mRing.size();
+            }
+            mDelivering = true;
+            lock.unlock();
+            for (const Record& record : batch) {
+                deliver(record.level, record.message);
+            }
+            lock.lock();
+            mDelivering = false;
+            mDrained.notify_all();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mReady;
+    std::condition_variable mDrained;
+    std::vector<Record> mRing;
+    size_t mHead;
+    size_t mCount;
+    bool mDelivering;
+    bool mRunning;
+    bool mStopping;
+    std::atomic<quint64> mDropped;
+    std::thread mThread;
+};
+
+// The sink is declared before the ring, so the ring's thread has stopped before the sink goes at exit
+struct LogState {
+    std::mutex sinkMutex;
+    ZipLog::Sink sink;
+    AsyncRing ring;
+};
+
+LogState& state()
+{
+    static LogState logState;
+    return logState;
+}
+
+void deliver(ZipLog::Level level, const QString& message)
+{
+    LogState& log = state();
+    std::lock_guard<std::mutex> lock(log.sinkMutex);
+    if (log.sink) {
+        log.sink(level, message);
+        return;
+    }
+    switch (level) {
+    case ZipLog::TraceLevel:
+    case ZipLog::DebugLevel:
+        qDebug("%s", qPrintable(message));
+        break;
+    case ZipLog::InfoLevel:
+        qInfo("%s", qPrintable(message));
+        break;
+    default:
+        qWarning("%s", qPrintable(message));
+        break;
+    }
+}
+
+}
+
+void ZipLog::setLevel(Level level)
+{
+    logLevel.storeRelease(level);
+}
+
+ZipLog::Level ZipLog::level()
+{
+    return static_cast<Level>(logLevel.loadAcquire());
+}
+
+bool ZipLog::isEnabled(Level level)
+{
+    return level >= logLevel.loadAcquire() && level < SilentLevel;
+}
+
+void ZipLog::setSink(Sink sink)
+{
+    LogState& log = state();
+    log.ring.flush();
+    std::lock_guard<std::mutex> lock(log.sinkMutex);
+    log.sink = std::move(sink);
+}
+
+void ZipLog::setAsync(bool async, int capacity)
+{
+    if (async) {
+        state().ring.start(capacity, deliver);
+    } else {
+        state().ring.stop();
+    }
+}
+
+void ZipLog::flush()
+{
+    state().ring.flush();
+}
+
+quint64 ZipLog::dropped()
+{
+    return state().ring.dropped();
+}
+
+void ZipLog::write(Level level, const QString& message)
+{
+    if (!state().ring.push(level, message)) {
+        deliver(level, message);
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef ZIPLOG_H
+#define ZIPLOG_H
+
+#include <QDebug>
+#include <QString>
+#include <QtGlobal>
+#include <functional>
+
+// The lowest level compiled in at all, messages below it are removed by the compiler (see ZipLog::Level)
+#ifndef SIMPLEZIPPER_LOG_MIN_LEVEL
+#define SIMPLEZIPPER_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * @brief   Log a message at a level, streamed like qDebug(), e.g., ZIP_LOG(ZipLog::TraceLevel) << "Writing" << path.
+ *
+ * @details The arguments are only evaluated if the level is enabled, so a disabled message costs a comparison,
+ *          and nothing at all if the level is below SIMPLEZIPPER_LOG_MIN_LEVEL.
+ */
+#define ZIP_LOG(level) \
+    if ((level) < SIMPLEZIPPER_LOG_MIN_LEVEL || !ZipLog::isEnabled(level)) {} else ZipLog::Message(level).stream()
+
+/**
+ * @class   ZipLog
+ *
+ * @brief   Level-gated logging for the library's diagnostics.
+ *
+ * @details Messages about single entries ("Writing", "Extracting") are at TraceLevel, which is off by default, so
+ *          zipping a million files doesn't format a million strings and write them to stderr. Messages about whole
+ *          jobs are at DebugLevel, and the default level. Failures still go straight to qWarning.
+ *
+ *          The level can be set with setLevel, or with the SIMPLEZIPPER_LOG environment variable (trace, debug,
+ *          info, warning or off), and levels below SIMPLEZIPPER_LOG_MIN_LEVEL (a CMake option) aren't compiled in.
+ *          Messages go to the sink, which by default passes them to qDebug, qInfo or qWarning so a Qt message
+ *          handler sees them as before.
+ *
+ *          With setAsync, messages are put in a fixed-size ring buffer and passed to the sink on a background
+ *          thread, so a slow sink (e.g., stderr redirected to a file) doesn't hold up the job. If the ring is full
+ *          the message is dropped and counted rather than making the job wait.
+ */
+class ZipLog {
+public:
+    /**
+     * @brief   How much detail a message is.
+     */
+    enum Level {
+        TraceLevel,     ///< Every entry
+        DebugLevel,     ///< Every job
+        InfoLevel,      ///< Things worth knowing
+        WarningLevel,   ///< Things that went wrong
+        SilentLevel     ///< No messages
+    };
+
+    /**
+     * @brief   Where messages end up, called on one thread at a time.
+     */
+    typedef std::function<void(Level level, const QString& message)> Sink;
+
+    /**
+     * @brief   The environment variable with the initial level.
+     */
+    static const char* const EnvironmentVariable;
+
+    /**
+     * @brief   The default number of messages the ring buffer holds.
+     */
+    static const int DefaultCapacity = 4096;
+
+    /**
+     * @brief   Set the lowest level that is logged.
+     */
+    static void setLevel(Level level);
+
+    /**
+     * @brief   Get the lowest level that is logged.
+     */
+    static Level level();
+
+    /**
+     * @brief   Check whether messages at a level are logged, a single atomic load.
+     */
+    static bool isEnabled(Level level);
+
+    /**
+     * @brief   Send messages somewhere else, or back to the Qt message functions with a null sink.
+     */
+    static void setSink(Sink sink);
+
+    /**
+     * @brief   Turn the ring buffer and its thread on or off.
+     *
+     * @details Turning it off delivers whatever is still in the ring first.
+     *
+     * @param   async True to deliver messages on a background thread.
+     * @param   capacity The number of messages the ring holds.
+     */
+    static void setAsync(bool async, int capacity = DefaultCapacity);
+
+    /**
+     * @brief   Wait until every message in the ring buffer has been passed to the sink.
+     */
+    static void flush();
+
+    /**
+     * @brief   Get the number of messages dropped because the ring buffer was full.
+     */
+    static quint64 dropped();
+
+    /**
+     * @brief   Log a message that has already been formatted.
+     */
+    static void write(Level level, const QString& message);
+
+    /**
+     * @brief   A message being streamed, written out when it's destroyed (see ZIP_LOG).
+     */
+    class Message {
+    public:
+        explicit Message(Level level) :
+            mLevel(level),
+            mStream(&mText)
+        {
+        }
+
+        ~Message()
+        {
+            // QDebug puts a space after every argument, including the last
+            if (mText.endsWith(' ')) {
+                mText.chop(1);
+            }
+            ZipLog::write(mLevel, mText);
+        }
+
+        Message(const Message&) = delete;
+        Message& operator=(const Message&) = delete;
+
+        QDebug& stream() { return mStream; }
+
+    private:
+        Level mLevel;
+        QString mText;
+        QDebug mStream;
+    };
+};
+
+#endif // ZIPLOG_H
@@ -0,0 +1,263 @@
+#ifndef ZIPOPTIONS_H
+#define ZIPOPTIONS_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include "miniz.h"
+#include "DiskOrder.h"
+#include "MemoryGovernor.h"
+#include "RateLimiter.h"
+#include "ZipArena.h"
+#include "ZipProgress.h"
+#include "ZipScheduler.h"
+
+/**
+ * @struct  ZipOptions
+ *
+ * @brief   Per-job options for SimpleZipper.
+ *
+ * @details The defaults give the same behaviour as the SimpleZipper functions that don't take options.
+ */
+struct ZipOptions {
+    /**
+     * @brief   Use the low-memory compressor profile.
+     *
+     * @details Uses a smaller hash table and smaller LZ code and output buffers for each compressor (about 165 KB
+     *          instead of 320 KB on 64-bit builds), and a smaller arena chunk size. Compression is a little slower
+     *          and the output a little bigger. Useful when lots of zip jobs run at the same time.
+     */
+    bool lowMemory = false;
+
+    /**
+     * @brief   The compression level, from 0 (store) to 10 (smallest output, slowest), 6 by default.
+     */
+    int level = MZ_DEFAULT_LEVEL;
+
+    /**
+     * @brief   Back the compressor / decompressor state, I/O buffers and arena with 2 MB huge pages.
+     *
+     * @details The deflate hash chains and dictionary are accessed randomly, so with 4 KB pages they cause lots of
+     *          TLB misses on large inputs. Falls back to normal pages if huge pages aren't available (see
+     *          PageAllocator).
+     */
+    bool hugePages = false;
+
+    /**
+     * @brief   Overlap reading, compressing and writing when zipping a folder (see ZipPipeline).
+     */
+    bool pipelined = true;
+
+    /**
+     * @brief   Compress on the shared ZipScheduler workers rather than the calling thread (see ParallelDeflate).
+     *
+     * @details Files are compressed in parallel and added in order, and files over 8 MB are split into chunks that
+     *          are compressed in parallel too. Big files come out slightly bigger, as each 4 MB chunk starts with an
+     *          empty dictionary.
+     */
+    bool parallelCompression = true;
+
+    /**
+     * @brief   The job's share of the ZipScheduler workers when other jobs are compressing at the same time.
+     */
+    ZipScheduler::Priority priority = ZipScheduler::NormalPriority;
+
+    /**
+     * @brief   The scheduler to compress on, or null for the shared ZipScheduler::instance() (or the background one).
+     *
+     * @details E.g., to compare a scheduler without NUMA placement, or to keep a set of jobs on their own workers.
+     */
+    ZipScheduler* compressionScheduler = nullptr;
+
+    /**
+     * @brief   The number of threads listing folders when zipping a folder (see DirectoryWalker), or 0 for automatic.
+     */
+    int walkerThreads = 0;
+
+    /**
+     * @brief   The order to read files in when zipping a folder (see DiskOrder).
+     *
+     * @details Anything other than NameOrder means the whole folder is listed before compression starts. The file
+     *          data is written in the order it was read, but the archive's central directory is put back into name
+     *          order, so the archive lists the same way whichever order is used.
+     */
+    DiskOrder::Order readOrder = DiskOrder::NameOrder;
+
+    /**
+     * @brief   Leave out files and folders matching any of these patterns when zipping a folder (see PathFilter).
+     *
+     * @details Uses .gitignore syntax, e.g., "*.tmp" or "build/", with '!' to re-include (e.g., "!keep.tmp").
+     *          Excluded folders aren't walked at all.
+     */
+    QStringList excludePatterns;
+
+    /**
+     * @brief   Only zip the files matching one of these patterns when zipping a folder, or all files if empty.
+     */
+    QStringList includePatterns;
+
+    /**
+     * @brief   The name of an ignore file (e.g., ".gitignore") whose rules apply to the folder it's in and below.
+     *
+     * @details Leave empty to not look for ignore files.
+     */
+    QString ignoreFileName;
+
+    /**
+     * @brief   The maximum number of files the pipeline reads ahead of the compressor.
+     */
+    int readAheadFiles = 32;
+
+    /**
+     * @brief   The maximum number of bytes the pipeline reads ahead of the compressor.
+     *
+     * @details A single file larger than this is still read, but nothing else is read ahead while it is queued.
+     */
+    qint64 readAheadBytes = 64 * 1024 * 1024;
+
+    /**
+     * @brief   The number of files the pipeline's reader keeps in flight at once (see BatchFileReader).
+     *
+     * @details Set to 1 to open and read one file at a time.
+     */
+    int readQueueDepth = 64;
+
+    /**
+     * @brief   Use io_uring for batched reads on Linux when the kernel supports it.
+     *
+     * @details If false, or io_uring isn't available, a pool of reader threads is used instead.
+     */
+    bool ioUring = true;
+
+    /**
+     * @brief   Memory-map input files of at least this many bytes instead of reading them into memory.
+     *
+     * @details Mapped files are compressed straight from the mapping, and the pages are dropped as the compressor
+     *          gets through them (see MappedFile). Smaller files are cheaper to read. Set to 0 to never map files.
+     */
+    qint64 mapThreshold = 4 * 1024 * 1024;
+
+    /**
+     * @brief   Keep the job from filling the page cache (see PageCache).
+     *
+     * @details Input files are dropped from the cache after they have been read, and the output is written back and
+     *          dropped as it goes, so large archive jobs don't evict other processes' cached data. Makes the job a
+     *          little slower, and re-reading the same files straight afterwards won't hit the cache.
+     */
+    bool bulkIo = false;
+
+    /**
+     * @brief   The memory budget the job's file data counts against, or null for MemoryGovernor::instance().
+     *
+     * @details Set the budget on the governor, e.g., MemoryGovernor::instance()->setBudget(), to limit every job
+     *          sharing it at once. Files there isn't room for are memory-mapped rather than read.
+     */
+    MemoryGovernor* memoryGovernor = nullptr;
+
+    /**
+     * @brief   Limit the rate the job reads its input (files when zipping, the archive when unzipping), or null.
+     *
+     * @details Give each job its own RateLimiter for a per-job ceiling, or share one between jobs of the same kind
+     *          for a combined one. The process-wide RateLimiter::reads() applies as well. A read limit makes the
+     *          pipeline read one file at a time.
+     */
+    std::shared_ptr<RateLimiter> readLimit;
+
+    /**
+     * @brief   Limit the rate the job writes its output (the archive when zipping, files when unzipping), or null.
+     *
+     * @details The process-wide RateLimiter::writes() applies as well.
+     */
+    std::shared_ptr<RateLimiter> writeLimit;
+
+    /**
+     * @brief   Run the job at background CPU and I/O priority.
+     *
+     * @details The pipeline's reader and writer threads are moved to the idle I/O class and nice 19, and compression
+     *          runs on ZipScheduler::backgroundInstance(), whose workers are too (see ThreadPriority). The calling
+     *          thread is left alone, as it couldn't get its priority back afterwards.
+     */
+    bool background = false;
+
+    /**
+     * @brief   Leave holes in extracted files where whole blocks are zero (see SparseFileWriter).
+     *
+     * @details Keeps sparse files sparse when they are unzipped, which saves disk writes and disk space. The extracted
+     *          files have the same contents either way.
+     */
+    bool sparseOutput = false;
+
+    /**
+     * @brief   Counters to report the job's progress to, and to cancel it with, or null.
+     *
+     * @details With progress set, a cancelled job stops at the next 1 MB chunk of input and deletes its partial
+     *          output (see ZipProgress and ZipJob).
+     */
+    std::shared_ptr<ZipProgress> progress;
+
+    /**
+     * @brief   Get the miniz level_and_flags value for mz_zip_writer_add_* calls.
+     */
+    mz_uint levelAndFlags() const {
+        return static_cast<mz_uint>(qBound(0, level, static_cast<int>(MZ_UBER_COMPRESSION))) | (lowMemory ? MZ_ZIP_FLAG_LOW_MEMORY : 0);
+    }
+
+    /**
+     * @brief   Get the memory governor to use for the job.
+     */
+    MemoryGovernor* governor() const {
+        return memoryGovernor ? memoryGovernor : MemoryGovernor::instance();
+    }
+
+    /**
+     * @brief   Get the scheduler to compress the job on.
+     */
+    ZipScheduler* scheduler() const {
+        if (compressionScheduler) {
+            return compressionScheduler;
+        }
+        return background ? ZipScheduler::backgroundInstance() : ZipScheduler::instance();
+    }
+
+    /**
+     * @brief   Wait until the job's read limits allow this many bytes.
+     *
+     * @return  False if the job was cancelled while waiting.
+     */
+    bool throttleRead(qint64 bytes) const {
+        return (!readLimit || readLimit->acquire(bytes, progress.get())) && RateLimiter::reads()->acquire(bytes, progress.get());
+    }
+
+    /**
+     * @brief   Wait until the job's write limits allow this many bytes.
+     *
+     * @return  False if the job was cancelled while waiting.
+     */
+    bool throttleWrite(qint64 bytes) const {
+        return (!writeLimit || writeLimit->acquire(bytes, progress.get())) && RateLimiter::writes()->acquire(bytes, progress.get());
+    }
+
+    /**
+     * @brief   Check whether the job's reads are rate limited.
+     */
+    bool readsLimited() const {
+        return (readLimit && readLimit->rate() > 0) || RateLimiter::reads()->rate() > 0;
+    }
+
+    /**
+     * @brief   Check whether the job's writes are rate limited.
+     */
+    bool writesLimited() const {
+        return (writeLimit && writeLimit->rate() > 0) || RateLimiter::writes()->rate() > 0;
+    }
+
+    /**
+     * @brief   Get the arena chunk size to use for the job.
+     */
+    size_t arenaChunkSize() const {
+        return lowMemory ? ZipArena::DefaultChunkSize / 4 : ZipArena::DefaultChunkSize;
+    }
+};
+
+#endif // ZIPOPTIONS_H
@@ -0,0 +1,367 @@
+#include "ZipPipeline.h"
+#include "ThreadPriority.h"
+#include "ZipLog.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// miniz's writes are coalesced into chunks of this size before being handed to the writer thread
+const int ChunkSize = 256 * 1024;
+
+// Number of chunks that can be waiting for the writer thread
+const size_t WriteQueueChunks = 16;
+
+}
+
+ZipPipeline::ZipPipeline(const ZipOptions& options) :
+    mOptions(options),
+    mReadQueue(static_cast<size_t>(options.readAheadFiles), static_cast<size_t>(options.readAheadBytes)),
+    mWriteQueue(WriteQueueChunks),
+    mDeflate(options),
+    mWriteFailed(false),
+    mWrittenEnd(0)
+{
+    mPending.offset = 0;
+}
+
+ZipPipeline::~ZipPipeline()
+{
+    stop();
+}
+
+bool ZipPipeline::open(mz_zip_archive* zip, const QString& zipFilename)
+{
+    mFile.setFileName(zipFilename);
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    zip->m_pWrite = writeFunc;
+    zip->m_pIO_opaque = this;
+    if (mOptions.bulkIo) {
+        mWriteBehind.reset(new PageCache::WriteBehind(mFile.handle()));
+    }
+
+    if (mOptions.pipelined) {
+        mWriter = std::thread(&ZipPipeline::writerLoop, this);
+    }
+    return true;
+}
+
+bool ZipPipeline::addEntries(mz_zip_archive* zip, const QVector<ZipEntry>& entries)
+{
+    int next = 0;
+    return addEntries(zip, [&](ZipEntry& entry) {
+        if (next >= entries.size()) {
+            return false;
+        }
+        entry = entries[next++];
+        return true;
+    });
+}
+
+bool ZipPipeline::addEntries(mz_zip_archive* zip, const ZipEntrySource& source)
+{
+    // The queue is left closed (or aborted) by the previous call
+    mReadQueue.reset();
+    if (mOptions.pipelined) {
+        mReader = std::thread(&ZipPipeline::readerLoop, this, std::cref(source));
+    }
+
+    bool ok = true;
+    for (;;) {
+        ReadItem item;
+        if (mOptions.pipelined) {
+            if (!mReadQueue.pop(item)) {
+                // Either the reader has finished or it gave up
+                ok = !mReadQueue.isAborted();
+                break;
+            }
+        } else {
+            if (!source(item.entry)) {
+                break;
+            }
+            item.contents = BatchFileReader::readFile(item.entry.sourcePath, mOptions.mapThreshold, mOptions.bulkIo, mOptions.governor());
+            if (mOptions.progress && item.contents.ok) {
+                mOptions.progress->addTotal(item.contents.size());
+            }
+            if (!item.contents.mapping && !mOptions.throttleRead(item.contents.size())) {
+                ok = false;
+                break;
+            }
+        }
+
+        const ZipEntry& entry = item.entry;
+        ZIP_LOG(ZipLog::TraceLevel) << "Writing" << entry.sourcePath;
+        if (!item.contents.ok) {
+            qWarning() << "Failed to open file" << entry.sourcePath << "for reading";
+            ok = false;
+            break;
+        }
+
+        // Compressed on the scheduler, the entries that have finished are added as we go
+        if (!mDeflate.add(zip, entry.archiveName, item.contents)) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && mDeflate.flush(zip);
+    if (!ok && mOptions.progress && mOptions.progress->isCanceled()) {
+        ZIP_LOG(ZipLog::DebugLevel) << "Zip cancelled";
+    }
+
+    // Stop the reader if we bailed out early
+    if (!ok) {
+        mReadQueue.abort();
+        mDeflate.abort();
+    }
+    if (mReader.joinable()) {
+        mReader.join();
+    }
+    return ok;
+}
+
+bool ZipPipeline::addFile(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents)
+{
+    return mDeflate.add(zip, archiveName, contents) && mDeflate.flush(zip);
+}
+
+bool ZipPipeline::close()
+{
+    bool ok = flushPending();
+    mWriteQueue.close();
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+    if (mWriteBehind) {
+        mFile.flush();
+        mWriteBehind->finish();
+        mWriteBehind.reset();
+    }
+    mFile.close();
+    return ok && !mWriteFailed;
+}
+
+bool ZipPipeline::addContents(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents, const ZipOptions& options)
+{
+    ZipProgress* progress = options.progress.get();
+    if (progress && progress->isCanceled()) {
+        return false;
+    }
+
+    // The callbacks make miniz compress in chunks, so only install them when there's something to do between chunks
+    EntryProgress entryProgress = {contents.mapping.get(), &options, progress, 0};
+    const bool stored = (options.levelAndFlags() & 0xF) == 0;
+    if (contents.mapping && stored && !options.throttleRead(contents.size())) {
+        // Stored entries are copied in one go without calling back, so their reads are limited up front
+        return false;
+    }
+    if (contents.mapping || progress) {
+        zip->m_pProgress = progressFunc;
+        zip->m_pProgress_opaque = &entryProgress;
+        if (contents.mapping && contents.mapping->isSparse()) {
+            zip->m_pZero_run = zeroRunMapped;
+        }
+    }
+    mz_bool result = mz_zip_writer_add_mem(zip, archiveName.toUtf8().constData(), contents.constData(), static_cast<size_t>(contents.size()), options.levelAndFlags());
+    zip->m_pProgress = nullptr;
+    zip->m_pProgress_opaque = nullptr;
+    zip->m_pZero_run = nullptr;
+
+    if (result && progress) {
+        progress->addBytes(static_cast<qint64>(static_cast<mz_uint64>(contents.size()) - entryProgress.bytesReported));
+        progress->addEntry();
+    }
+    return result;
+}
+
+mz_bool ZipPipeline::progressFunc(void* opaque, mz_uint64 bytesDone, mz_uint64)
+{
+    EntryProgress* entryProgress = static_cast<EntryProgress*>(opaque);
+    qint64 bytes = static_cast<qint64>(bytesDone - entryProgress->bytesReported);
+    entryProgress->bytesReported = bytesDone;
+
+    // A mapped file is read as it's compressed, so its reads are limited chunk by chunk here
+    if (entryProgress->mapping) {
+        entryProgress->mapping->release(static_cast<qint64>(bytesDone));
+        if (!entryProgress->options->throttleRead(bytes)) {
+            return MZ_FALSE;
+        }
+    }
+    if (entryProgress->progress) {
+        entryProgress->progress->addBytes(bytes);
+        return !entryProgress->progress->isCanceled();
+    }
+    return MZ_TRUE;
+}
+
+mz_uint64 ZipPipeline::zeroRunMapped(void* opaque, mz_uint64 offset, mz_uint64)
+{
+    return static_cast<mz_uint64>(static_cast<EntryProgress*>(opaque)->mapping->zeroRun(static_cast<qint64>(offset)));
+}
+
+void ZipPipeline::stop()
+{
+    mReadQueue.abort();
+    mWriteQueue.abort();
+    if (mReader.joinable()) {
+        mReader.join();
+    }
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+    if (mFile.isOpen()) {
+        mFile.close();
+    }
+}
+
+size_t ZipPipeline::writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size)
+{
+    ZipPipeline* pipeline = static_cast<ZipPipeline*>(opaque);
+    WriteChunk& pending = pipeline->mPending;
+    if (pipeline->mWriteFailed) {
+        return 0;
+    }
+
+    // Start a new chunk if this write isn't contiguous with the pending one (e.g., miniz seeking back to a header)
+    if (!pending.data.isEmpty() && offset != pending.offset + pending.data.size()) {
+        if (!pipeline->flushPending()) {
+            return 0;
+        }
+    }
+
+    const char* data = static_cast<const char*>(buffer);
+    size_t remaining = size;
+    while (remaining) {
+        if (pending.data.isEmpty()) {
+            pending.offset = offset;
+            pending.data.reserve(ChunkSize);
+        }
+
+        int count = static_cast<int>(std::min(remaining, static_cast<size_t>(ChunkSize - pending.data.size())));
+        pending.data.append(data, count);
+        data += count;
+        offset += count;
+        remaining -= count;
+
+        if (pending.data.size() >= ChunkSize && !pipeline->flushPending()) {
+            return 0;
+        }
+    }
+    return size;
+}
+
+bool ZipPipeline::flushPending()
+{
+    if (mPending.data.isEmpty()) {
+        return true;
+    }
+
+    WriteChunk chunk;
+    chunk.offset = mPending.offset;
+    chunk.data.swap(mPending.data);
+
+    if (mOptions.pipelined) {
+        return mWriteQueue.push(std::move(chunk)) && !mWriteFailed;
+    }
+    if (!writeChunk(chunk)) {
+        mWriteFailed = true;
+        return false;
+    }
+    return true;
+}
+
+bool ZipPipeline::writeChunk(const WriteChunk& chunk)
+{
+    // A cancelled job stops waiting, but the chunk is still written, the job fails further up
+    mOptions.throttleWrite(chunk.data.size());
+
+    if (mFile.pos() != static_cast<qint64>(chunk.offset) && !mFile.seek(static_cast<qint64>(chunk.offset))) {
+        return false;
+    }
+    if (mFile.write(chunk.data) != chunk.data.size()) {
+        return false;
+    }
+
+    // In bulk mode, push the data out to the OS so it can be written back and dropped behind us
+    if (mWriteBehind) {
+        mWrittenEnd = qMax(mWrittenEnd, static_cast<qint64>(chunk.offset) + chunk.data.size());
+        if (!mFile.flush()) {
+            return false;
+        }
+        mWriteBehind->written(mWrittenEnd);
+    }
+    return true;
+}
+
+void ZipPipeline::readerLoop(const ZipEntrySource& source)
+{
+    if (mOptions.background) {
+        ThreadPriority::setBackground();
+    }
+
+    BatchFileReader::Sink sink = [this](int, const ZipEntry& entry, FileContents& contents) {
+        if (mOptions.progress) {
+            if (mOptions.progress->isCanceled()) {
+                return false;
+            }
+            if (contents.ok) {
+                mOptions.progress->addTotal(contents.size());
+            }
+        }
+
+        // Mapped files are read as they're compressed, and limited there
+        if (!contents.mapping && !mOptions.throttleRead(contents.size())) {
+            return false;
+        }
+        ReadItem item;
+        item.entry = entry;
+        item.contents = std::move(contents);
+        size_t bytes = static_cast<size_t>(item.contents.size());
+        return mReadQueue.push(std::move(item), bytes);
+    };
+
+    // Batching reads is only there to go faster, so limited and background jobs read one file at a time
+    if (mOptions.readQueueDepth > 1 && !mOptions.readsLimited() && !mOptions.background) {
+        BatchFileReader reader(mOptions.readQueueDepth, mOptions.ioUring ? BatchFileReader::Auto : BatchFileReader::ThreadPool);
+        reader.setMapThreshold(mOptions.mapThreshold);
+        reader.setDropCache(mOptions.bulkIo);
+        reader.setMemoryGovernor(mOptions.governor());
+
+        // Stop the compressor too if the reader couldn't finish
+        if (reader.read(source, sink)) {
+            mReadQueue.close();
+        } else {
+            mReadQueue.abort();
+        }
+        return;
+    }
+
+    ZipEntry entry;
+    while (source(entry)) {
+        FileContents contents = BatchFileReader::readFile(entry.sourcePath, mOptions.mapThreshold, mOptions.bulkIo, mOptions.governor());
+        if (!sink(0, entry, contents)) {
+            mReadQueue.abort();
+            return;
+        }
+    }
+    mReadQueue.close();
+}
+
+void ZipPipeline::writerLoop()
+{
+    if (mOptions.background) {
+        ThreadPriority::setBackground();
+    }
+
+    WriteChunk chunk;
+    while (mWriteQueue.pop(chunk)) {
+        if (!writeChunk(chunk)) {
+            qWarning() << "Failed to write to zip file" << mFile.fileName();
+            mWriteFailed = true;
+            mWriteQueue.abort();
+            return;
+        }
+    }
+}
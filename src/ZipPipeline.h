@@ -0,0 +1,159 @@
+#ifndef ZIPPIPELINE_H
+#define ZIPPIPELINE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "BatchFileReader.h"
+#include "BoundedQueue.h"
+#include "PageCache.h"
+#include "ParallelDeflate.h"
+#include "ZipEntry.h"
+#include "ZipOptions.h"
+#include "miniz.h"
+
+/**
+ * @class   ZipPipeline
+ *
+ * @brief   Adds files to a zip archive using separate read, compress and write stages.
+ *
+ * @details A reader thread reads the upcoming files into memory, the calling thread compresses the current file,
+ *          and a writer thread writes the previous entries to the output file. The stages are connected with
+ *          bounded queues, so the read-ahead is limited by ZipOptions::readAheadFiles and readAheadBytes. This
+ *          overlaps disk and CPU time, which matters most on spinning disks and network drives. The writer is
+ *          installed on the archive as its m_pWrite function, miniz's writes are coalesced into larger chunks
+ *          before being handed over. If ZipOptions::pipelined is false, the same steps are run one after the other
+ *          on the calling thread.
+ *
+ *          The reader uses a BatchFileReader to keep ZipOptions::readQueueDepth files in flight at once, and the
+ *          compression itself is spread over the shared ZipScheduler workers by a ParallelDeflate. Reads and writes
+ *          are held to the job's rate limits (see RateLimiter), and with ZipOptions::background the reader and writer
+ *          threads run at background priority.
+ *
+ *          Usage: open, mz_zip_writer_init_v2, addEntries (as many times as needed), mz_zip_writer_finalize_archive,
+ *          mz_zip_writer_end, close.
+ */
+class ZipPipeline {
+public:
+    explicit ZipPipeline(const ZipOptions& options);
+    ~ZipPipeline();
+
+    ZipPipeline(const ZipPipeline&) = delete;
+    ZipPipeline& operator=(const ZipPipeline&) = delete;
+
+    /**
+     * @brief   Create the output file, start the writer thread and install the write function on the archive.
+     *
+     * @param   zip A pointer to the miniz zip archive object, before mz_zip_writer_init_v2 is called.
+     * @param   zipFilename The name of the zip file to create.
+     *
+     * @return  True if the output file was created, false otherwise.
+     */
+    bool open(mz_zip_archive* zip, const QString& zipFilename);
+
+    /**
+     * @brief   Read, compress and add a list of files to the archive.
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     * @param   entries The files to add, in the order they should appear in the archive.
+     *
+     * @return  True if all of the files were added, false otherwise.
+     */
+    bool addEntries(mz_zip_archive* zip, const QVector<ZipEntry>& entries);
+
+    /**
+     * @brief   Read, compress and add files to the archive as they are produced by a source.
+     *
+     * @details If the pipeline is enabled, the source is called from the reader thread.
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     * @param   source Called to get each file to add, in the order they should appear in the archive.
+     *
+     * @return  True if all of the files were added, false otherwise.
+     */
+    bool addEntries(mz_zip_archive* zip, const ZipEntrySource& source);
+
+    /**
+     * @brief   Compress and add a single file to the archive.
+     *
+     * @details Big files are still split into chunks that are compressed in parallel (see ParallelDeflate).
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     * @param   archiveName The name of the file inside the archive.
+     * @param   contents The contents of the file.
+     *
+     * @return  True if the file was added, false otherwise.
+     */
+    bool addFile(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents);
+
+    /**
+     * @brief   Flush any pending writes, stop the writer thread and close the output file.
+     *
+     * @details Call after mz_zip_writer_finalize_archive.
+     *
+     * @return  True if everything was written successfully, false otherwise.
+     */
+    bool close();
+
+    /**
+     * @brief   Compress a file's contents and add them to the archive.
+     *
+     * @details If the file is memory-mapped, the pages are released as the compressor gets through them, any holes
+     *          in a sparse file are compressed as zeros without reading the mapping, and the reads are held to the
+     *          job's read limits. If the job has progress, the bytes are counted after each chunk, and the add fails
+     *          at the next chunk once it has been cancelled.
+     *
+     * @param   zip A pointer to the miniz zip archive object.
+     * @param   archiveName The name of the file inside the archive.
+     * @param   contents The contents of the file.
+     * @param   options The job's options, for the level, progress and read limits.
+     *
+     * @return  True if the file was added, false otherwise.
+     */
+    static bool addContents(mz_zip_archive* zip, const QString& archiveName, const FileContents& contents, const ZipOptions& options);
+
+private:
+    struct ReadItem {
+        ZipEntry entry;
+        FileContents contents;
+    };
+
+    struct WriteChunk {
+        mz_uint64 offset;
+        QByteArray data;
+    };
+
+    // Passed to miniz's progress and zero run callbacks while an entry is compressed
+    struct EntryProgress {
+        MappedFile* mapping;
+        const ZipOptions* options;
+        ZipProgress* progress;
+        mz_uint64 bytesReported;
+    };
+
+    static mz_bool progressFunc(void* opaque, mz_uint64 bytesDone, mz_uint64 bytesTotal);
+    static mz_uint64 zeroRunMapped(void* opaque, mz_uint64 offset, mz_uint64 bytesTotal);
+    static size_t writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size);
+    bool writeChunk(const WriteChunk& chunk);
+    bool flushPending();
+    void readerLoop(const ZipEntrySource& source);
+    void writerLoop();
+    void stop();
+
+    ZipOptions mOptions;
+    QFile mFile;
+    BoundedQueue<ReadItem> mReadQueue;
+    BoundedQueue<WriteChunk> mWriteQueue;
+    std::thread mReader;
+    std::thread mWriter;
+    ParallelDeflate mDeflate;
+    std::atomic<bool> mWriteFailed;
+    WriteChunk mPending;
+    std::unique_ptr<PageCache::WriteBehind> mWriteBehind;
+    qint64 mWrittenEnd;
+};
+
+#endif // ZIPPIPELINE_H
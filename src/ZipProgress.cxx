@@ -0,0 +1,92 @@
+#include "ZipProgress.h"
+#include <chrono>
+
+namespace {
+
+qint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+ZipProgress::ZipProgress(Callback callback, int intervalMs) :
+    mCallback(std::move(callback)),
+    mIntervalNs(static_cast<qint64>(intervalMs) * 1000000),
+    mBytesDone(0),
+    mBytesTotal(0),
+    mEntriesDone(0),
+    mEntriesTotal(0),
+    mTotalsFixed(false),
+    mCanceled(false),
+    mLastNotify(0)
+{
+}
+
+void ZipProgress::setTotals(qint64 bytes, int entries)
+{
+    mBytesTotal = bytes;
+    mEntriesTotal = entries;
+    mTotalsFixed = true;
+    update();
+}
+
+void ZipProgress::addTotal(qint64 bytes)
+{
+    if (mTotalsFixed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    mBytesTotal.fetch_add(bytes, std::memory_order_relaxed);
+    mEntriesTotal.fetch_add(1, std::memory_order_relaxed);
+    update();
+}
+
+void ZipProgress::addBytes(qint64 bytes)
+{
+    mBytesDone.fetch_add(bytes, std::memory_order_relaxed);
+    update();
+}
+
+void ZipProgress::addEntry()
+{
+    mEntriesDone.fetch_add(1, std::memory_order_relaxed);
+    update();
+}
+
+void ZipProgress::cancel()
+{
+    mCanceled = true;
+}
+
+ZipProgress::Snapshot ZipProgress::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.bytesDone = mBytesDone.load(std::memory_order_relaxed);
+    snapshot.bytesTotal = mBytesTotal.load(std::memory_order_relaxed);
+    snapshot.entriesDone = mEntriesDone.load(std::memory_order_relaxed);
+    snapshot.entriesTotal = mEntriesTotal.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void ZipProgress::notify()
+{
+    mLastNotify = nowNs();
+    if (mCallback) {
+        mCallback(snapshot());
+    }
+}
+
+void ZipProgress::update()
+{
+    if (!mCallback) {
+        return;
+    }
+
+    // Only the thread that moves the timestamp on gets to call back, so the callback rate stays bounded
+    qint64 now = nowNs();
+    qint64 last = mLastNotify.load(std::memory_order_relaxed);
+    if (now - last < mIntervalNs || !mLastNotify.compare_exchange_strong(last, now)) {
+        return;
+    }
+    mCallback(snapshot());
+}
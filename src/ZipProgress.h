@@ -0,0 +1,101 @@
+#ifndef ZIPPROGRESS_H
+#define ZIPPROGRESS_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <functional>
+
+/**
+ * @class   ZipProgress
+ *
+ * @brief   Thread-safe progress counters and cancel flag for a zip or unzip job.
+ *
+ * @details Set ZipOptions::progress to have a job count the bytes and entries it has processed. The counters are
+ *          updated from whichever threads do the work (the pipeline's reader counts the totals as files are read, the
+ *          compressor counts the bytes done after each 1 MB chunk), and the callback is called with a snapshot at most
+ *          once per interval, so it can be used to drive a progress bar directly. The callback is called on one of
+ *          the job's threads.
+ *
+ *          When zipping a folder the totals keep growing while the folder is being walked, for the other jobs they
+ *          are set up front. Calling cancel makes the job stop at the next chunk (or entry) and fail.
+ */
+class ZipProgress {
+public:
+    /**
+     * @brief   The state of the counters at one point in time.
+     */
+    struct Snapshot {
+        qint64 bytesDone = 0;
+        qint64 bytesTotal = 0;
+        int entriesDone = 0;
+        int entriesTotal = 0;
+    };
+
+    typedef std::function<void(const Snapshot& snapshot)> Callback;
+
+    /**
+     * @brief   Create a set of counters.
+     *
+     * @param   callback Called with the counters as they change, or empty to just poll with snapshot.
+     * @param   intervalMs The minimum time between calls to the callback in milliseconds.
+     */
+    explicit ZipProgress(Callback callback = Callback(), int intervalMs = 100);
+
+    ZipProgress(const ZipProgress&) = delete;
+    ZipProgress& operator=(const ZipProgress&) = delete;
+
+    /**
+     * @brief   Set the totals for the whole job when they are known up front, later calls to addTotal are ignored.
+     */
+    void setTotals(qint64 bytes, int entries);
+
+    /**
+     * @brief   Add an entry of the given size to the totals, unless they have been set with setTotals.
+     */
+    void addTotal(qint64 bytes);
+
+    /**
+     * @brief   Count bytes of input processed.
+     */
+    void addBytes(qint64 bytes);
+
+    /**
+     * @brief   Count an entry as finished.
+     */
+    void addEntry();
+
+    /**
+     * @brief   Ask the job to stop as soon as possible.
+     */
+    void cancel();
+
+    /**
+     * @brief   Check whether the job has been asked to stop.
+     */
+    bool isCanceled() const { return mCanceled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief   Get the current counters.
+     */
+    Snapshot snapshot() const;
+
+    /**
+     * @brief   Call the callback now, whenever it was last called (e.g., when the job has finished).
+     */
+    void notify();
+
+private:
+    void update();
+
+    Callback mCallback;
+    const qint64 mIntervalNs;
+    std::atomic<qint64> mBytesDone;
+    std::atomic<qint64> mBytesTotal;
+    std::atomic<int> mEntriesDone;
+    std::atomic<int> mEntriesTotal;
+    std::atomic<bool> mTotalsFixed;
+    std::atomic<bool> mCanceled;
+    std::atomic<qint64> mLastNotify;
+};
+
+#endif // ZIPPROGRESS_H
@@ -0,0 +1,315 @@
+#include "ZipReader.h"
+#include "SparseFileWriter.h"
+#include "ZipArena.h"
+#include "ZipLog.h"
+#include "ZipStatePool.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <climits>
+#include <cstring>
+
+// The archive must stay at a fixed address while it's open, and the arena must outlive it
+struct ZipReader::State {
+    explicit State(const ZipOptions& options) :
+        options(options),
+        arena(options.arenaChunkSize(), options.hugePages)
+    {
+        memset(&zip, 0, sizeof(zip));
+        arena.install(&zip);
+    }
+
+    ZipOptions options;
+    QString filename;
+    ZipArena arena;
+    mz_zip_archive zip;
+    mz_file_read_func fileRead = nullptr;
+    bool open = false;
+};
+
+ZipReader::ZipReader(const ZipOptions& options) :
+    mOptions(options)
+{
+}
+
+ZipReader::~ZipReader()
+{
+    close();
+}
+
+ZipReader::ZipReader(ZipReader&& other) :
+    mOptions(other.mOptions),
+    mState(std::move(other.mState))
+{
+}
+
+ZipReader& ZipReader::operator=(ZipReader&& other)
+{
+    if (this != &other) {
+        close();
+        mOptions = other.mOptions;
+        mState = std::move(other.mState);
+    }
+    return *this;
+}
+
+bool ZipReader::open(const QString& zipFilename)
+{
+    close();
+
+    mState.reset(new State(mOptions));
+    mState->filename = zipFilename;
+    attach();
+    if (!mz_zip_reader_init_file(&mState->zip, zipFilename.toUtf8().constData(), 0)) {
+        qWarning() << "Failed to open zip file" << zipFilename;
+        return false;
+    }
+
+    // Reads of the archive go through the job's rate limits, then on to miniz's own read function
+    mState->fileRead = mState->zip.m_pRead;
+    mState->zip.m_pRead = readFunc;
+    mState->zip.m_pIO_opaque = mState.get();
+    mState->open = true;
+    return true;
+}
+
+bool ZipReader::isOpen() const
+{
+    return mState && mState->open;
+}
+
+void ZipReader::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    mState->open = false;
+    mz_zip_reader_end(&mState->zip);
+}
+
+int ZipReader::count() const
+{
+    return isOpen() ? static_cast<int>(mz_zip_reader_get_num_files(&mState->zip)) : 0;
+}
+
+bool ZipReader::stat(int index, mz_zip_archive_file_stat& fileStat) const
+{
+    return isOpen() && index >= 0 && mz_zip_reader_file_stat(&mState->zip, static_cast<mz_uint>(index), &fileStat);
+}
+
+int ZipReader::indexOf(const QString& archiveName) const
+{
+    mz_uint32 index;
+    if (!isOpen() || !mz_zip_reader_locate_file_v2(&mState->zip, archiveName.toUtf8().constData(), nullptr, 0, &index)) {
+        return -1;
+    }
+    return static_cast<int>(index);
+}
+
+bool ZipReader::isZip64() const
+{
+    return isOpen() && mz_zip_is_zip64(&mState->zip);
+}
+
+bool ZipReader::verify(int index)
+{
+    if (!isOpen() || index < 0) {
+        return false;
+    }
+    attach();
+    return mz_zip_validate_file(&mState->zip, static_cast<mz_uint>(index), 0);
+}
+
+bool ZipReader::extract(int index, QByteArray& data)
+{
+    mz_zip_archive_file_stat fileStat;
+    if (!stat(index, fileStat)) {
+        return false;
+    }
+    if (fileStat.m_uncomp_size > static_cast<mz_uint64>(INT_MAX)) {
+        qWarning() << "File" << fileStat.m_filename << "is too big to extract to memory";
+        return false;
+    }
+
+    // Shrinking a QByteArray keeps its capacity, so a buffer that's reused for each file soon stops allocating
+    attach();
+    data.resize(static_cast<int>(fileStat.m_uncomp_size));
+    if (mOptions.progress) {
+        mOptions.progress->addTotal(data.size());
+        Sink sink = {nullptr, nullptr, data.data(), fileStat.m_uncomp_size, mOptions.progress.get(), &mOptions};
+        return extractWithCallback(fileStat, sink);
+    }
+    return mz_zip_reader_extract_to_mem_no_alloc(&mState->zip, fileStat.m_file_index, data.data(), static_cast<size_t>(data.size()), 0, nullptr, 0);
+}
+
+bool ZipReader::extractToFile(int index, const QString& outFile)
+{
+    mz_zip_archive_file_stat fileStat;
+    if (!stat(index, fileStat)) {
+        return false;
+    }
+    if (mOptions.progress) {
+        mOptions.progress->addTotal(static_cast<qint64>(fileStat.m_uncomp_size));
+    }
+    return extractToFile(fileStat, outFile);
+}
+
+bool ZipReader::extractAll(const QString& outputFolder)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    // The sizes are all in the central directory, so the totals are known before starting
+    int numFiles = count();
+    ZIP_LOG(ZipLog::DebugLevel) << "Zip file contains" << numFiles << "files";
+    if (mOptions.progress) {
+        qint64 totalSize = 0;
+        for (int i = 0; i < numFiles; i++) {
+            mz_zip_archive_file_stat fileStat;
+            if (stat(i, fileStat)) {
+                totalSize += static_cast<qint64>(fileStat.m_uncomp_size);
+            }
+        }
+        mOptions.progress->setTotals(totalSize, numFiles);
+    }
+
+    // Extract each file in the zip archive
+    QStringList extracted;
+    for (int i = 0; i < numFiles; i++) {
+        mz_zip_archive_file_stat fileStat;
+        if (!stat(i, fileStat)) {
+            qWarning() << "Failed to get file info for file" << i << "in zip file" << mState->filename;
+            return false;
+        }
+
+        QString filename = QString::fromUtf8(fileStat.m_filename);
+        ZIP_LOG(ZipLog::TraceLevel) << "Extracting" << filename;
+        QString outFile = outputFolder + "/" + filename;
+        if (!extractToFile(fileStat, outFile)) {
+            if (mOptions.progress && mOptions.progress->isCanceled()) {
+                ZIP_LOG(ZipLog::DebugLevel) << "Unzip cancelled, removing" << extracted.size() << "extracted files";
+                for (const auto& file : extracted) {
+                    QFile::remove(file);
+                }
+            } else {
+                qWarning() << "Failed to extract file" << filename << "from zip file" << mState->filename;
+            }
+            return false;
+        }
+        extracted.append(outFile);
+    }
+    return true;
+}
+
+size_t ZipReader::peakMemory() const
+{
+    return mState ? mState->arena.peakBytesReserved() : 0;
+}
+
+bool ZipReader::extractToFile(const mz_zip_archive_file_stat& fileStat, const QString& outFile)
+{
+    if (mOptions.progress && mOptions.progress->isCanceled()) {
+        return false;
+    }
+    if (!QDir().mkpath(QFileInfo(outFile).path())) {
+        qWarning() << "Failed to create directory for file" << outFile;
+        return false;
+    }
+    attach();
+    if (!mOptions.sparseOutput && !mOptions.progress && !mOptions.writesLimited()) {
+        return mz_zip_reader_extract_to_file(&mState->zip, fileStat.m_file_index, outFile.toUtf8().constData(), 0);
+    }
+
+    // Go through the write callback to leave holes, count the bytes, limit the rate or be able to stop part way
+    SparseFileWriter sparse;
+    QFile file(outFile);
+    Sink sink = {nullptr, nullptr, nullptr, 0, mOptions.progress.get(), &mOptions};
+    bool ok;
+    if (mOptions.sparseOutput) {
+        sink.sparse = &sparse;
+        ok = sparse.open(outFile) && extractWithCallback(fileStat, sink);
+        ok = sparse.close() && ok;
+        if (ok && sparse.holeBytes()) {
+            ZIP_LOG(ZipLog::TraceLevel) << "Left" << sparse.holeBytes() << "bytes of holes in" << outFile;
+        }
+    } else {
+        sink.file = &file;
+        ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate) && extractWithCallback(fileStat, sink);
+        file.close();
+    }
+    if (!ok) {
+        QFile::remove(outFile);
+        return false;
+    }
+
+    // Keep the modification time, as mz_zip_reader_extract_to_file does
+    if (file.open(QIODevice::ReadWrite)) {
+        QDateTime time = QDateTime::fromSecsSinceEpoch(static_cast<qint64>(fileStat.m_time));
+        file.setFileTime(time, QFileDevice::FileAccessTime);
+        file.setFileTime(time, QFileDevice::FileModificationTime);
+    }
+    return true;
+}
+
+bool ZipReader::extractWithCallback(const mz_zip_archive_file_stat& fileStat, Sink& sink)
+{
+    if (!mz_zip_reader_extract_to_callback(&mState->zip, fileStat.m_file_index, writeFunc, &sink, 0)) {
+        return false;
+    }
+    if (sink.progress) {
+        sink.progress->addEntry();
+    }
+    return true;
+}
+
+size_t ZipReader::writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size)
+{
+    // Returning less than size makes miniz give up on the file
+    Sink* sink = static_cast<Sink*>(opaque);
+    if (sink->progress && sink->progress->isCanceled()) {
+        return 0;
+    }
+
+    // Written data is counted whether or not it ends up as holes, extracting to memory isn't counted at all
+    if ((sink->sparse || sink->file) && !sink->options->throttleWrite(static_cast<qint64>(size))) {
+        return 0;
+    }
+
+    size_t written = 0;
+    if (sink->sparse) {
+        written = SparseFileWriter::writeFunc(sink->sparse, offset, buffer, size);
+    } else if (sink->file) {
+        written = sink->file->write(static_cast<const char*>(buffer), static_cast<qint64>(size)) == static_cast<qint64>(size) ? size : 0;
+    } else if (offset + size <= sink->bufferSize) {
+        memcpy(sink->buffer + offset, buffer, size);
+        written = size;
+    }
+    if (sink->progress) {
+        sink->progress->addBytes(static_cast<qint64>(written));
+    }
+    return written;
+}
+
+size_t ZipReader::readFunc(void* opaque, mz_uint64 offset, void* buffer, size_t size)
+{
+    State* state = static_cast<State*>(opaque);
+    if (!state->options.throttleRead(static_cast<qint64>(size))) {
+        return 0;
+    }
+    return state->fileRead(&state->zip, offset, buffer, size);
+}
+
+mz_zip_archive* ZipReader::archive() const
+{
+    return &mState->zip;
+}
+
+void ZipReader::attach() const
+{
+    // The buffers belong to whichever thread is making the call
+    ZipStatePool::attach(&mState->zip, mOptions.hugePages);
+}
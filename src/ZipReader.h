@@ -0,0 +1,166 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <memory>
+#include "miniz.h"
+#include "ZipOptions.h"
+
+class QFile;
+class SparseFileWriter;
+
+/**
+ * @class   ZipReader
+ *
+ * @brief   A zip archive that stays open while files are read from it.
+ *
+ * @details Opening an archive reads and sorts its whole central directory, so reading files one at a time with the
+ *          static SimpleZipper functions pays that cost every time. A ZipReader opens the archive once, and then
+ *          looks files up by name with a binary search and extracts them to memory or disk as needed. extract reuses
+ *          the memory of the QByteArray it is given, so reading lots of files into the same buffer doesn't allocate
+ *          for each one. The decompressor, dictionary and read buffer come from the ZipStatePool.
+ *
+ *          Threading: a ZipReader must only be used by one thread at a time, but it doesn't have to be the same
+ *          thread each time. Each call attaches the calling thread's ZipStatePool buffers for the duration of the
+ *          call. To read one archive from several threads at once, give each thread its own ZipReader. ZipReaders
+ *          can be moved but not copied, a moved-from ZipReader is closed.
+ */
+class ZipReader {
+public:
+    /**
+     * @brief   Create a reader.
+     *
+     * @param   options The options for reading, e.g., sparse output files.
+     */
+    explicit ZipReader(const ZipOptions& options = ZipOptions());
+    ~ZipReader();
+
+    ZipReader(ZipReader&& other);
+    ZipReader& operator=(ZipReader&& other);
+    ZipReader(const ZipReader&) = delete;
+    ZipReader& operator=(const ZipReader&) = delete;
+
+    /**
+     * @brief   Open a zip file, closing any archive that is already open.
+     *
+     * @param   zipFilename The name of the zip file to open.
+     *
+     * @return  True if the zip file was opened, false otherwise.
+     */
+    bool open(const QString& zipFilename);
+
+    /**
+     * @brief   Check whether an archive is open.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief   Close the zip file.
+     */
+    void close();
+
+    /**
+     * @brief   Get the number of files in the archive.
+     */
+    int count() const;
+
+    /**
+     * @brief   Get the miniz file information for a file in the archive.
+     *
+     * @param   index The index of the file.
+     * @param   fileStat Set to the file information.
+     *
+     * @return  True if the index was valid, false otherwise.
+     */
+    bool stat(int index, mz_zip_archive_file_stat& fileStat) const;
+
+    /**
+     * @brief   Find a file in the archive by name.
+     *
+     * @param   archiveName The name of the file inside the archive.
+     *
+     * @return  The index of the file, or -1 if there isn't one with that name.
+     */
+    int indexOf(const QString& archiveName) const;
+
+    /**
+     * @brief   Check whether the archive uses the zip64 format.
+     */
+    bool isZip64() const;
+
+    /**
+     * @brief   Check a file's headers and CRC-32 by decompressing it without keeping the output.
+     *
+     * @param   index The index of the file.
+     *
+     * @return  True if the file is intact, false otherwise.
+     */
+    bool verify(int index);
+
+    /**
+     * @brief   Extract a file into memory.
+     *
+     * @param   index The index of the file.
+     * @param   data Resized to the size of the file and filled with its contents. Its existing memory is reused when
+     *          it is big enough.
+     *
+     * @return  True if the file was extracted and its CRC-32 checked, false otherwise.
+     */
+    bool extract(int index, QByteArray& data);
+
+    /**
+     * @brief   Extract a file to disk, creating its folder if needed.
+     *
+     * @details If ZipOptions::sparseOutput is set, whole blocks of zeros are left as holes (see SparseFileWriter).
+     *          If the job is cancelled through ZipOptions::progress, the partly written file is deleted.
+     *
+     * @param   index The index of the file.
+     * @param   outFile The name of the file to create.
+     *
+     * @return  True if the file was extracted, false otherwise.
+     */
+    bool extractToFile(int index, const QString& outFile);
+
+    /**
+     * @brief   Extract every file in the archive into a folder, keeping the folder structure.
+     *
+     * @details If the job is cancelled through ZipOptions::progress, the files extracted so far are deleted.
+     *
+     * @param   outputFolder The name of the folder to extract to.
+     *
+     * @return  True if every file was extracted, false otherwise.
+     */
+    bool extractAll(const QString& outputFolder);
+
+    /**
+     * @brief   Get the peak memory reserved by the current (or last) archive's arena in bytes.
+     */
+    size_t peakMemory() const;
+
+private:
+    friend class ZipWriter;
+    struct State;
+
+    // Where extractWithCallback sends the data, exactly one of sparse, file and buffer is set
+    struct Sink {
+        SparseFileWriter* sparse;
+        QFile* file;
+        char* buffer;
+        mz_uint64 bufferSize;
+        ZipProgress* progress;
+        const ZipOptions* options;
+    };
+
+    mz_zip_archive* archive() const;
+    bool extractWithCallback(const mz_zip_archive_file_stat& fileStat, Sink& sink);
+    bool extractToFile(const mz_zip_archive_file_stat& fileStat, const QString& outFile);
+    static size_t writeFunc(void* opaque, mz_uint64 offset, const void* buffer, size_t size);
+    static size_t readFunc(void* opaque, mz_uint64 offset, void* buffer, size_t size);
+    void attach() const;
+
+    ZipOptions mOptions;
+    std::unique_ptr<State> mState;
+};
+
+#endif // ZIPREADER_H
@@ -0,0 +1,303 @@
+#include "ZipScheduler.h"
+#include "CpuCount.h"
+#include "NumaTopology.h"
+#include "ThreadPriority.h"
+#include "miniz.h"
+#include <algorithm>
+
+namespace {
+
+// How many tasks a worker takes from a group at once, the rest of the batch can be stolen
+const int BatchSize = 4;
+
+// How far down a group's queue a worker looks for a task on its own node before taking the first one
+const size_t NodeLookahead = 8;
+
+// The scheduler and worker the calling thread belongs to, if it is a worker
+thread_local const ZipScheduler* currentScheduler = nullptr;
+thread_local int currentWorker = -1;
+
+double weightFor(ZipScheduler::Priority priority)
+{
+    switch (priority) {
+    case ZipScheduler::HighPriority:
+        return 4.0;
+    case ZipScheduler::LowPriority:
+        return 1.0;
+    default:
+        return 2.0;
+    }
+}
+
+// The first task near the front of the queue that is on the node or doesn't mind, or else the front one
+template <typename Queue>
+typename Queue::iterator pickForNode(Queue& queue, int node, int nodeCount)
+{
+    if (nodeCount > 1) {
+        typename Queue::iterator end = queue.begin() + static_cast<std::ptrdiff_t>(std::min(queue.size(), NodeLookahead));
+        for (typename Queue::iterator it = queue.begin(); it != end; ++it) {
+            if (it->node < 0 || it->node == node) {
+                return it;
+            }
+        }
+    }
+    return queue.begin();
+}
+
+}
+
+ZipScheduler::Group::Group(Priority priority) :
+    mPriority(priority),
+    mWeight(weightFor(priority)),
+    mPass(0),
+    mOutstanding(0)
+{
+}
+
+ZipScheduler::ZipScheduler(int workers, bool background, bool numaPlacement) :
+    mVirtualTime(0),
+    mLocalTasks(0),
+    mTaskCount(0),
+    mStealCount(0),
+    mNodeLocalCount(0),
+    mNodeRemoteCount(0),
+    mNodeCount(numaPlacement ? NumaTopology::instance().nodeCount() : 1),
+    mBackground(background),
+    mStopping(false)
+{
+    if (workers <= 0) {
+        workers = CpuCount::available();
+    }
+
+    // Spread the workers over the nodes in proportion to the cores the process has on each
+    std::vector<int> cpuNodes;
+    for (int node = 0; node < mNodeCount; node++) {
+        cpuNodes.insert(cpuNodes.end(), NumaTopology::instance().node(node).cpus.size(), node);
+    }
+    for (int i = 0; i < workers; i++) {
+        mWorkers.emplace_back(new Worker);
+        if (mNodeCount > 1) {
+            mWorkers[i]->node = cpuNodes[static_cast<size_t>(i) * cpuNodes.size() / static_cast<size_t>(workers)];
+        }
+    }
+
+    // Pick miniz's CPU kernels now, rather than every worker doing it at once on its first task
+    mz_cpu_get_level();
+    for (int i = 0; i < workers; i++) {
+        mWorkers[i]->thread = std::thread(&ZipScheduler::workerLoop, this, i);
+    }
+}
+
+ZipScheduler::~ZipScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkCondition.notify_all();
+    for (std::unique_ptr<Worker>& worker : mWorkers) {
+        worker->thread.join();
+    }
+}
+
+ZipScheduler* ZipScheduler::instance()
+{
+    // Started on first use and stopped at exit, by which time the jobs have finished
+    static ZipScheduler scheduler;
+    return &scheduler;
+}
+
+ZipScheduler* ZipScheduler::backgroundInstance()
+{
+    static ZipScheduler scheduler(0, true);
+    return &scheduler;
+}
+
+ZipScheduler::GroupPtr ZipScheduler::createGroup(Priority priority)
+{
+    return GroupPtr(new Group(priority));
+}
+
+void ZipScheduler::submit(const GroupPtr& group, Task task, qint64 cost, int node)
+{
+    int nodeIndex = mNodeCount > 1 && node >= 0 ? NumaTopology::instance().indexOf(node) : -1;
+    Item item = {std::move(task), group, qMax<qint64>(cost, 1), nodeIndex};
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        group->mOutstanding++;
+
+        if (currentScheduler == this) {
+            // Spawned by a task, so keep it on this worker where its data is likely still in cache
+            charge(*group, item.cost);
+            Worker& worker = *mWorkers[currentWorker];
+            std::lock_guard<std::mutex> workerLock(worker.mutex);
+            worker.tasks.push_front(std::move(item));
+            mLocalTasks++;
+        } else {
+            if (group->mQueue.empty()) {
+                // Rejoin at the current virtual time, so an idle group can't bank credit and a new one isn't behind
+                group->mPass = std::max(group->mPass, mVirtualTime);
+                mActive.push_back(group.get());
+            }
+            group->mQueue.push_back(std::move(item));
+        }
+    }
+    mWorkCondition.notify_one();
+}
+
+void ZipScheduler::wait(const GroupPtr& group)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdleCondition.wait(lock, [&group] { return group->mOutstanding == 0; });
+}
+
+int ZipScheduler::workerCount() const
+{
+    return static_cast<int>(mWorkers.size());
+}
+
+int ZipScheduler::nodeCount() const
+{
+    return mNodeCount;
+}
+
+ZipScheduler::Stats ZipScheduler::stats() const
+{
+    Stats stats;
+    stats.tasks = mTaskCount;
+    stats.steals = mStealCount;
+    stats.nodes = mNodeCount;
+    stats.nodeLocal = mNodeLocalCount;
+    stats.nodeRemote = mNodeRemoteCount;
+    return stats;
+}
+
+void ZipScheduler::workerLoop(int index)
+{
+    currentScheduler = this;
+    currentWorker = index;
+    Worker& worker = *mWorkers[index];
+    if (mBackground) {
+        ThreadPriority::setBackground();
+    }
+    if (mNodeCount > 1) {
+        // Pinned before the worker allocates anything, so its compressor state is first touched on its own node
+        NumaTopology::instance().pinToNode(worker.node);
+    }
+
+    for (;;) {
+        Item item;
+        if (!takeLocal(worker, item) && !takeFromGroups(worker, item) && !steal(index, item)) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mActive.empty() && mLocalTasks == 0) {
+                if (mStopping) {
+                    return;
+                }
+                mWorkCondition.wait(lock);
+            }
+            continue;
+        }
+
+        if (item.node >= 0) {
+            (item.node == worker.node ? mNodeLocalCount : mNodeRemoteCount)++;
+        }
+        item.task();
+        mTaskCount++;
+        finished(*item.group);
+    }
+}
+
+bool ZipScheduler::takeLocal(Worker& worker, Item& item)
+{
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    item = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    mLocalTasks--;
+    return true;
+}
+
+bool ZipScheduler::takeFromGroups(Worker& worker, Item& item)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mActive.empty()) {
+        return false;
+    }
+
+    // The group that is furthest behind its share goes next
+    std::vector<Group*>::iterator next = std::min_element(mActive.begin(), mActive.end(), [](const Group* a, const Group* b) {
+        return a->mPass < b->mPass;
+    });
+    Group& group = **next;
+    mVirtualTime = std::max(mVirtualTime, group.mPass);
+
+    std::deque<Item>::iterator first = pickForNode(group.mQueue, worker.node, mNodeCount);
+    item = std::move(*first);
+    group.mQueue.erase(first);
+    charge(group, item.cost);
+
+    // Take a few more while we're here, they wait on this worker's deque where idle workers can steal them
+    int batch = std::min(BatchSize - 1, static_cast<int>(group.mQueue.size()) / workerCount());
+    if (batch > 0) {
+        std::lock_guard<std::mutex> workerLock(worker.mutex);
+        for (int i = 0; i < batch; i++) {
+            std::deque<Item>::iterator next = pickForNode(group.mQueue, worker.node, mNodeCount);
+            charge(group, next->cost);
+            worker.tasks.push_back(std::move(*next));
+            group.mQueue.erase(next);
+            mLocalTasks++;
+        }
+
+        // Only one worker was woken for this group's work, the others can steal the batch
+        mWorkCondition.notify_all();
+    }
+
+    if (group.mQueue.empty()) {
+        mActive.erase(next);
+    }
+    return true;
+}
+
+bool ZipScheduler::steal(int index, Item& item)
+{
+    if (mLocalTasks == 0) {
+        return false;
+    }
+
+    // Take from the far end of the first busy worker after this one, away from where its owner is working. Workers
+    // on the same node go first, as their tasks' input is likely to be on this node too.
+    int count = workerCount();
+    int node = mWorkers[index]->node;
+    for (int pass = mNodeCount > 1 ? 0 : 1; pass < 2; pass++) {
+        for (int i = 1; i < count; i++) {
+            Worker& victim = *mWorkers[(index + i) % count];
+            if (pass == 0 && victim.node != node) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                item = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                mLocalTasks--;
+                mStealCount++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ZipScheduler::charge(Group& group, qint64 cost)
+{
+    group.mPass += static_cast<double>(cost) / group.mWeight;
+}
+
+void ZipScheduler::finished(Group& group)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (--group.mOutstanding == 0) {
+        mIdleCondition.notify_all();
+    }
+}
@@ -0,0 +1,204 @@
+#ifndef ZIPSCHEDULER_H
+#define ZIPSCHEDULER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class   ZipScheduler
+ *
+ * @brief   A work-stealing thread pool shared by every zip job in the process.
+ *
+ * @details Compression is split into tasks (one per entry, or one per chunk of a big file, see ParallelDeflate) that
+ *          run on a fixed set of worker threads, one per core, however many jobs are running. So ten jobs at once
+ *          use the same number of compression threads as one, instead of each bringing its own.
+ *
+ *          Each job gets a Group, and tasks are submitted to the group's queue. An idle worker takes a few tasks at
+ *          a time from the group that has had the least CPU time for its weight (stride scheduling, the weight
+ *          comes from the job's Priority and the charge from each task's cost in bytes) and keeps them in its own
+ *          deque. Other idle workers steal from the far end of that deque, and tasks submitted from inside a task go
+ *          straight onto the worker's own deque. A group that has been idle starts again at the current virtual
+ *          time rather than where it left off, so a small job that turns up while a giant one is running gets its
+ *          share straight away instead of waiting behind the giant job's queue, and can't bank credit while idle.
+ *
+ *          On a NUMA machine each worker is pinned to the cores of one node (see NumaTopology), so its compressor
+ *          state and output land in that node's memory. A task can say which node its input is on, and a worker
+ *          looks a little way down the group's queue for a task on its own node, and steals from workers on its own
+ *          node first. It's a preference rather than a rule, so a job whose input is all on one node still uses
+ *          every worker.
+ *
+ *          Background jobs (ZipOptions::background) use a second scheduler, backgroundInstance(), whose workers run
+ *          at background priority (see ThreadPriority), so they only get the CPU time other processes leave.
+ *
+ *          Tasks must not block waiting for other tasks (the workers don't help while waiting), the jobs wait for
+ *          their results on their own threads.
+ */
+class ZipScheduler {
+public:
+    /**
+     * @brief   A job's share of the workers, High gets four times the CPU time of Low when both are busy.
+     */
+    enum Priority {
+        LowPriority,
+        NormalPriority,
+        HighPriority
+    };
+
+    typedef std::function<void()> Task;
+
+    /**
+     * @brief   Counters for the whole scheduler.
+     */
+    struct Stats {
+        quint64 tasks = 0;
+        quint64 steals = 0;
+        int nodes = 1;              ///< The NUMA nodes the workers are spread over
+        quint64 nodeLocal = 0;      ///< Tasks with a node that ran on a worker on that node
+        quint64 nodeRemote = 0;     ///< Tasks with a node that ran on a worker on another node
+    };
+
+    class Group;
+    typedef std::shared_ptr<Group> GroupPtr;
+
+    /**
+     * @brief   Start a scheduler with its own workers.
+     *
+     * @param   workers The number of worker threads, or 0 for one per core the process can use (see CpuCount).
+     * @param   background Run the workers at background priority.
+     * @param   numaPlacement Spread the workers over the NUMA nodes and pin them there, if there's more than one.
+     */
+    explicit ZipScheduler(int workers = 0, bool background = false, bool numaPlacement = true);
+
+    /**
+     * @brief   Stop the workers, waiting for the tasks that are already queued.
+     */
+    ~ZipScheduler();
+
+    ZipScheduler(const ZipScheduler&) = delete;
+    ZipScheduler& operator=(const ZipScheduler&) = delete;
+
+    /**
+     * @brief   Get the process-wide scheduler, starting it the first time.
+     */
+    static ZipScheduler* instance();
+
+    /**
+     * @brief   Get the process-wide scheduler for background jobs, starting it the first time.
+     */
+    static ZipScheduler* backgroundInstance();
+
+    /**
+     * @brief   Create a group for a job's tasks.
+     *
+     * @param   priority The job's priority.
+     */
+    GroupPtr createGroup(Priority priority = NormalPriority);
+
+    /**
+     * @brief   Queue a task.
+     *
+     * @details Called from a worker, the task goes onto that worker's own deque.
+     *
+     * @param   group The group the task belongs to.
+     * @param   task The task to run.
+     * @param   cost Roughly how much work the task is (e.g., input bytes), the group is charged this for fair share.
+     * @param   node The NUMA node the task's input is on (see NumaTopology::nodeOf), or -1 for anywhere.
+     */
+    void submit(const GroupPtr& group, Task task, qint64 cost = 1, int node = -1);
+
+    /**
+     * @brief   Wait until every task submitted to a group has finished.
+     *
+     * @details Must not be called from a worker.
+     */
+    void wait(const GroupPtr& group);
+
+    /**
+     * @brief   Get the number of worker threads.
+     */
+    int workerCount() const;
+
+    /**
+     * @brief   Get the number of NUMA nodes the workers are spread over, 1 if they aren't placed.
+     *
+     * @details Only worth finding out which node a task's input is on when this is more than 1.
+     */
+    int nodeCount() const;
+
+    /**
+     * @brief   Get the task counters.
+     */
+    Stats stats() const;
+
+private:
+    struct Item {
+        Task task;
+        GroupPtr group;
+        qint64 cost;
+        int node;   // Index in NumaTopology, or -1
+    };
+
+    // Owner pops from the front, thieves from the back
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Item> tasks;
+        std::thread thread;
+        int node = 0;
+    };
+
+    void workerLoop(int index);
+    bool takeLocal(Worker& worker, Item& item);
+    bool takeFromGroups(Worker& worker, Item& item);
+    bool steal(int index, Item& item);
+    void charge(Group& group, qint64 cost);
+    void finished(Group& group);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mIdleCondition;
+    std::vector<Group*> mActive;
+    double mVirtualTime;
+    std::atomic<int> mLocalTasks;
+    std::atomic<quint64> mTaskCount;
+    std::atomic<quint64> mStealCount;
+    std::atomic<quint64> mNodeLocalCount;
+    std::atomic<quint64> mNodeRemoteCount;
+    int mNodeCount;
+    bool mBackground;
+    bool mStopping;
+};
+
+/**
+ * @class   ZipScheduler::Group
+ *
+ * @brief   The queue and fair-share accounting for one job's tasks.
+ */
+class ZipScheduler::Group {
+public:
+    /**
+     * @brief   Get the group's priority.
+     */
+    Priority priority() const { return mPriority; }
+
+private:
+    friend class ZipScheduler;
+
+    explicit Group(Priority priority);
+
+    // All guarded by the scheduler's mutex
+    Priority mPriority;
+    double mWeight;
+    double mPass;
+    std::deque<Item> mQueue;
+    int mOutstanding;
+};
+
+#endif // ZIPSCHEDULER_H
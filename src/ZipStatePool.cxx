@@ -0,0 +1,190 @@
+#include "ZipStatePool.h"
+#include "PageAllocator.h"
+#include <QAtomicInt>
+#include <QThreadStorage>
+#include <vector>
+
+namespace {
+
+// Owns one mz_zip_entry_state
+struct LocalState {
+    // A freed block in the huge page region
+    struct Block {
+        char* address;
+        size_t size;
+    };
+
+    explicit LocalState(bool hugePages) :
+        hugePages(hugePages),
+        region(nullptr),
+        regionSize(0),
+        regionUsed(0),
+        regionBlocks(0),
+        fallbacks(0)
+    {
+        mz_zip_entry_state_init(&state);
+        if (hugePages) {
+            state.m_pAlloc = allocHuge;
+            state.m_pFree = freeHuge;
+            state.m_pAlloc_opaque = this;
+        }
+    }
+
+    ~LocalState()
+    {
+        mz_zip_entry_state_end(&state);
+        PageAllocator::release(region, regionSize);
+    }
+
+    // All of the scratch buffers (around 430 KB) are carved out of one 2 MB huge page where possible, so the
+    // compressor hash chains, dictionary and I/O buffers share a single TLB entry. A slot that outgrows its buffer
+    // frees it and allocates a bigger one, so freed blocks are kept for reuse, and the region starts again from the
+    // beginning once nothing in it is live.
+    static void* allocHuge(void* opaque, size_t* size)
+    {
+        LocalState* local = static_cast<LocalState*>(opaque);
+        if (!local->region) {
+            local->regionSize = PageAllocator::hugePageSize() ? PageAllocator::hugePageSize() : *size;
+            local->region = static_cast<char*>(PageAllocator::allocate(local->regionSize, true));
+        }
+
+        if (local->region) {
+            // Sizes are rounded up and written back, so every block starts on a cache line and frees its whole size
+            *size = (*size + 63) & ~size_t(63);
+            for (std::vector<Block>::iterator freed = local->freeBlocks.begin(); freed != local->freeBlocks.end(); ++freed) {
+                if (freed->size >= *size) {
+                    char* block = freed->address;
+                    *size = freed->size;
+                    local->freeBlocks.erase(freed);
+                    local->regionBlocks++;
+                    return block;
+                }
+            }
+            if (local->regionUsed + *size <= local->regionSize) {
+                char* block = local->region + local->regionUsed;
+                local->regionUsed += *size;
+                local->regionBlocks++;
+                return block;
+            }
+        }
+        local->fallbacks++;
+        return PageAllocator::allocate(*size, true);
+    }
+
+    static void freeHuge(void* opaque, void* address, size_t size)
+    {
+        LocalState* local = static_cast<LocalState*>(opaque);
+        char* block = static_cast<char*>(address);
+        if (block < local->region || block >= local->region + local->regionSize) {
+            PageAllocator::release(address, size);
+            return;
+        }
+
+        if (--local->regionBlocks == 0) {
+            local->regionUsed = 0;
+            local->freeBlocks.clear();
+        } else if (block + size == local->region + local->regionUsed) {
+            local->regionUsed -= size;
+        } else {
+            Block freedBlock = {block, size};
+            local->freeBlocks.push_back(freedBlock);
+        }
+    }
+
+    bool hugePages;
+    char* region;
+    size_t regionSize;
+    size_t regionUsed;
+    int regionBlocks;
+    std::vector<Block> freeBlocks;
+    quint64 fallbacks;
+    mz_zip_entry_state state;
+};
+
+// One state for each page size, created when first used, QThreadStorage deletes them when the thread exits. An
+// archive opened with huge pages and one opened without can both be in use on a thread (e.g., repacking with
+// different options), so neither state is ever replaced while the thread is alive.
+struct LocalStates {
+    LocalStates()
+    {
+        modes[0] = nullptr;
+        modes[1] = nullptr;
+    }
+
+    ~LocalStates()
+    {
+        delete modes[0];
+        delete modes[1];
+    }
+
+    LocalState* modes[2];
+};
+
+QThreadStorage<LocalStates*> localStates;
+QAtomicInt poolEnabled(1);
+
+mz_zip_entry_state* localState(bool hugePages)
+{
+    if (!localStates.hasLocalData() || !localStates.localData()) {
+        localStates.setLocalData(new LocalStates);
+    }
+    LocalState*& local = localStates.localData()->modes[hugePages ? 1 : 0];
+    if (!local) {
+        local = new LocalState(hugePages);
+    }
+    return &local->state;
+}
+
+}
+
+void ZipStatePool::attach(mz_zip_archive* zip, bool hugePages)
+{
+    zip->m_pEntry_state = isEnabled() ? localState(hugePages) : nullptr;
+}
+
+void ZipStatePool::setEnabled(bool enabled)
+{
+    poolEnabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool ZipStatePool::isEnabled()
+{
+    return poolEnabled.loadAcquire() != 0;
+}
+
+ZipStatePool::Stats ZipStatePool::stats()
+{
+    Stats stats;
+    if (localStates.hasLocalData() && localStates.localData()) {
+        for (const LocalState* local : localStates.localData()->modes) {
+            if (local) {
+                stats.allocations += local->state.m_alloc_count;
+                stats.reuses += local->state.m_reuse_count;
+                stats.hugePageFallbacks += local->fallbacks;
+                stats.hugePageBytes += local->regionUsed;
+            }
+        }
+    }
+    return stats;
+}
+
+void ZipStatePool::resetStats()
+{
+    if (localStates.hasLocalData() && localStates.localData()) {
+        for (LocalState* local : localStates.localData()->modes) {
+            if (local) {
+                local->state.m_alloc_count = 0;
+                local->state.m_reuse_count = 0;
+                local->fallbacks = 0;
+            }
+        }
+    }
+}
+
+void ZipStatePool::release()
+{
+    if (localStates.hasLocalData()) {
+        // setLocalData deletes the previous value
+        localStates.setLocalData(nullptr);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef ZIPSTATEPOOL_H
+#define ZIPSTATEPOOL_H
+
+#include <QtGlobal>
+#include "miniz.h"
+
+/**
+ * @class   ZipStatePool
+ *
+ * @brief   A thread-local pool of miniz compressor and decompressor states.
+ *
+ * @details miniz normally allocates a new compressor (around 300 KB) or decompressor plus its 32 KB dictionary and
+ *          I/O buffers for every entry it writes or extracts, and frees them again straight after. For folders with
+ *          lots of small files that is a lot of malloc/free traffic and every entry starts with a cold cache. This
+ *          class keeps one mz_zip_entry_state per thread which is attached to each archive SimpleZipper opens, so the
+ *          buffers are allocated once per thread and then just reset with tdefl_init / tinfl_init for each entry.
+ *          The buffers are freed when the thread exits.
+ */
+class ZipStatePool {
+public:
+    /**
+     * @brief   Allocation counters for the calling thread's state.
+     */
+    struct Stats {
+        quint64 allocations = 0;
+        quint64 reuses = 0;
+        quint64 hugePageFallbacks = 0;  ///< Huge page buffers that didn't fit in the thread's 2 MB region
+        size_t hugePageBytes = 0;       ///< The bytes of the region in use now, rather than a counter
+    };
+
+    /**
+     * @brief   Attach the calling thread's state to a zip archive.
+     *
+     * @details Sets zip->m_pEntry_state, or leaves it NULL if pooling has been disabled. The archive must only be
+     *          used from the calling thread until it is attached again (no buffers are held between miniz calls, so
+     *          an open archive can be re-attached by another thread between entries, see ZipWriter). If hugePages is
+     *          set, the buffers are carved out of a single 2 MB huge page (see PageAllocator). Each thread keeps a
+     *          separate state for normal and huge pages, so archives opened with either can be used side by side.
+     *
+     * @param   zip A pointer to the miniz zip archive object, after memset and before it is used.
+     * @param   hugePages Whether the thread's buffers should be backed by huge pages.
+     */
+    static void attach(mz_zip_archive* zip, bool hugePages = false);
+
+    /**
+     * @brief   Enable or disable pooling for all threads (enabled by default).
+     *
+     * @details Mostly useful for benchmarking. Disabling doesn't free states that already exist.
+     *
+     * @param   enabled Whether archives opened from now on use the pool.
+     */
+    static void setEnabled(bool enabled);
+
+    /**
+     * @brief   Check whether pooling is enabled.
+     *
+     * @return  True if archives use the thread-local state, false otherwise.
+     */
+    static bool isEnabled();
+
+    /**
+     * @brief   Get the number of scratch buffers allocated and reused by the calling thread, for both page sizes.
+     *
+     * @return  The counters since the thread started or since the last call to resetStats.
+     */
+    static Stats stats();
+
+    /**
+     * @brief   Reset the calling thread's counters to zero.
+     */
+    static void resetStats();
+
+    /**
+     * @brief   Free the calling thread's buffers now rather than when the thread exits.
+     *
+     * @details Only call this when no archive attached on the calling thread is still in use.
+     */
+    static void release();
+};
+
+#endif // ZIPSTATEPOOL_H
@@ -0,0 +1,311 @@
+#include "ZipWriter.h"
+#include "BatchFileReader.h"
+#include "DirectoryWalker.h"
+#include "DiskOrder.h"
+#include "PathFilter.h"
+#include "ZipArena.h"
+#include "ZipPipeline.h"
+#include "ZipReader.h"
+#include "ZipStatePool.h"
+#include <QDebug>
+#include <QFile>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Where recompressFrom reads an entry from, decompressed a buffer at a time
+struct RecompressSource {
+    mz_zip_reader_extract_iter_state* iter;
+    ZipProgress* progress;
+};
+
+size_t readRecompressed(void* opaque, mz_uint64 offset, void* buffer, size_t size)
+{
+    Q_UNUSED(offset);
+    RecompressSource* source = static_cast<RecompressSource*>(opaque);
+    if (source->progress && source->progress->isCanceled()) {
+        return 0;
+    }
+    size_t read = mz_zip_reader_extract_iter_read(source->iter, buffer, size);
+    if (source->progress) {
+        source->progress->addBytes(static_cast<qint64>(read));
+    }
+    return read;
+}
+
+}
+
+// Everything that has to stay at a fixed address while the archive is open, the arena must outlive the archive
+struct ZipWriter::State {
+    explicit State(const ZipOptions& options) :
+        arena(options.arenaChunkSize(), options.hugePages),
+        pipeline(options)
+    {
+        memset(&zip, 0, sizeof(zip));
+        arena.install(&zip);
+    }
+
+    QString filename;
+    ZipArena arena;
+    mz_zip_archive zip;
+    ZipPipeline pipeline;
+    bool open = false;
+};
+
+ZipWriter::ZipWriter(const ZipOptions& options) :
+    mOptions(options)
+{
+}
+
+ZipWriter::~ZipWriter()
+{
+    close();
+}
+
+ZipWriter::ZipWriter(ZipWriter&& other) :
+    mOptions(other.mOptions),
+    mState(std::move(other.mState))
+{
+}
+
+ZipWriter& ZipWriter::operator=(ZipWriter&& other)
+{
+    if (this != &other) {
+        close();
+        mOptions = other.mOptions;
+        mState = std::move(other.mState);
+    }
+    return *this;
+}
+
+bool ZipWriter::open(const QString& zipFilename, mz_uint flags)
+{
+    close();
+
+    mState.reset(new State(mOptions));
+    mState->filename = zipFilename;
+    attach();
+    if (!mState->pipeline.open(&mState->zip, zipFilename) || !mz_zip_writer_init_v2(&mState->zip, 0, flags)) {
+        qWarning() << "Failed to open output zip file" << zipFilename;
+        return false;
+    }
+    mState->open = true;
+    return true;
+}
+
+bool ZipWriter::isOpen() const
+{
+    return mState && mState->open;
+}
+
+bool ZipWriter::reserve(int files, quint64 nameBytes)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    return mz_zip_writer_reserve(&mState->zip, static_cast<mz_uint>(files), nameBytes);
+}
+
+bool ZipWriter::addFile(const QString& filename, const QString& archiveName)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    // Read the contents of the input file, or map it if it's big
+    FileContents contents = BatchFileReader::readFile(filename, mOptions.mapThreshold, mOptions.bulkIo, mOptions.governor());
+    if (!contents.ok) {
+        qWarning() << "Failed to open file" << filename << "for reading";
+        return false;
+    }
+    if (mOptions.progress) {
+        mOptions.progress->addTotal(contents.size());
+    }
+    if (!contents.mapping && !mOptions.throttleRead(contents.size())) {
+        return false;
+    }
+    attach();
+    if (!mState->pipeline.addFile(&mState->zip, archiveName, contents)) {
+        if (!mOptions.progress || !mOptions.progress->isCanceled()) {
+            qWarning() << "Failed to add file" << filename << "to zip archive" << mState->filename;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ZipWriter::addData(const QString& archiveName, const QByteArray& data)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    FileContents contents;
+    contents.ok = true;
+    contents.data = data;
+    if (mOptions.progress) {
+        mOptions.progress->addTotal(contents.size());
+    }
+    attach();
+    if (!mState->pipeline.addFile(&mState->zip, archiveName, contents)) {
+        if (!mOptions.progress || !mOptions.progress->isCanceled()) {
+            qWarning() << "Failed to add" << archiveName << "to zip archive" << mState->filename;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ZipWriter::addEntries(const QVector<ZipEntry>& entries)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    attach();
+    if (mOptions.readOrder != DiskOrder::NameOrder) {
+        return addInDiskOrder(entries);
+    }
+    return mState->pipeline.addEntries(&mState->zip, entries);
+}
+
+bool ZipWriter::addFolder(const QString& folder, const QString& prefix)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    attach();
+
+    // Add each file in the folder and its subfolders, compressing them as they are found
+    std::shared_ptr<const PathFilter> filter = std::make_shared<PathFilter>(mOptions.excludePatterns, mOptions.includePatterns, mOptions.ignoreFileName);
+    if (mOptions.readOrder != DiskOrder::NameOrder) {
+        return addInDiskOrder(DirectoryWalker::list(folder, prefix, mOptions.walkerThreads, filter));
+    }
+    DirectoryWalker walker(mOptions.walkerThreads);
+    walker.setFilter(filter);
+    walker.start(folder, prefix);
+    return mState->pipeline.addEntries(&mState->zip, [&walker](ZipEntry& entry) { return walker.next(entry); });
+}
+
+bool ZipWriter::copyFrom(const ZipReader& reader, int index)
+{
+    if (!isOpen() || !reader.isOpen() || index < 0) {
+        return false;
+    }
+    attach();
+    if (!mz_zip_writer_add_from_zip_reader(&mState->zip, reader.archive(), static_cast<mz_uint>(index))) {
+        qWarning() << "Failed to copy file" << index << "into zip archive" << mState->filename;
+        return false;
+    }
+    return true;
+}
+
+bool ZipWriter::recompressFrom(const ZipReader& reader, int index)
+{
+    if (!isOpen() || !reader.isOpen() || index < 0) {
+        return false;
+    }
+    mz_zip_archive_file_stat fileStat;
+    if (!mz_zip_reader_file_stat(reader.archive(), static_cast<mz_uint>(index), &fileStat)) {
+        return false;
+    }
+
+    // Folders, and stored files going into a stored archive, come out the same either way
+    if (fileStat.m_is_directory || (fileStat.m_method == 0 && (mOptions.levelAndFlags() & 0xF) == 0)) {
+        return copyFrom(reader, index);
+    }
+
+    // Decompressed and compressed again in step, so the entry is never held in memory whatever its size
+    reader.attach();
+    RecompressSource source = {mz_zip_reader_extract_iter_new(reader.archive(), static_cast<mz_uint>(index), 0), mOptions.progress.get()};
+    if (!source.iter) {
+        qWarning() << "Failed to read file" << fileStat.m_filename << "to recompress it";
+        return false;
+    }
+    if (mOptions.progress) {
+        mOptions.progress->addTotal(static_cast<qint64>(fileStat.m_uncomp_size));
+    }
+    attach();
+    MZ_TIME_T time = fileStat.m_time;
+    bool ok = mz_zip_writer_add_read_buf_callback(&mState->zip, fileStat.m_filename, readRecompressed, &source, fileStat.m_uncomp_size, &time,
+                                                  fileStat.m_comment, static_cast<mz_uint16>(fileStat.m_comment_size), mOptions.levelAndFlags(),
+                                                  nullptr, 0, nullptr, 0);
+
+    // Freeing the iterator checks the CRC-32 of everything it decompressed
+    ok = mz_zip_reader_extract_iter_free(source.iter) && ok;
+    if (!ok) {
+        if (!mOptions.progress || !mOptions.progress->isCanceled()) {
+            qWarning() << "Failed to recompress file" << fileStat.m_filename << "into zip archive" << mState->filename;
+        }
+        return false;
+    }
+    if (mOptions.progress) {
+        mOptions.progress->addEntry();
+    }
+    return true;
+}
+
+bool ZipWriter::close()
+{
+    if (!isOpen()) {
+        return true;
+    }
+    attach();
+    mState->open = false;
+    bool ok = mz_zip_writer_finalize_archive(&mState->zip);
+    mz_zip_writer_end(&mState->zip);
+    if (!mState->pipeline.close()) {
+        qWarning() << "Failed to write output zip file" << mState->filename;
+        return false;
+    }
+    return ok;
+}
+
+void ZipWriter::abort()
+{
+    if (!isOpen()) {
+        return;
+    }
+    mState->open = false;
+    mz_zip_writer_end(&mState->zip);
+    mState->pipeline.close();
+    QFile::remove(mState->filename);
+}
+
+int ZipWriter::count() const
+{
+    return mState ? static_cast<int>(mz_zip_reader_get_num_files(&mState->zip)) : 0;
+}
+
+size_t ZipWriter::peakMemory() const
+{
+    return mState ? mState->arena.peakBytesReserved() : 0;
+}
+
+bool ZipWriter::addInDiskOrder(QVector<ZipEntry> entries)
+{
+    mz_uint base = mz_zip_reader_get_num_files(&mState->zip);
+    QVector<int> logicalIndices = DiskOrder::sort(entries, mOptions.readOrder);
+    if (!mState->pipeline.addEntries(&mState->zip, entries)) {
+        return false;
+    }
+
+    // Put the new entries back into the original order, so the listing doesn't depend on the disk layout
+    std::vector<mz_uint> order(base + logicalIndices.size());
+    for (mz_uint i = 0; i < base; i++) {
+        order[i] = i;
+    }
+    for (int i = 0; i < logicalIndices.size(); i++) {
+        order[base + logicalIndices[i]] = base + i;
+    }
+    if (!mz_zip_writer_reorder_central_dir(&mState->zip, order.data())) {
+        qWarning() << "Failed to reorder zip archive central directory";
+        return false;
+    }
+    return true;
+}
+
+void ZipWriter::attach() const
+{
+    // The buffers belong to whichever thread is making the call
+    ZipStatePool::attach(&mState->zip, mOptions.hugePages);
+}
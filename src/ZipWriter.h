@@ -0,0 +1,172 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "miniz.h"
+#include "ZipEntry.h"
+#include "ZipOptions.h"
+
+class ZipReader;
+
+/**
+ * @class   ZipWriter
+ *
+ * @brief   A zip archive that stays open while files are added to it.
+ *
+ * @details The static SimpleZipper functions create, fill and finalize an archive in one call. A ZipWriter keeps the
+ *          archive, its ZipArena, and the ZipPipeline's writer thread and buffers alive between calls, so files can be
+ *          added as they turn up without paying for a new archive each time. The archive is finalized by close, or by
+ *          the destructor if close wasn't called. Use abort to throw away a half-written archive instead.
+ *
+ *          Threading: a ZipWriter must only be used by one thread at a time, but it doesn't have to be the same
+ *          thread each time. Each call attaches the calling thread's ZipStatePool buffers for the duration of the
+ *          call. Different ZipWriter objects are independent. ZipWriters can be moved but not copied, a moved-from
+ *          ZipWriter is closed.
+ */
+class ZipWriter {
+public:
+    /**
+     * @brief   Create a writer.
+     *
+     * @param   options The options for the archives written, e.g., the low-memory compressor profile.
+     */
+    explicit ZipWriter(const ZipOptions& options = ZipOptions());
+    ~ZipWriter();
+
+    ZipWriter(ZipWriter&& other);
+    ZipWriter& operator=(ZipWriter&& other);
+    ZipWriter(const ZipWriter&) = delete;
+    ZipWriter& operator=(const ZipWriter&) = delete;
+
+    /**
+     * @brief   Create a new zip file, closing any archive that is already open.
+     *
+     * @param   zipFilename The name of the zip file to create.
+     * @param   flags Extra miniz writer flags, e.g., MZ_ZIP_FLAG_WRITE_ZIP64.
+     *
+     * @return  True if the file was created, false otherwise.
+     */
+    bool open(const QString& zipFilename, mz_uint flags = 0);
+
+    /**
+     * @brief   Check whether an archive is open.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief   Allocate the central directory for a number of files up front.
+     *
+     * @param   files The number of files that will be added.
+     * @param   nameBytes The total length of their archive names in bytes (UTF-8).
+     *
+     * @return  True if the space was allocated, false otherwise (e.g., too many files for the archive format).
+     */
+    bool reserve(int files, quint64 nameBytes);
+
+    /**
+     * @brief   Compress a file and add it to the archive.
+     *
+     * @param   filename The name of the file to add.
+     * @param   archiveName The name of the file inside the archive.
+     *
+     * @return  True if the file was added, false otherwise.
+     */
+    bool addFile(const QString& filename, const QString& archiveName);
+
+    /**
+     * @brief   Compress data from memory and add it to the archive.
+     *
+     * @param   archiveName The name of the file inside the archive.
+     * @param   data The contents of the file.
+     *
+     * @return  True if the data was added, false otherwise.
+     */
+    bool addData(const QString& archiveName, const QByteArray& data);
+
+    /**
+     * @brief   Compress a list of files and add them to the archive, reading ahead through the pipeline.
+     *
+     * @details The files are listed in the archive in the order given. If ZipOptions::readOrder is set, they are read
+     *          in disk order instead (see DiskOrder).
+     *
+     * @param   entries The files to add.
+     *
+     * @return  True if all of the files were added, false otherwise.
+     */
+    bool addEntries(const QVector<ZipEntry>& entries);
+
+    /**
+     * @brief   Compress a folder and all its contents recursively and add them to the archive.
+     *
+     * @details The folder is walked with a DirectoryWalker using the include / exclude rules from the options, and
+     *          files are compressed as soon as they are found.
+     *
+     * @param   folder The name of the folder to add.
+     * @param   prefix The prefix for the archive names of the files, e.g., "data/", or empty to add them at the top.
+     *
+     * @return  True if all of the files were added, false otherwise.
+     */
+    bool addFolder(const QString& folder, const QString& prefix = QString());
+
+    /**
+     * @brief   Copy a file from another archive as it is, without decompressing and recompressing it.
+     *
+     * @details If the source archive uses zip64, this archive must have been opened with MZ_ZIP_FLAG_WRITE_ZIP64.
+     *
+     * @param   reader The archive to copy from.
+     * @param   index The index of the file in the source archive.
+     *
+     * @return  True if the file was copied, false otherwise.
+     */
+    bool copyFrom(const ZipReader& reader, int index);
+
+    /**
+     * @brief   Decompress a file from another archive and compress it again with this archive's options.
+     *
+     * @details The file is streamed through, a buffer at a time, so it's never held in memory whatever its size.
+     *          Folders and stored files going into a stored archive are copied as they are (see copyFrom). If the
+     *          source archive uses zip64, this archive must have been opened with MZ_ZIP_FLAG_WRITE_ZIP64.
+     *
+     * @param   reader The archive to copy from.
+     * @param   index The index of the file in the source archive.
+     *
+     * @return  True if the file was recompressed and its CRC-32 checked, false otherwise.
+     */
+    bool recompressFrom(const ZipReader& reader, int index);
+
+    /**
+     * @brief   Write the central directory and close the zip file.
+     *
+     * @return  True if the archive was written successfully, false otherwise.
+     */
+    bool close();
+
+    /**
+     * @brief   Close the zip file without finishing it, and delete it.
+     */
+    void abort();
+
+    /**
+     * @brief   Get the number of files in the archive so far.
+     */
+    int count() const;
+
+    /**
+     * @brief   Get the peak memory reserved by the current (or last) archive's arena in bytes.
+     */
+    size_t peakMemory() const;
+
+private:
+    struct State;
+
+    bool addInDiskOrder(QVector<ZipEntry> entries);
+    void attach() const;
+
+    ZipOptions mOptions;
+    std::unique_ptr<State> mState;
+};
+
+#endif // ZIPWRITER_H
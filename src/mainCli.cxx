@@ -0,0 +1,437 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QTextStream>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include "CpuCount.h"
+#include "ZipLog.h"
+#include "ZipReader.h"
+#include "ZipScheduler.h"
+#include "ZipWriter.h"
+
+namespace {
+
+// What each command did, printed as a summary line or as JSON
+struct Stats {
+    bool ok = false;
+    int entries = 0;
+    qint64 bytesIn = 0;
+    qint64 bytesOut = 0;
+    QJsonArray list;
+};
+
+bool verbose = false;
+
+void messageHandler(QtMsgType type, const QMessageLogContext&, const QString& message)
+{
+    // Debug messages, from the library or Qt, are only wanted when asked for
+    if (type == QtDebugMsg && !verbose) {
+        return;
+    }
+    fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+qint64 fileSize(const QString& filename)
+{
+    return QFileInfo(filename).size();
+}
+
+bool addPaths(ZipWriter& writer, const QStringList& paths)
+{
+    // Folders go in under their own name, as they would with zip -r
+    for (const auto& path : paths) {
+        QFileInfo fileInfo(path);
+        if (fileInfo.isDir()) {
+            if (!writer.addFolder(path, QDir(path).dirName() + "/")) {
+                return false;
+            }
+        } else if (!writer.addFile(path, fileInfo.fileName())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool replaceArchive(const QString& tempFilename, const QString& zipFilename)
+{
+    if ((QFile::exists(zipFilename) && !QFile::remove(zipFilename)) || !QFile::rename(tempFilename, zipFilename)) {
+        qWarning() << "Failed to replace" << zipFilename;
+        QFile::remove(tempFilename);
+        return false;
+    }
+    return true;
+}
+
+bool zipCommand(const QString& zipFilename, const QStringList& paths, const ZipOptions& options, Stats& stats)
+{
+    ZipWriter writer(options);
+    if (!writer.open(zipFilename)) {
+        return false;
+    }
+    if (!addPaths(writer, paths)) {
+        writer.abort();
+        return false;
+    }
+    if (!writer.close()) {
+        return false;
+    }
+    stats.entries = writer.count();
+    stats.bytesIn = options.progress->snapshot().bytesDone;
+    stats.bytesOut = fileSize(zipFilename);
+    return true;
+}
+
+bool unzipCommand(const QString& zipFilename, QString outputFolder, const ZipOptions& options, Stats& stats)
+{
+    if (outputFolder.isEmpty()) {
+        QFileInfo fileInfo(zipFilename);
+        outputFolder = fileInfo.absolutePath() + "/" + fileInfo.baseName();
+    }
+    ZipReader reader(options);
+    if (!reader.open(zipFilename) || !reader.extractAll(outputFolder)) {
+        return false;
+    }
+    stats.entries = reader.count();
+    stats.bytesIn = fileSize(zipFilename);
+    stats.bytesOut = options.progress->snapshot().bytesDone;
+    return true;
+}
+
+bool listCommand(const QString& zipFilename, const ZipOptions& options, bool json, Stats& stats)
+{
+    ZipReader reader(options);
+    if (!reader.open(zipFilename)) {
+        return false;
+    }
+    QTextStream out(stdout);
+    for (int i = 0; i < reader.count(); i++) {
+        mz_zip_archive_file_stat fileStat;
+        if (!reader.stat(i, fileStat)) {
+            return false;
+        }
+        QString name = QString::fromUtf8(fileStat.m_filename);
+        if (json) {
+            QJsonObject entry;
+            entry["name"] = name;
+            entry["size"] = static_cast<qint64>(fileStat.m_uncomp_size);
+            entry["compressedSize"] = static_cast<qint64>(fileStat.m_comp_size);
+            entry["crc32"] = QString::number(fileStat.m_crc32, 16).rightJustified(8, '0');
+            stats.list.append(entry);
+        } else {
+            out << QString::number(static_cast<qint64>(fileStat.m_uncomp_size)).rightJustified(12) << " "
+                << QString::number(static_cast<qint64>(fileStat.m_comp_size)).rightJustified(12) << "  " << name << "\n";
+        }
+        stats.bytesOut += static_cast<qint64>(fileStat.m_uncomp_size);
+    }
+    stats.entries = reader.count();
+    stats.bytesIn = fileSize(zipFilename);
+    return true;
+}
+
+bool testCommand(const QString& zipFilename, const ZipOptions& options, Stats& stats)
+{
+    ZipReader reader(options);
+    if (!reader.open(zipFilename)) {
+        return false;
+    }
+
+    // Carry on past a bad file, so every bad file is reported
+    bool ok = true;
+    for (int i = 0; i < reader.count(); i++) {
+        mz_zip_archive_file_stat fileStat;
+        if (!reader.stat(i, fileStat) || !reader.verify(i)) {
+            qWarning() << "Bad file" << i << (reader.stat(i, fileStat) ? fileStat.m_filename : "");
+            ok = false;
+            continue;
+        }
+        stats.bytesOut += static_cast<qint64>(fileStat.m_uncomp_size);
+    }
+    stats.entries = reader.count();
+    stats.bytesIn = fileSize(zipFilename);
+    return ok;
+}
+
+bool appendCommand(const QString& zipFilename, const QStringList& paths, const ZipOptions& options, Stats& stats)
+{
+    // The existing files are copied across still compressed, so this costs about one sequential copy of the archive
+    ZipReader reader(options);
+    if (!reader.open(zipFilename)) {
+        return false;
+    }
+    QString tempFilename = zipFilename + ".tmp";
+    ZipWriter writer(options);
+    if (!writer.open(tempFilename, reader.isZip64() ? MZ_ZIP_FLAG_WRITE_ZIP64 : 0)) {
+        return false;
+    }
+    for (int i = 0; i < reader.count(); i++) {
+        if (!writer.copyFrom(reader, i)) {
+            writer.abort();
+            return false;
+        }
+    }
+    reader.close();
+    if (!addPaths(writer, paths)) {
+        writer.abort();
+        return false;
+    }
+    if (!writer.close() || !replaceArchive(tempFilename, zipFilename)) {
+        return false;
+    }
+    stats.entries = writer.count();
+    stats.bytesIn = options.progress->snapshot().bytesDone;
+    stats.bytesOut = fileSize(zipFilename);
+    return true;
+}
+
+bool repackCommand(const QString& zipFilename, const QString& outputFilename, const ZipOptions& options, Stats& stats)
+{
+    // Without -o the archive is replaced, so its size has to be taken first
+    qint64 bytesIn = fileSize(zipFilename);
+    ZipReader reader(options);
+    if (!reader.open(zipFilename)) {
+        return false;
+    }
+    QString tempFilename = (outputFilename.isEmpty() ? zipFilename : outputFilename) + ".tmp";
+    ZipWriter writer(options);
+    if (!writer.open(tempFilename, reader.isZip64() ? MZ_ZIP_FLAG_WRITE_ZIP64 : 0)) {
+        return false;
+    }
+
+    // Recompress every file with the new options, keeping only the last copy of a name that was appended again
+    QSet<QString> seen;
+    QVector<int> indices;
+    for (int i = reader.count() - 1; i >= 0; i--) {
+        mz_zip_archive_file_stat fileStat;
+        if (reader.stat(i, fileStat) && !seen.contains(QString::fromUtf8(fileStat.m_filename))) {
+            seen.insert(QString::fromUtf8(fileStat.m_filename));
+            indices.prepend(i);
+        }
+    }
+    for (int i : indices) {
+        if (!writer.recompressFrom(reader, i)) {
+            writer.abort();
+            return false;
+        }
+    }
+    reader.close();
+    QString outFile = outputFilename.isEmpty() ? zipFilename : outputFilename;
+    if (!writer.close() || !replaceArchive(tempFilename, outFile)) {
+        return false;
+    }
+    stats.entries = writer.count();
+    stats.bytesIn = bytesIn;
+    stats.bytesOut = fileSize(outFile);
+    return true;
+}
+
+bool parseRateLimit(const QCommandLineParser& parser, const QCommandLineOption& option, std::shared_ptr<RateLimiter>& limit)
+{
+    if (!parser.isSet(option)) {
+        return true;
+    }
+    double rate = parser.value(option).toDouble() * 1e6;
+    if (rate < 1) {
+        return false;
+    }
+    limit = std::make_shared<RateLimiter>(static_cast<qint64>(rate));
+    return true;
+}
+
+bool applyIoMode(const QString& modes, ZipOptions& options)
+{
+    for (const auto& mode : modes.split(',')) {
+        if (mode == "auto") {
+            continue;
+        } else if (mode == "uring") {
+            options.ioUring = true;
+        } else if (mode == "threads") {
+            options.ioUring = false;
+        } else if (mode == "sync") {
+            options.pipelined = false;
+            options.readQueueDepth = 1;
+        } else if (mode == "bulk") {
+            options.bulkIo = true;
+        } else if (mode == "mmap") {
+            options.mapThreshold = 1;
+        } else if (mode == "nommap") {
+            options.mapThreshold = 0;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("simplezipper-cli");
+    qInstallMessageHandler(messageHandler);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Zip and unzip files without a display.\n\n"
+        "Commands:\n"
+        "  zip <archive> <paths...>     Create an archive from files and folders\n"
+        "  unzip <archive>              Extract an archive (into -o, or a folder named after it)\n"
+        "  list <archive>               List the files in an archive\n"
+        "  test <archive>               Check every file's CRC-32\n"
+        "  append <archive> <paths...>  Add files and folders to an existing archive\n"
+        "  repack <archive>             Recompress an archive with the given options (in place, or to -o)");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "zip, unzip, list, test, append or repack.");
+    parser.addPositionalArgument("archive", "The zip file.");
+    parser.addPositionalArgument("paths", "The files and folders to add.", "[paths...]");
+    QCommandLineOption outputOption({"o", "output"}, "The folder to unzip to, or the archive to repack to.", "path");
+    QCommandLineOption threadsOption({"t", "threads"}, "The number of compression threads (0 for one per available core).", "n", "0");
+    QCommandLineOption walkerThreadsOption("walker-threads", "The number of threads listing folders (0 for automatic).", "n", "0");
+    QCommandLineOption levelOption({"l", "level"}, "The compression level, 0 (store) to 10.", "level", QString::number(MZ_DEFAULT_LEVEL));
+    QCommandLineOption memoryOption({"m", "memory"}, "A memory budget in MB for file data, below 64 this also uses the low-memory profile.", "MB");
+    QCommandLineOption readLimitOption("read-limit", "Read at most this many MB/s.", "MB/s");
+    QCommandLineOption writeLimitOption("write-limit", "Write at most this many MB/s.", "MB/s");
+    QCommandLineOption backgroundOption("background", "Run at idle I/O priority and the lowest CPU priority.");
+    QCommandLineOption ioOption("io", "Comma separated I/O modes: auto, uring, threads, sync, bulk, mmap, nommap.", "modes", "auto");
+    QCommandLineOption excludeOption("exclude", "Leave out files matching a .gitignore style pattern (repeatable).", "pattern");
+    QCommandLineOption includeOption("include", "Only add files matching a .gitignore style pattern (repeatable).", "pattern");
+    QCommandLineOption ignoreFileOption("ignore-file", "Read the rules in files with this name (e.g., .gitignore) while walking folders.", "name");
+    QCommandLineOption sparseOption("sparse", "Leave holes in extracted files where whole blocks are zero.");
+    QCommandLineOption hugePagesOption("huge-pages", "Use 2 MB huge pages for the compressor state and buffers.");
+    QCommandLineOption jsonOption("json", "Print the statistics (and the listing) as JSON.");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Print each file as it is processed.");
+    parser.addOptions({outputOption, threadsOption, walkerThreadsOption, levelOption, memoryOption, readLimitOption, writeLimitOption,
+                       backgroundOption, ioOption, excludeOption, includeOption, ignoreFileOption, sparseOption,
+                       hugePagesOption, jsonOption, verboseOption});
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.size() < 2) {
+        parser.showHelp(2);
+    }
+    QString command = args.takeFirst();
+    QString zipFilename = args.takeFirst();
+    verbose = parser.isSet(verboseOption);
+
+    // Per-file messages aren't even formatted without -v, and with it they're written on a background thread
+    if (verbose) {
+        ZipLog::setLevel(ZipLog::TraceLevel);
+        ZipLog::setAsync(true);
+    } else {
+        ZipLog::setLevel(ZipLog::WarningLevel);
+    }
+    bool json = parser.isSet(jsonOption);
+
+    // Build the job's options from the flags
+    ZipOptions options;
+    bool levelOk = false;
+    bool threadsOk = false;
+    bool walkerThreadsOk = false;
+    options.level = parser.value(levelOption).toInt(&levelOk);
+    int threads = parser.value(threadsOption).toInt(&threadsOk);
+    options.walkerThreads = parser.value(walkerThreadsOption).toInt(&walkerThreadsOk);
+    if (!levelOk || options.level < 0 || options.level > 10 || !threadsOk || threads < 0 || !walkerThreadsOk || options.walkerThreads < 0) {
+        fprintf(stderr, "Invalid --level, --threads or --walker-threads\n");
+        return 2;
+    }
+    if (parser.isSet(memoryOption)) {
+        qint64 budget = parser.value(memoryOption).toLongLong() * 1024 * 1024;
+        if (budget <= 0) {
+            fprintf(stderr, "Invalid --memory\n");
+            return 2;
+        }
+        options.readAheadBytes = budget / 2;
+        options.lowMemory = budget < 64 * 1024 * 1024;
+        MemoryGovernor::instance()->setBudget(budget);
+    }
+    if (!parseRateLimit(parser, readLimitOption, options.readLimit) || !parseRateLimit(parser, writeLimitOption, options.writeLimit)) {
+        fprintf(stderr, "Invalid --read-limit or --write-limit\n");
+        return 2;
+    }
+    options.background = parser.isSet(backgroundOption);
+
+    // The shared scheduler has one worker per available core, --threads gets the job a scheduler of its own
+    std::unique_ptr<ZipScheduler> scheduler;
+    if (threads > 0) {
+        scheduler.reset(new ZipScheduler(threads, options.background));
+        options.compressionScheduler = scheduler.get();
+    }
+    if (!applyIoMode(parser.value(ioOption), options)) {
+        fprintf(stderr, "Invalid --io mode\n");
+        return 2;
+    }
+    options.excludePatterns = parser.values(excludeOption);
+    options.includePatterns = parser.values(includeOption);
+    options.ignoreFileName = parser.value(ignoreFileOption);
+    options.sparseOutput = parser.isSet(sparseOption);
+    options.hugePages = parser.isSet(hugePagesOption);
+    options.progress = std::make_shared<ZipProgress>();
+
+    // Run the command, timing it in wall clock and CPU time (all threads)
+    QElapsedTimer timer;
+    timer.start();
+    std::clock_t cpuStart = std::clock();
+    Stats stats;
+    if (command == "zip" && !args.isEmpty()) {
+        stats.ok = zipCommand(zipFilename, args, options, stats);
+    } else if (command == "unzip") {
+        stats.ok = unzipCommand(zipFilename, parser.value(outputOption), options, stats);
+    } else if (command == "list") {
+        stats.ok = listCommand(zipFilename, options, json, stats);
+    } else if (command == "test") {
+        stats.ok = testCommand(zipFilename, options, stats);
+    } else if (command == "append" && !args.isEmpty()) {
+        stats.ok = appendCommand(zipFilename, args, options, stats);
+    } else if (command == "repack") {
+        stats.ok = repackCommand(zipFilename, parser.value(outputOption), options, stats);
+    } else {
+        parser.showHelp(2);
+    }
+    double wallSeconds = timer.nsecsElapsed() / 1e9;
+    double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    double throughput = wallSeconds > 0 ? qMax(stats.bytesIn, stats.bytesOut) / wallSeconds / 1e6 : 0;
+    MemoryGovernor::Stats memory = MemoryGovernor::instance()->stats();
+    int workers = options.scheduler()->workerCount();
+    QString threadSource = scheduler ? QString("--threads") : CpuCount::info().source;
+    ZipLog::flush();
+    if (ZipLog::dropped()) {
+        fprintf(stderr, "%llu log messages dropped\n", static_cast<unsigned long long>(ZipLog::dropped()));
+    }
+
+    if (json) {
+        QJsonObject result;
+        result["command"] = command;
+        result["archive"] = zipFilename;
+        result["ok"] = stats.ok;
+        result["entries"] = stats.entries;
+        result["bytesIn"] = stats.bytesIn;
+        result["bytesOut"] = stats.bytesOut;
+        result["wallSeconds"] = wallSeconds;
+        result["cpuSeconds"] = cpuSeconds;
+        result["throughputMBps"] = throughput;
+        result["peakMemoryBytes"] = memory.peak;
+        result["memoryWaitSeconds"] = memory.waitNanoseconds / 1e9;
+        result["memoryBackoffs"] = static_cast<qint64>(memory.backoffs);
+        result["threads"] = workers;
+        result["threadSource"] = threadSource;
+        if (command == "list") {
+            result["files"] = stats.list;
+        }
+        QTextStream(stdout) << QJsonDocument(result).toJson(QJsonDocument::Compact) << "\n";
+    } else if (command != "list") {
+        fprintf(stderr, "%s %s: %d files, %lld bytes in, %lld bytes out, %.2f s wall, %.2f s CPU, %.1f MB/s, %.1f MB peak buffered, %d threads (%s)\n",
+                stats.ok ? "OK" : "FAILED", qPrintable(command), stats.entries, static_cast<long long>(stats.bytesIn),
+                static_cast<long long>(stats.bytesOut), wallSeconds, cpuSeconds, throughput, memory.peak / 1e6,
+                workers, qPrintable(threadSource));
+    }
+    return stats.ok ? 0 : 1;
+}
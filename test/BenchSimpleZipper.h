@@ -0,0 +1,217 @@
+#ifndef BENCHSIMPLEZIPPER_H
+#define BENCHSIMPLEZIPPER_H
+
+#include <QtCore>
+#include <QtTest/QtTest>
+
+#include "SimpleZipper.h"
+#include "NumaTopology.h"
+#include "PageAllocator.h"
+#include "ZipScheduler.h"
+#include "ZipStatePool.h"
+
+/**
+ * @class   BenchSimpleZipper
+ *
+ * @brief   Benchmarks for the SimpleZipper class.
+ *
+ * @details The BenchSimpleZipper class times zipping and unzipping a folder with lots of small files, with and without
+ *          the thread-local compressor / decompressor state pool. The number of scratch buffers allocated and reused
+ *          by the pool is printed after each run. It also times zipping a large file with the default and low-memory
+ *          compressor profiles and prints the compressor memory per job, with and without huge pages, and with and
+ *          without NUMA placement of the compression workers. These aren't part of the unit tests, run the
+ *          BenchSimpleZipper executable directly.
+ */
+class BenchSimpleZipper : public QObject {
+    Q_OBJECT
+
+private:
+    static const int NumFiles = 2000;
+    static const int LargeFileLines = 1000000;
+
+    QDir mTempDir;
+    QString mFolder;
+    QString mLargeFile;
+
+    /**
+     * @brief Adds the pooled and unpooled rows used by each benchmark.
+     */
+    static void addPoolRows() {
+        QTest::addColumn<bool>("pooled");
+        QTest::newRow("per-entry allocation") << false;
+        QTest::newRow("thread-local pool") << true;
+    }
+
+    /**
+     * @brief Prints the pool counters for the last benchmark run.
+     */
+    static void printStats(bool pooled) {
+        ZipStatePool::Stats stats = ZipStatePool::stats();
+        if (pooled) {
+            qInfo() << "Scratch buffers allocated:" << stats.allocations << "reused:" << stats.reuses;
+        } else {
+            qInfo() << "Pooling disabled, scratch buffers allocated and freed for each of the" << NumFiles << "entries";
+        }
+    }
+
+private slots:
+    /**
+     * @brief Creates a temporary folder with lots of small text files and zips it once for the unzip benchmark,
+     *        and a large text file for the compressor profile benchmark.
+     */
+    void initTestCase() {
+        mTempDir = QDir(QDir::tempPath() + "/BenchSimpleZipper");
+        mFolder = mTempDir.filePath("smallFiles");
+        QVERIFY(QDir(mFolder).mkpath("."));
+
+        for (int i = 0; i < NumFiles; i++) {
+            QFile file(mFolder + QString("/file%1.txt").arg(i));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(QByteArray("Small file number ").append(QByteArray::number(i)).repeated(i % 50 + 1));
+            file.close();
+        }
+
+        QVERIFY(SimpleZipper::zipFolder(mFolder, mTempDir.filePath("smallFiles.zip")));
+
+        mLargeFile = mTempDir.filePath("large.txt");
+        QFile largeFile(mLargeFile);
+        QVERIFY(largeFile.open(QIODevice::WriteOnly));
+        for (int i = 0; i < LargeFileLines; i++) {
+            largeFile.write(QByteArray("Line ").append(QByteArray::number(i)).append(", value ").append(QByteArray::number((i * 7919) % 1000)).append("\n"));
+        }
+        largeFile.close();
+    }
+
+    void benchZipFolder_data() {
+        addPoolRows();
+    }
+
+    /**
+     * @brief Times zipping the folder of small files.
+     */
+    void benchZipFolder() {
+        QFETCH(bool, pooled);
+        ZipStatePool::setEnabled(pooled);
+        ZipStatePool::release();
+        ZipStatePool::resetStats();
+
+        QBENCHMARK {
+            QVERIFY(SimpleZipper::zipFolder(mFolder, mTempDir.filePath("bench.zip")));
+        }
+
+        printStats(pooled);
+        ZipStatePool::setEnabled(true);
+    }
+
+    void benchUnzipFile_data() {
+        addPoolRows();
+    }
+
+    /**
+     * @brief Times unzipping the folder of small files.
+     */
+    void benchUnzipFile() {
+        QFETCH(bool, pooled);
+        ZipStatePool::setEnabled(pooled);
+        ZipStatePool::release();
+        ZipStatePool::resetStats();
+
+        QBENCHMARK {
+            QVERIFY(SimpleZipper::unzipFile(mTempDir.filePath("smallFiles.zip"), mTempDir.filePath("unzipped")));
+        }
+
+        printStats(pooled);
+        ZipStatePool::setEnabled(true);
+    }
+
+    void benchCompressorProfile_data() {
+        QTest::addColumn<bool>("lowMemory");
+        QTest::newRow("default") << false;
+        QTest::newRow("low memory") << true;
+    }
+
+    /**
+     * @brief Times zipping a large file with the default and low-memory compressor profiles.
+     */
+    void benchCompressorProfile() {
+        QFETCH(bool, lowMemory);
+        ZipOptions options;
+        options.lowMemory = lowMemory;
+        QString zipPath = mTempDir.filePath("large.zip");
+
+        QBENCHMARK {
+            QVERIFY(SimpleZipper::zipFile(mLargeFile, zipPath, options));
+        }
+
+        qInfo() << "Compressor state per job:" << tdefl_compressor_size(lowMemory ? TDEFL_LOW_MEMORY_FLAG : 0) << "bytes,"
+                << "input:" << QFileInfo(mLargeFile).size() << "bytes, compressed:" << QFileInfo(zipPath).size() << "bytes";
+    }
+
+    void benchHugePages_data() {
+        QTest::addColumn<bool>("hugePages");
+        QTest::newRow("4 KB pages") << false;
+        QTest::newRow("huge pages") << true;
+    }
+
+    /**
+     * @brief Times zipping and unzipping a large file with and without huge page backed buffers.
+     *
+     * @details On Linux, run with "-perf -perfcounter dTLB-load-misses" to count TLB misses instead of wall time.
+     */
+    void benchHugePages() {
+        QFETCH(bool, hugePages);
+        ZipOptions options;
+        options.hugePages = hugePages;
+        QString zipPath = mTempDir.filePath("hugePages.zip");
+        QString unzipDir = mTempDir.filePath("hugePages");
+
+        QBENCHMARK {
+            QVERIFY(SimpleZipper::zipFile(mLargeFile, zipPath, options));
+            QVERIFY(SimpleZipper::unzipFile(zipPath, unzipDir, options));
+        }
+
+        qInfo() << "Input:" << QFileInfo(mLargeFile).size() << "bytes, huge page size:" << PageAllocator::hugePageSize() << "bytes";
+    }
+
+    void benchNumaPlacement_data() {
+        QTest::addColumn<bool>("numaPlacement");
+        QTest::newRow("floating workers") << false;
+        QTest::newRow("workers pinned per node") << true;
+    }
+
+    /**
+     * @brief Times zipping the large file, read into memory, on a scheduler with and without NUMA placement.
+     *
+     * @details Only different on a machine with more than one NUMA node. The counters show how many chunks were
+     *          compressed on the node their input was read into.
+     */
+    void benchNumaPlacement() {
+        QFETCH(bool, numaPlacement);
+        ZipScheduler scheduler(0, false, numaPlacement);
+        ZipOptions options;
+        options.compressionScheduler = &scheduler;
+        options.mapThreshold = 0;
+        QString zipPath = mTempDir.filePath("numa.zip");
+
+        QBENCHMARK {
+            QVERIFY(SimpleZipper::zipFile(mLargeFile, zipPath, options));
+        }
+
+        ZipScheduler::Stats stats = scheduler.stats();
+        qInfo() << "NUMA nodes:" << NumaTopology::instance().nodeCount() << "workers:" << scheduler.workerCount()
+                << "on" << stats.nodes << "nodes, chunks on their input's node:" << stats.nodeLocal
+                << "on another node:" << stats.nodeRemote << "steals:" << stats.steals;
+    }
+
+    /**
+     * @brief Deletes the temporary directory and all files created in it.
+     */
+    void cleanupTestCase() {
+        QVERIFY(mTempDir.removeRecursively());
+    }
+
+};
+
+QTEST_MAIN(BenchSimpleZipper)
+
+#endif // BENCHSIMPLEZIPPER_H
@@ -3,8 +3,35 @@
 
 #include <QtCore>
 #include <QtTest/QtTest>
+#include <atomic>
+#include <future>
+#include <thread>
 
+#if defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BatchFileReader.h"
+#include "CpuCount.h"
+#include "DirectoryWalker.h"
+#include "DiskOrder.h"
+#include "MemoryGovernor.h"
+#include "NumaTopology.h"
+#include "PageCache.h"
+#include "ParallelDeflate.h"
+#include "RateLimiter.h"
 #include "SimpleZipper.h"
+#include "SparseFileWriter.h"
+#include "ZipArena.h"
+#include "ZipJob.h"
+#include "ZipLog.h"
+#include "ZipReader.h"
+#include "ZipScheduler.h"
+#include "ZipStatePool.h"
+#include "ZipWriter.h"
 
 /**
  * @class   TestSimpleZipper
@@ -27,6 +54,56 @@ private:
     QFile mSubFile1;
     QFile mSubFile2;
 
+    /**
+     * @brief Writes data to a file, replacing anything already there.
+     */
+    static void writeFile(const QString& filename, const QByteArray& data) {
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(data), qint64(data.size()));
+        file.close();
+    }
+
+    /**
+     * @brief Zips a file with the options, deletes it, unzips it next to where it was and checks the contents.
+     *
+     * @details The unzipped file is left in place for the caller to check further and delete, the archive is deleted.
+     */
+    void roundTripFile(const ZipOptions& options, const QString& filename, const QByteArray& expected) {
+        QString zipFilename = filename + ".zip";
+        QVERIFY(SimpleZipper::zipFile(filename, zipFilename, options));
+        QVERIFY(QFile::remove(filename));
+        QVERIFY(SimpleZipper::unzipFile(zipFilename, QFileInfo(filename).path(), options));
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVERIFY(file.readAll() == expected);
+        file.close();
+        QVERIFY(QFile::remove(zipFilename));
+    }
+
+    /**
+     * @brief Writes data to a temporary file, zips and unzips it with the options, checks the contents survive and
+     *        cleans up.
+     */
+    void roundTrip(const ZipOptions& options, const QByteArray& data) {
+        QString filename = mTempDir.filePath("roundTrip.bin");
+        writeFile(filename, data);
+        roundTripFile(options, filename, data);
+        QVERIFY(QFile::remove(filename));
+    }
+
+    /**
+     * @brief Writes an archive with one entry, compressed on the calling thread with its huge page state.
+     */
+    static bool zipHugePageEntry(const QString& zipFilename, const QByteArray& data, bool lowMemory) {
+        ZipOptions options;
+        options.hugePages = true;
+        options.lowMemory = lowMemory;
+        options.parallelCompression = false;
+        ZipWriter writer(options);
+        return writer.open(zipFilename) && writer.addData("entry.txt", data) && writer.close();
+    }
+
 private slots:
     /**
      * @brief Creates a temporary directory with three text files and a subdirectory with two text files.
@@ -153,6 +230,1084 @@ private slots:
         mFile1.close();
     }
 
+    /**
+     * @brief Checks the checksum kernels against known answers and zips and unzips a file at each CPU dispatch level the host supports.
+     */
+    void testCpuDispatchLevels()
+    {
+        // Create a file with a mix of literals, long matches and zero runs
+        QByteArray data;
+        for (int i = 0; i < 20000; i++) {
+            data.append(QByteArray::number(i % 97).repeated(i % 5 + 1));
+            data.append(QByteArray(i % 13, '\0'));
+        }
+        QString filename = mTempDir.filePath("levels.bin");
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+        file.close();
+
+        // The standard check values, at an odd address, and a long unaligned run that isn't a multiple of any SIMD width
+        const QByteArray check("x123456789");
+        const mz_uint8* checkData = reinterpret_cast<const mz_uint8*>(check.constData()) + 1;
+        const mz_uint8* oddData = reinterpret_cast<const mz_uint8*>(data.constData()) + 3;
+        const size_t oddLength = 100003;
+        mz_ulong genericCrc = 0;
+        mz_ulong genericAdler = 0;
+
+        mz_cpu_level originalLevel = mz_cpu_get_level();
+        for (int level = MZ_CPU_LEVEL_GENERIC; level <= MZ_CPU_LEVEL_ARMV8_CRC; level++) {
+            if (!mz_cpu_set_level(static_cast<mz_cpu_level>(level))) {
+                continue;
+            }
+
+            // Checksums that are wrong the same way on both sides would still round trip
+            QCOMPARE(mz_crc32(MZ_CRC32_INIT, checkData, 9), mz_ulong(0xCBF43926));
+            QCOMPARE(mz_adler32(MZ_ADLER32_INIT, checkData, 9), mz_ulong(0x091E01DE));
+            if (level == MZ_CPU_LEVEL_GENERIC) {
+                genericCrc = mz_crc32(MZ_CRC32_INIT, oddData, oddLength);
+                genericAdler = mz_adler32(MZ_ADLER32_INIT, oddData, oddLength);
+            } else {
+                QCOMPARE(mz_crc32(MZ_CRC32_INIT, oddData, oddLength), genericCrc);
+                QCOMPARE(mz_adler32(MZ_ADLER32_INIT, oddData, oddLength), genericAdler);
+            }
+
+            // Zip and unzip the file, the extraction checks the CRC-32 of the output
+            QString levelName = mz_cpu_get_level_name(static_cast<mz_cpu_level>(level));
+            QString zipPath = mTempDir.filePath("levels_" + levelName + ".zip");
+            QString unzipDir = mTempDir.filePath("levels_" + levelName);
+            QVERIFY(SimpleZipper::zipFile(filename, zipPath));
+            QVERIFY(SimpleZipper::unzipFile(zipPath, unzipDir));
+
+            QFile unzippedFile(unzipDir + "/levels.bin");
+            QVERIFY(unzippedFile.open(QIODevice::ReadOnly));
+            QCOMPARE(unzippedFile.readAll(), data);
+        }
+        mz_cpu_set_level(originalLevel);
+    }
+
+    /**
+     * @brief Zips and unzips a file using the low-memory compressor profile and checks the contents survive.
+     */
+    void testLowMemoryProfile()
+    {
+        // Large enough to need several of the smaller LZ code buffers
+        QByteArray data;
+        for (int i = 0; i < 50000; i++) {
+            data.append("line ").append(QByteArray::number(i % 1234)).append('\n');
+        }
+        ZipOptions options;
+        options.lowMemory = true;
+        roundTrip(options, data);
+    }
+
+    /**
+     * @brief Round trips with huge page buffers, then copies between a huge page reader and a normal writer on one
+     *        thread and checks each keeps its own buffers rather than freeing the other's, and that buffers given
+     *        back to the huge page region are reused as entries cycle.
+     */
+    void testHugePages()
+    {
+        QByteArray data = QByteArray("huge pages ").repeated(20000);
+        ZipOptions hugeOptions;
+        hugeOptions.hugePages = true;
+        roundTrip(hugeOptions, data);
+
+        QString sourceFilename = mTempDir.filePath("hugeSource.zip");
+        ZipWriter source(hugeOptions);
+        QVERIFY(source.open(sourceFilename));
+        for (int i = 0; i < 4; i++) {
+            QVERIFY(source.addData(QString("entry%1.txt").arg(i), data + QByteArray::number(i)));
+        }
+        QVERIFY(source.close());
+
+        // Both archives compress and extract on this thread, alternating between the two states
+        ZipReader reader(hugeOptions);
+        QVERIFY(reader.open(sourceFilename));
+        ZipOptions normalOptions;
+        normalOptions.parallelCompression = false;
+        ZipWriter writer(normalOptions);
+        QString copyFilename = mTempDir.filePath("hugeCopy.zip");
+        QVERIFY(writer.open(copyFilename));
+        QByteArray extracted;
+        quint64 allocations = 0;
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(reader.extract(i, extracted));
+            QVERIFY(writer.addData(QString("entry%1.txt").arg(i), extracted));
+            if (i == 0) {
+                allocations = ZipStatePool::stats().allocations;
+            }
+        }
+        QCOMPARE(ZipStatePool::stats().allocations, allocations);
+        QVERIFY(writer.close());
+        reader.close();
+
+        QVERIFY(reader.open(copyFilename));
+        QCOMPARE(reader.count(), 4);
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(reader.extract(i, extracted));
+            QVERIFY(extracted == data + QByteArray::number(i));
+        }
+        reader.close();
+        QVERIFY(QFile::remove(sourceFilename));
+        QVERIFY(QFile::remove(copyFilename));
+
+        // Going from a low-memory compressor to a full one gives the smaller block back to the region
+        QString cycleFilename = mTempDir.filePath("hugeCycle.zip");
+        ZipStatePool::release();
+        QVERIFY(zipHugePageEntry(cycleFilename, data, false));
+        size_t fullBytes = ZipStatePool::stats().hugePageBytes;
+        QVERIFY(fullBytes > 0);
+        ZipStatePool::release();
+        QVERIFY(zipHugePageEntry(cycleFilename, data, true));
+        QVERIFY(zipHugePageEntry(cycleFilename, data, false));
+        QCOMPARE(ZipStatePool::stats().hugePageBytes, fullBytes);
+
+        // Cycling through more entries, extracting each one, reuses the same part of the region
+        size_t cycleBytes = 0;
+        for (int i = 0; i < 6; i++) {
+            QVERIFY(zipHugePageEntry(cycleFilename, data, i % 2 == 0));
+            QVERIFY(reader.open(cycleFilename));
+            QVERIFY(reader.extract(0, extracted));
+            QVERIFY(extracted == data);
+            reader.close();
+            if (i == 0) {
+                cycleBytes = ZipStatePool::stats().hugePageBytes;
+            }
+        }
+        QCOMPARE(ZipStatePool::stats().hugePageBytes, cycleBytes);
+        QCOMPARE(ZipStatePool::stats().hugePageFallbacks, quint64(0));
+        ZipStatePool::release();
+        QVERIFY(QFile::remove(cycleFilename));
+    }
+
+    /**
+     * @brief Writes and reads a zip archive in memory using an arena and checks all of the memory is accounted for.
+     */
+    void testArenaAllocator()
+    {
+        QByteArray data = QByteArray("arena test data ").repeated(10000);
+        ZipArena arena(64 * 1024);
+
+        // Write the archive, the heap buffer is kept alive until it has been read back
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+        arena.install(&zip);
+        QVERIFY(mz_zip_writer_init_heap(&zip, 0, 0));
+        for (int i = 0; i < 100; i++) {
+            QVERIFY(mz_zip_writer_add_mem(&zip, QByteArray::number(i).constData(), data.constData(), data.size() - i, MZ_DEFAULT_COMPRESSION));
+        }
+        void* zipData = nullptr;
+        size_t zipSize = 0;
+        QVERIFY(mz_zip_writer_finalize_heap_archive(&zip, &zipData, &zipSize));
+        QVERIFY(mz_zip_writer_end(&zip));
+        QVERIFY(arena.bytesInUse() >= zipSize);
+
+        // Read it back
+        memset(&zip, 0, sizeof(zip));
+        arena.install(&zip);
+        QVERIFY(mz_zip_reader_init_mem(&zip, zipData, zipSize, 0));
+        for (int i = 0; i < 100; i++) {
+            size_t size = 0;
+            void* entry = mz_zip_reader_extract_to_heap(&zip, i, &size, 0);
+            QVERIFY(entry);
+            QCOMPARE(QByteArray(static_cast<const char*>(entry), static_cast<int>(size)), data.left(data.size() - i));
+            arena.deallocate(entry);
+        }
+        QVERIFY(mz_zip_reader_end(&zip));
+        arena.deallocate(zipData);
+
+        // Everything has been freed, and the memory goes back to the OS on reset
+        QCOMPARE(arena.bytesInUse(), size_t(0));
+        QVERIFY(arena.peakBytesInUse() > size_t(data.size()));
+        arena.reset();
+        QCOMPARE(arena.bytesReserved(), size_t(0));
+    }
+
+    /**
+     * @brief Reads the test files with both batch reader backends and checks they come back in order.
+     */
+    void testBatchFileReader()
+    {
+        QVector<ZipEntry> entries;
+        QList<QByteArray> expected;
+        for (QFile* file : {&mFile1, &mFile2, &mFile3, &mSubFile1, &mSubFile2}) {
+            entries.append({file->fileName(), QString()});
+            QVERIFY(file->open(QIODevice::ReadOnly));
+            expected.append(file->readAll());
+            file->close();
+        }
+        entries.append({mTempDir.filePath("missing.txt"), QString()});
+
+        for (auto backend : {BatchFileReader::Auto, BatchFileReader::ThreadPool}) {
+            BatchFileReader reader(2, backend);
+            int next = 0;
+            bool ok = reader.read(entries, [&](int index, const ZipEntry& entry, FileContents& contents) {
+                bool inOrder = index == next++ && entry.sourcePath == entries[index].sourcePath;
+                if (index < expected.size()) {
+                    return inOrder && contents.ok && contents.data == expected[index];
+                }
+                return inOrder && !contents.ok;
+            });
+            QVERIFY(ok);
+            QCOMPARE(next, entries.size());
+        }
+    }
+
+    /**
+     * @brief Reads a pipe, which has no size and returns short reads, through io_uring and checks none of it is lost.
+     */
+    void testBatchFileReaderUnknownSize()
+    {
+#if defined(Q_OS_LINUX)
+        if (!BatchFileReader::ioUringSupported()) {
+            QSKIP("io_uring isn't supported");
+        }
+        QByteArray data;
+        for (int i = 0; data.size() < 300000; i++) {
+            data += QByteArray::number(i) + " piped ";
+        }
+        QString filename = mTempDir.filePath("unknownSize.fifo");
+        QCOMPARE(mkfifo(QFile::encodeName(filename).constData(), 0600), 0);
+
+        // Written a bit at a time, so the reads come back short long before the end
+        std::thread writer([&filename, &data]() {
+            sigset_t pipeSignal;
+            sigemptyset(&pipeSignal);
+            sigaddset(&pipeSignal, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+            int fd = open(QFile::encodeName(filename).constData(), O_WRONLY);
+            for (int offset = 0; fd >= 0 && offset < data.size(); offset += 10000) {
+                if (write(fd, data.constData() + offset, static_cast<size_t>(qMin(10000, data.size() - offset))) < 0) {
+                    break;
+                }
+                QThread::msleep(1);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        });
+
+        QVector<ZipEntry> entries;
+        entries.append({filename, QString()});
+        QByteArray read;
+        BatchFileReader reader(1, BatchFileReader::IoUring);
+        bool ok = reader.read(entries, [&read](int, const ZipEntry&, FileContents& contents) {
+            read = contents.data;
+            return contents.ok;
+        });
+        writer.join();
+        QVERIFY(ok);
+        QCOMPARE(read.size(), data.size());
+        QVERIFY(read == data);
+        QVERIFY(QFile::remove(filename));
+#else
+        QSKIP("io_uring is Linux only");
+#endif
+    }
+
+    /**
+     * @brief Zips an explicit list of files under new names and checks they unzip to the same contents.
+     */
+    void testZipFileList()
+    {
+        QVector<ZipEntry> entries = {
+            {mFile3.fileName(), "c.txt"},
+            {mFile1.fileName(), "a.txt"},
+            {mSubFile1.fileName(), "docs/sub.txt"}
+        };
+        QString zipFilename = mTempDir.filePath("list.zip");
+        QVERIFY(SimpleZipper::zipFiles(zipFilename, entries));
+
+        // The archive lists the files in the order given
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+        QVERIFY(mz_zip_reader_init_file(&zip, zipFilename.toUtf8().constData(), 0));
+        QCOMPARE(mz_zip_reader_get_num_files(&zip), mz_uint(entries.size()));
+        for (int i = 0; i < entries.size(); i++) {
+            char name[64];
+            mz_zip_reader_get_filename(&zip, i, name, sizeof(name));
+            QCOMPARE(QString(name), entries[i].archiveName);
+        }
+        QVERIFY(mz_zip_reader_end(&zip));
+
+        QString outputFolder = mTempDir.filePath("list");
+        QVERIFY(SimpleZipper::unzipFile(zipFilename, outputFolder));
+        for (const auto& entry : entries) {
+            QFile source(entry.sourcePath);
+            QFile unzipped(outputFolder + "/" + entry.archiveName);
+            QVERIFY(source.open(QIODevice::ReadOnly));
+            QVERIFY(unzipped.open(QIODevice::ReadOnly));
+            QCOMPARE(unzipped.readAll(), source.readAll());
+        }
+
+        // A missing file fails the job before anything is written
+        entries.append({mTempDir.filePath("missing.txt"), "missing.txt"});
+        QVERIFY(QFile::remove(zipFilename));
+        QVERIFY(!SimpleZipper::zipFiles(zipFilename, entries));
+        QVERIFY(!QFile::exists(zipFilename));
+        QVERIFY(QDir(outputFolder).removeRecursively());
+    }
+
+    /**
+     * @brief Adds to one archive over several calls with a ZipWriter, then reads it back with a ZipReader.
+     */
+    void testZipWriterReader()
+    {
+        QString zipFilename = mTempDir.filePath("session.zip");
+        ZipWriter writer;
+        QVERIFY(writer.open(zipFilename));
+        QVERIFY(writer.addData("notes.txt", "Written from memory"));
+        QVERIFY(writer.addFile(mFile1.fileName(), "first.txt"));
+
+        // Moving the writer keeps the archive open
+        ZipWriter moved(std::move(writer));
+        QVERIFY(!writer.isOpen());
+        QVERIFY(moved.addFolder(mSubDir.path(), "sub/"));
+        QCOMPARE(moved.count(), 4);
+        QVERIFY(moved.close());
+
+        ZipReader reader;
+        QVERIFY(reader.open(zipFilename));
+        QCOMPARE(reader.count(), 4);
+        QCOMPARE(reader.indexOf("missing.txt"), -1);
+
+        // The same buffer is used for each file
+        QByteArray data;
+        QVERIFY(reader.extract(reader.indexOf("notes.txt"), data));
+        QCOMPARE(data, QByteArray("Written from memory"));
+        QVERIFY(reader.extract(reader.indexOf("sub/mSubFile2.txt"), data));
+        QCOMPARE(data, QByteArray("Sub File 2"));
+        QVERIFY(reader.extract(reader.indexOf("first.txt"), data));
+        QCOMPARE(data, QByteArray("Hello World!"));
+        reader.close();
+        QVERIFY(QFile::remove(zipFilename));
+
+        // Aborting leaves nothing behind
+        QVERIFY(writer.open(zipFilename));
+        QVERIFY(!writer.addFile(mTempDir.filePath("missing.txt"), "missing.txt"));
+        writer.abort();
+        QVERIFY(!QFile::exists(zipFilename));
+    }
+
+    /**
+     * @brief Zips lots of files through the read, compress and write threads, with and without pipelining, then
+     *        checks a file that can't be read fails the job without leaving the reader thread stuck.
+     */
+    void testPipeline()
+    {
+        QDir root(mTempDir.filePath("pipeline"));
+        QVERIFY(root.mkpath("."));
+        QVector<ZipEntry> entries;
+        QList<QByteArray> contents;
+        for (int i = 0; i < 50; i++) {
+            QByteArray data = QByteArray("pipeline file ").append(QByteArray::number(i)).repeated(i * 100 + 1);
+            QString name = QString("file%1.txt").arg(i);
+            writeFile(root.filePath(name), data);
+            entries.append({root.filePath(name), name});
+            contents.append(data);
+        }
+
+        QString zipFilename = mTempDir.filePath("pipeline.zip");
+        for (bool pipelined : {true, false}) {
+            ZipOptions options;
+            options.pipelined = pipelined;
+            options.readAheadFiles = 2;
+            ZipWriter writer(options);
+            QVERIFY(writer.open(zipFilename));
+            QVERIFY(writer.addEntries(entries));
+            QVERIFY(writer.close());
+
+            ZipReader reader;
+            QVERIFY(reader.open(zipFilename));
+            QCOMPARE(reader.count(), entries.size());
+            QByteArray extracted;
+            for (int i = 0; i < entries.size(); i++) {
+                QCOMPARE(reader.indexOf(entries[i].archiveName), i);
+                QVERIFY(reader.extract(i, extracted));
+                QVERIFY(extracted == contents[i]);
+            }
+            reader.close();
+
+            // A file that has gone since it was listed, with the reader already blocked on a full queue behind it
+            QVector<ZipEntry> broken = entries;
+            broken.insert(1, {root.filePath("missing.txt"), "missing.txt"});
+            QVERIFY(writer.open(zipFilename));
+            QVERIFY(!writer.addEntries(broken));
+            writer.abort();
+            QVERIFY(!QFile::exists(zipFilename));
+        }
+        QVERIFY(root.removeRecursively());
+    }
+
+    /**
+     * @brief Copies an archive's files into a new one without recompressing, then recompresses them into another,
+     *        and checks each one's CRC-32.
+     */
+    void testCopyAndVerify()
+    {
+        QString zipFilename = mTempDir.filePath("source.zip");
+        ZipOptions options;
+        options.level = 0;
+        ZipWriter writer(options);
+        QVERIFY(writer.open(zipFilename));
+        QVERIFY(writer.addFolder(mSubDir.path(), "sub/"));
+        QVERIFY(writer.close());
+
+        ZipReader reader;
+        QVERIFY(reader.open(zipFilename));
+        QVERIFY(!reader.isZip64());
+        QString copyFilename = mTempDir.filePath("copy.zip");
+        QVERIFY(writer.open(copyFilename));
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(reader.verify(i));
+            QVERIFY(writer.copyFrom(reader, i));
+        }
+        QVERIFY(writer.addData("extra.txt", "Appended"));
+        QVERIFY(writer.close());
+        reader.close();
+
+        // Stored files are copied byte for byte
+        QVERIFY(reader.open(copyFilename));
+        QCOMPARE(reader.count(), 3);
+        QByteArray data;
+        QVERIFY(reader.extract(reader.indexOf("sub/mSubFile2.txt"), data));
+        QCOMPARE(data, QByteArray("Sub File 2"));
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(reader.verify(i));
+        }
+
+        // Recompressing streams each file from the stored copy into a deflated one
+        QString recompressedFilename = mTempDir.filePath("recompressed.zip");
+        ZipWriter recompressed;
+        QVERIFY(recompressed.open(recompressedFilename));
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(recompressed.recompressFrom(reader, i));
+        }
+        QVERIFY(recompressed.close());
+        reader.close();
+        QVERIFY(reader.open(recompressedFilename));
+        QCOMPARE(reader.count(), 3);
+        mz_zip_archive_file_stat fileStat;
+        QVERIFY(reader.stat(reader.indexOf("extra.txt"), fileStat));
+        QCOMPARE(int(fileStat.m_method), MZ_DEFLATED);
+        QVERIFY(reader.extract(reader.indexOf("extra.txt"), data));
+        QCOMPARE(data, QByteArray("Appended"));
+        for (int i = 0; i < reader.count(); i++) {
+            QVERIFY(reader.verify(i));
+        }
+        reader.close();
+        QVERIFY(QFile::remove(zipFilename));
+        QVERIFY(QFile::remove(copyFilename));
+        QVERIFY(QFile::remove(recompressedFilename));
+    }
+
+    /**
+     * @brief Runs a folder zip in the background to the end, then cancels a big file zip part way through and checks
+     *        nothing is left.
+     */
+    void testAsyncZip()
+    {
+        QString zipFilename = mTempDir.filePath("async.zip");
+        QScopedPointer<ZipJob> job(SimpleZipper::zipFolderAsync(mSubDir.path(), zipFilename));
+        QSignalSpy finishedSpy(job.data(), &ZipJob::finished);
+        QVERIFY(job->result());
+
+        // finished is posted to this thread, so it still arrives when the job is done before the spy is connected
+        QTRY_COMPARE(finishedSpy.count(), 1);
+        QCOMPARE(finishedSpy.at(0).at(0).toBool(), true);
+        ZipProgress::Snapshot progress = job->progress();
+        QVERIFY(progress.bytesTotal > 0);
+        QCOMPARE(progress.bytesDone, progress.bytesTotal);
+        QCOMPARE(progress.entriesDone, progress.entriesTotal);
+        QVERIFY(QFile::remove(zipFilename));
+
+        // Limited to a few seconds' work, so the job is still writing when the first progress report cancels it
+        QString filename = mTempDir.filePath("async.txt");
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray("cancel me ").repeated(6000000));
+        file.close();
+        ZipOptions options;
+        options.readLimit = std::make_shared<RateLimiter>(10 * 1000 * 1000);
+        job.reset(SimpleZipper::zipFileAsync(filename, zipFilename, options));
+        std::atomic<bool> partial(false);
+        ZipJob* running = job.data();
+        connect(running, &ZipJob::progressChanged, running, [running, &partial, &zipFilename](qint64 bytesDone) {
+            if (bytesDone > 0 && !running->isCanceled()) {
+                partial = QFile::exists(zipFilename);
+                running->cancel();
+            }
+        }, Qt::DirectConnection);
+        QVERIFY(!job->result());
+        QVERIFY(job->isCanceled());
+        QVERIFY(partial);
+        QVERIFY(!QFile::exists(zipFilename));
+        QVERIFY(file.remove());
+    }
+
+    /**
+     * @brief Zips a file big enough to be split into chunks on the scheduler, and checks that a high priority group
+     *        that turns up late overtakes a low priority backlog.
+     */
+    void testParallelCompression()
+    {
+        QByteArray data;
+        for (int i = 0; data.size() < 3 * ParallelDeflate::ChunkThreshold; i++) {
+            data += QByteArray::number(i) + " chunk ";
+        }
+        ZipOptions options;
+        options.priority = ZipScheduler::HighPriority;
+        roundTrip(options, data);
+
+        // One worker, held up until both groups are queued, so the order only depends on the fair-share accounting
+        ZipScheduler scheduler(1);
+        ZipScheduler::GroupPtr gate = scheduler.createGroup(ZipScheduler::NormalPriority);
+        ZipScheduler::GroupPtr low = scheduler.createGroup(ZipScheduler::LowPriority);
+        ZipScheduler::GroupPtr high = scheduler.createGroup(ZipScheduler::HighPriority);
+        std::promise<void> open;
+        std::future<void> opened = open.get_future();
+        scheduler.submit(gate, [&opened]() { opened.wait(); });
+        std::atomic<int> lowDone(0);
+        std::atomic<int> lowWhenHighDone(-1);
+        for (int i = 0; i < 50; i++) {
+            scheduler.submit(low, [&lowDone]() { lowDone++; }, 1000);
+        }
+        std::atomic<int> highDone(0);
+        for (int i = 0; i < 10; i++) {
+            scheduler.submit(high, [&]() { if (++highDone == 10) { lowWhenHighDone = lowDone.load(); } }, 1000);
+        }
+        open.set_value();
+        scheduler.wait(high);
+        scheduler.wait(low);
+        scheduler.wait(gate);
+        QCOMPARE(lowDone.load(), 50);
+
+        // Both groups start level, so low gets at most one batch in before high's four times the weight finishes it
+        QVERIFY(lowWhenHighDone >= 0 && lowWhenHighDone <= 4);
+    }
+
+    /**
+     * @brief Checks the memory budget makes readers wait or map files, and is all given back after a zip.
+     */
+    void testMemoryGovernor()
+    {
+        MemoryGovernor governor(1000);
+        MemoryGovernor::LeasePtr first = governor.reserve(250);
+        MemoryGovernor::LeasePtr second = governor.reserve(250);
+        QVERIFY(first && second);
+        QVERIFY(!governor.reserve(251));
+        MemoryGovernor::LeasePtr output = governor.charge(600);
+        QVERIFY(!governor.reserve(100));
+        QCOMPARE(governor.stats().current, qint64(1100));
+        QCOMPARE(governor.stats().peak, qint64(1100));
+        QCOMPARE(governor.stats().backoffs, quint64(2));
+
+        // Giving back the output lets a waiting reader in
+        std::thread release([&output]() { QThread::msleep(20); output.reset(); });
+        MemoryGovernor::LeasePtr waited = governor.reserve(200, 5000);
+        release.join();
+        QVERIFY(waited);
+        QCOMPARE(governor.stats().waits, quint64(1));
+        first.reset();
+        second.reset();
+        waited.reset();
+        QCOMPARE(governor.stats().current, qint64(0));
+
+        // Files too big for the budget are mapped even with mapping turned off
+        QByteArray data = QByteArray("governed input ").repeated(2000);
+        QString filename = mTempDir.filePath("governed.txt");
+        writeFile(filename, data);
+        FileContents contents = BatchFileReader::readFile(filename, 0, false, &governor);
+        QVERIFY(contents.ok && contents.mapping && !contents.lease);
+        contents = BatchFileReader::readFile(filename, 0);
+        QVERIFY(contents.ok && !contents.mapping);
+        contents = FileContents();
+
+        ZipOptions options;
+        options.memoryGovernor = &governor;
+        options.mapThreshold = 0;
+        governor.setBudget(1000000);
+        roundTripFile(options, filename, data);
+        QVERIFY(governor.stats().peak > 0);
+        QCOMPARE(governor.stats().current, qint64(0));
+        QVERIFY(QFile::remove(filename));
+    }
+
+    /**
+     * @brief Checks the rate limiter holds callers to its rate, and that limited background jobs still round trip.
+     */
+    void testRateLimiter()
+    {
+        RateLimiter limiter(1000000);
+        QElapsedTimer timer;
+        timer.start();
+        // The first quarter second is a burst, anything past that has to wait for the bucket to refill
+        QVERIFY(limiter.acquire(250000));
+        QCOMPARE(limiter.throttledNanoseconds(), qint64(0));
+        QVERIFY(limiter.acquire(500000));
+        QVERIFY(timer.elapsed() >= 400);
+        QVERIFY(limiter.throttledNanoseconds() >= 250000000);
+
+        // A cancelled job stops waiting
+        ZipProgress progress;
+        progress.cancel();
+        QVERIFY(!limiter.acquire(10000000, &progress));
+
+        ZipOptions options;
+        options.readLimit = std::make_shared<RateLimiter>(100 * 1000 * 1000);
+        options.writeLimit = std::make_shared<RateLimiter>(100 * 1000 * 1000);
+        options.background = true;
+        roundTrip(options, QByteArray("limited input ").repeated(50000));
+    }
+
+    /**
+     * @brief Checks the cgroup quota parsing, the environment override and that the thread pools use the count.
+     */
+    void testCpuCount()
+    {
+        QCOMPARE(CpuCount::parseCgroupV2("400000 100000\n"), 4.0);
+        QCOMPARE(CpuCount::parseCgroupV2("150000 100000"), 1.5);
+        QCOMPARE(CpuCount::parseCgroupV2("max 100000"), 0.0);
+        QCOMPARE(CpuCount::parseCgroupV2(""), 0.0);
+        QCOMPARE(CpuCount::parseCgroupV1("200000", "100000"), 2.0);
+        QCOMPARE(CpuCount::parseCgroupV1("-1", "100000"), 0.0);
+
+        // Never more than the machine or the affinity mask has, and the override wins outright
+        CpuCount::Info info = CpuCount::detect();
+        QVERIFY(info.threads >= 1 && info.threads <= info.hardware);
+        QVERIFY(info.affinity == 0 || info.threads <= info.affinity);
+        QByteArray saved = qgetenv(CpuCount::EnvironmentVariable);
+        qputenv(CpuCount::EnvironmentVariable, "3");
+        info = CpuCount::detect();
+        QCOMPARE(info.threads, 3);
+        QCOMPARE(info.source, QString("environment"));
+        qputenv(CpuCount::EnvironmentVariable, "nonsense");
+        QVERIFY(CpuCount::detect().source != "environment");
+        if (saved.isNull()) {
+            qunsetenv(CpuCount::EnvironmentVariable);
+        } else {
+            qputenv(CpuCount::EnvironmentVariable, saved);
+        }
+
+        QCOMPARE(ZipScheduler::instance()->workerCount(), CpuCount::available());
+        QCOMPARE(ZipJob::threadPool()->maxThreadCount(), CpuCount::available());
+    }
+
+    /**
+     * @brief Checks the NUMA topology is consistent, that node hints are counted, and that a job can compress on its
+     *        own scheduler.
+     */
+    void testNumaPlacement()
+    {
+        const NumaTopology& topology = NumaTopology::instance();
+        QVERIFY(topology.nodeCount() >= 1);
+        for (int i = 0; i < topology.nodeCount(); i++) {
+            QVERIFY(!topology.node(i).cpus.empty());
+            QCOMPARE(topology.indexOf(topology.node(i).id), i);
+        }
+
+        // Tasks tagged with the node of their input all run, and are counted as local or remote when placing
+        QByteArray buffer(1024 * 1024, 'n');
+        int node = NumaTopology::nodeOf(buffer.constData());
+        ZipScheduler scheduler(2);
+        ZipScheduler::GroupPtr group = scheduler.createGroup();
+        std::atomic<int> done(0);
+        for (int i = 0; i < 20; i++) {
+            scheduler.submit(group, [&done]() { done++; }, 1, node);
+        }
+        scheduler.wait(group);
+        QCOMPARE(done.load(), 20);
+        ZipScheduler::Stats stats = scheduler.stats();
+        QCOMPARE(stats.nodes, scheduler.nodeCount());
+        bool hinted = scheduler.nodeCount() > 1 && topology.indexOf(node) >= 0;
+        QCOMPARE(stats.nodeLocal + stats.nodeRemote, static_cast<quint64>(hinted ? 20 : 0));
+
+        ZipScheduler unplaced(2, false, false);
+        ZipOptions options;
+        options.compressionScheduler = &unplaced;
+        options.mapThreshold = 0;
+        roundTrip(options, QByteArray("placed ").repeated(3 * 1024 * 1024));
+        QCOMPARE(unplaced.nodeCount(), 1);
+        QVERIFY(unplaced.stats().tasks > 0);
+    }
+
+    /**
+     * @brief Checks per-file messages only appear at trace level, that disabled messages aren't formatted, and that
+     *        the async ring delivers or counts every message.
+     */
+    void testLogging()
+    {
+        if (SIMPLEZIPPER_LOG_MIN_LEVEL > ZipLog::TraceLevel) {
+            QSKIP("Trace messages are compiled out");
+        }
+        QStringList messages;
+        ZipLog::setSink([&messages](ZipLog::Level, const QString& message) { messages << message; });
+        QString folder = mTempDir.filePath("logged");
+        QVERIFY(QDir(folder).mkpath("."));
+        QFile file(folder + "/logged.txt");
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("logged");
+        file.close();
+        QString zipFilename = mTempDir.filePath("logged.zip");
+
+        ZipLog::setLevel(ZipLog::DebugLevel);
+        QVERIFY(SimpleZipper::zipFolder(folder, zipFilename));
+        QVERIFY(!messages.isEmpty());
+        QVERIFY(messages.filter("Writing").isEmpty());
+        messages.clear();
+        ZipLog::setLevel(ZipLog::TraceLevel);
+        QVERIFY(SimpleZipper::zipFolder(folder, zipFilename));
+        QCOMPARE(messages.filter("Writing").size(), 1);
+        messages.clear();
+
+        // The arguments of a disabled message are never evaluated
+        int evaluated = 0;
+        ZipLog::setLevel(ZipLog::WarningLevel);
+        ZIP_LOG(ZipLog::DebugLevel) << ++evaluated;
+        QCOMPARE(evaluated, 0);
+        ZIP_LOG(ZipLog::WarningLevel) << "count" << ++evaluated;
+        QCOMPARE(evaluated, 1);
+        QCOMPARE(messages, QStringList("count 1"));
+        ZipLog::setLevel(ZipLog::SilentLevel);
+        ZIP_LOG(ZipLog::WarningLevel) << "silent";
+        QCOMPARE(messages.size(), 1);
+        messages.clear();
+
+        // Nothing is lost without being counted, even when the ring overflows
+        ZipLog::setLevel(ZipLog::TraceLevel);
+        quint64 droppedBefore = ZipLog::dropped();
+        ZipLog::setAsync(true, 4);
+        for (int i = 0; i < 1000; i++) {
+            ZIP_LOG(ZipLog::TraceLevel) << "message" << i;
+        }
+        ZipLog::flush();
+        QCOMPARE(static_cast<quint64>(messages.size()) + ZipLog::dropped() - droppedBefore, quint64(1000));
+        ZipLog::setAsync(false);
+
+        ZipLog::setSink(nullptr);
+        ZipLog::setLevel(ZipLog::DebugLevel);
+        QVERIFY(QDir(folder).removeRecursively());
+        QVERIFY(QFile::remove(zipFilename));
+    }
+
+    /**
+     * @brief Zips a file through a memory mapping and checks it unzips to the same contents.
+     */
+    void testMappedInput()
+    {
+        QString filename = mTempDir.filePath("mapped.txt");
+        QByteArray data = QByteArray("mapped input ").repeated(200000);
+        writeFile(filename, data);
+
+        FileContents contents = BatchFileReader::readFile(filename, 1);
+        QVERIFY(contents.ok);
+        QVERIFY(contents.mapping);
+        QCOMPARE(contents.size(), qint64(data.size()));
+
+        contents = FileContents();
+
+        ZipOptions options;
+        options.mapThreshold = 1;
+        roundTripFile(options, filename, data);
+        QVERIFY(QFile::remove(filename));
+    }
+
+    /**
+     * @brief Zips and unzips a sparse file with data between the holes and checks the contents survive, and that the
+     *        output has holes wherever the file system supports them.
+     */
+    void testSparseInput()
+    {
+        QByteArray zeros(1000000, 0);
+        QCOMPARE(mz_crc32_zeros(MZ_CRC32_INIT, zeros.size()), mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const uchar*>(zeros.constData()), zeros.size()));
+
+        // Resizing leaves holes on file systems that support them, elsewhere the zeros are just written out
+        QString filename = mTempDir.filePath("sparse.bin");
+        QByteArray data = QByteArray("sparse data ").repeated(1000);
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QVERIFY(file.resize(32 * 1024 * 1024));
+        QVERIFY(file.seek(16 * 1024 * 1024));
+        file.write(data);
+        file.close();
+
+        ZipOptions options;
+        options.mapThreshold = 1;
+        options.sparseOutput = true;
+        QByteArray expected(32 * 1024 * 1024, 0);
+        expected.replace(16 * 1024 * 1024, data.size(), data);
+#if defined(Q_OS_UNIX)
+        // Only a file system that left holes in the input can be expected to leave them in the output
+        struct stat info;
+        QCOMPARE(stat(QFile::encodeName(filename).constData(), &info), 0);
+        bool holes = info.st_blocks * 512 < 4 * 1024 * 1024;
+#endif
+        roundTripFile(options, filename, expected);
+#if defined(Q_OS_UNIX)
+        QCOMPARE(stat(QFile::encodeName(filename).constData(), &info), 0);
+        QCOMPARE(qint64(info.st_size), qint64(expected.size()));
+        if (holes) {
+            QVERIFY(info.st_blocks * 512 < 4 * 1024 * 1024);
+        }
+#endif
+        QVERIFY(file.remove());
+    }
+
+    /**
+     * @brief Checks the zero test at every alignment and tail length, and writes files in unaligned pieces with a
+     *        partial last block and with a hole at the end.
+     */
+    void testSparseFileWriter()
+    {
+        QByteArray buffer(256, 0);
+        for (int start = 0; start < 16; start++) {
+            for (int size = 0; size <= 200; size += 7) {
+                QVERIFY(SparseFileWriter::isZero(buffer.constData() + start, size));
+                for (int nonZero : {start, start + size / 2, start + size - 1}) {
+                    if (size == 0) {
+                        continue;
+                    }
+                    buffer[nonZero] = 1;
+                    QVERIFY(!SparseFileWriter::isZero(buffer.constData() + start, size));
+                    buffer[nonZero] = 0;
+                }
+            }
+        }
+
+        // Data, then zeros covering the second and third blocks, then data in a partial last block. Only the second
+        // block is skipped, since the third one is split between two writes.
+        const qint64 blockSize = SparseFileWriter::DefaultBlockSize;
+        QByteArray data(5 * blockSize + 100, 0);
+        data.replace(100, 100, QByteArray(100, 'a'));
+        data.replace(3 * blockSize + 50, 2 * blockSize + 50, QByteArray(2 * blockSize + 50, 'b'));
+        QString filename = mTempDir.filePath("sparseWriter.bin");
+        SparseFileWriter writer;
+        QVERIFY(writer.open(filename));
+        qint64 offset = 0;
+        for (qint64 size : {qint64(1000), qint64(3000), qint64(7777), qint64(data.size()) - 11777}) {
+            QVERIFY(writer.write(offset, data.constData() + offset, size));
+            offset += size;
+        }
+        QVERIFY(writer.close());
+        QCOMPARE(writer.holeBytes(), blockSize);
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVERIFY(file.readAll() == data);
+        file.close();
+
+        // A file that ends in a hole still has its full size
+        data = QByteArray(blockSize, 'c') + QByteArray(3 * blockSize, 0);
+        QVERIFY(writer.open(filename));
+        QVERIFY(writer.write(0, data.constData(), blockSize));
+        QVERIFY(writer.write(blockSize, data.constData() + blockSize, 3 * blockSize));
+        QVERIFY(writer.close());
+        QCOMPARE(writer.holeBytes(), 3 * blockSize);
+        QCOMPARE(QFileInfo(filename).size(), qint64(data.size()));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVERIFY(file.readAll() == data);
+        file.close();
+        QVERIFY(file.remove());
+    }
+
+    /**
+     * @brief Zips and unzips in bulk mode, with an archive big enough to go through several write-behind windows,
+     *        and a folder whose inputs are dropped from the page cache as they're read.
+     */
+    void testBulkIo()
+    {
+        ZipOptions options;
+        options.bulkIo = true;
+        options.level = 0;
+        QByteArray data;
+        for (int i = 0; data.size() < 3 * PageCache::WriteBehind::DefaultWindow; i++) {
+            data += QByteArray::number(i % 100000) + " bulk ";
+        }
+        roundTrip(options, data);
+
+        options = ZipOptions();
+        options.bulkIo = true;
+        QString zipFilename = mTempDir.filePath("bulk.zip");
+        QString outputFolder = mTempDir.filePath("bulk");
+        QVERIFY(SimpleZipper::zipFolder(mSubDir.path(), zipFilename, options));
+        QVERIFY(SimpleZipper::unzipFile(zipFilename, outputFolder, options));
+        for (QFile* file : {&mSubFile1, &mSubFile2}) {
+            QFile unzipped(outputFolder + "/" + QFileInfo(file->fileName()).fileName());
+            QVERIFY(unzipped.open(QIODevice::ReadOnly));
+            QVERIFY(file->open(QIODevice::ReadOnly));
+            QCOMPARE(unzipped.readAll(), file->readAll());
+            file->close();
+        }
+        QVERIFY(QDir(outputFolder).removeRecursively());
+        QVERIFY(QFile::remove(zipFilename));
+    }
+
+    /**
+     * @brief Walks a small tree with different numbers of threads and checks the order is always the same.
+     */
+    void testDirectoryWalker()
+    {
+        QDir root(mTempDir.filePath("walker"));
+        QVERIFY(root.mkpath("b/inner"));
+        QVERIFY(root.mkpath("A"));
+        for (const QString& name : {"z.txt", "B.txt", "a.txt", ".hidden", "A/x.txt", "b/y.txt", "b/inner/w.txt"}) {
+            QFile file(root.filePath(name));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.close();
+        }
+
+#if defined(Q_OS_UNIX)
+        // A symlink back to the top folder must not be followed forever
+        QVERIFY(QFile::link(root.absolutePath(), root.filePath("b/inner/loop")));
+#endif
+
+        QStringList expected = {"a.txt", "B.txt", "z.txt", "A/x.txt", "b/y.txt", "b/inner/w.txt"};
+        for (int threads : {1, 4}) {
+            DirectoryWalker walker(threads);
+            walker.start(root.path());
+            QStringList names;
+            ZipEntry entry;
+            while (walker.next(entry)) {
+                names.append(entry.archiveName);
+            }
+            QCOMPARE(names, expected);
+        }
+        QVERIFY(root.removeRecursively());
+    }
+
+    /**
+     * @brief Checks the glob matcher, then zips a small tree with exclude rules and a .gitignore file.
+     */
+    void testPathFilter()
+    {
+        QVERIFY(PathFilter::globMatch("*.txt", "a.txt"));
+        QVERIFY(!PathFilter::globMatch("*.txt", "sub/a.txt"));
+        QVERIFY(PathFilter::globMatch("a/**/b", "a/b"));
+        QVERIFY(PathFilter::globMatch("a/**/b", "a/x/y/b"));
+        QVERIFY(PathFilter::globMatch("[!a-c]?", "dx"));
+        QVERIFY(!PathFilter::globMatch("[!a-c]?", "bx"));
+
+        QDir root(mTempDir.filePath("filter"));
+        QVERIFY(root.mkpath("src/__pycache__"));
+        QVERIFY(root.mkpath("build"));
+        for (const QString& name : {"a.txt", "b.tmp", "keep.tmp", "src/x.py", "src/__pycache__/x.pyc", "src/x.log", "build/out.o"}) {
+            QFile file(root.filePath(name));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(name.toUtf8());
+            file.close();
+        }
+        QFile ignoreFile(root.filePath("src/.gitignore"));
+        QVERIFY(ignoreFile.open(QIODevice::WriteOnly));
+        ignoreFile.write("__pycache__/\n*.log\n");
+        ignoreFile.close();
+
+        ZipOptions options;
+        options.excludePatterns = QStringList{"*.tmp", "!keep.tmp", "/build/"};
+        options.ignoreFileName = ".gitignore";
+        QString zipFilename = mTempDir.filePath("filter.zip");
+        QVERIFY(SimpleZipper::zipFolder(root.path(), zipFilename, options));
+
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+        QVERIFY(mz_zip_reader_init_file(&zip, zipFilename.toUtf8().constData(), 0));
+        QStringList names;
+        for (mz_uint i = 0; i < mz_zip_reader_get_num_files(&zip); i++) {
+            char name[64];
+            mz_zip_reader_get_filename(&zip, i, name, sizeof(name));
+            names.append(QString(name));
+        }
+        QVERIFY(mz_zip_reader_end(&zip));
+        QCOMPARE(names, QStringList({"a.txt", "keep.tmp", "src/x.py"}));
+
+        // Include rules only pick files, folders are still walked
+        options = ZipOptions();
+        options.includePatterns = QStringList{"*.py*"};
+        QVector<ZipEntry> entries = DirectoryWalker::list(root.path(), QString(), 0, std::make_shared<PathFilter>(options.excludePatterns, options.includePatterns, options.ignoreFileName));
+        QCOMPARE(entries.size(), 2);
+        QCOMPARE(entries[0].archiveName, QString("src/x.py"));
+        QCOMPARE(entries[1].archiveName, QString("src/__pycache__/x.pyc"));
+
+        QVERIFY(QFile::remove(zipFilename));
+        QVERIFY(root.removeRecursively());
+    }
+
+    /**
+     * @brief Checks files come out of the disk order sort with their inode or extent keys in order, then adds entries
+     *        out of order, puts the central directory back into name order and checks the listing.
+     */
+    void testDiskOrder()
+    {
+        // Newest first, so the sort has something to do, and a missing file that sorts as if it were at the start
+        QVector<ZipEntry> entries;
+        for (QFile* file : {&mSubFile2, &mSubFile1, &mFile3, &mFile2, &mFile1}) {
+            entries.append({file->fileName(), QFileInfo(file->fileName()).fileName()});
+        }
+        entries.append({mTempDir.filePath("missing.txt"), "missing.txt"});
+
+        for (DiskOrder::Order order : {DiskOrder::InodeOrder, DiskOrder::ExtentOrder}) {
+            // The order actually used, after falling back from ones this file system doesn't support
+            DiskOrder::Order used = order;
+            for (bool supported = false; !supported && used != DiskOrder::NameOrder;) {
+                supported = true;
+                for (const ZipEntry& entry : entries) {
+                    DiskOrder::key(entry.sourcePath, used, supported);
+                }
+                if (!supported) {
+                    used = used == DiskOrder::ExtentOrder ? DiskOrder::InodeOrder : DiskOrder::NameOrder;
+                }
+            }
+
+            // Each file is in place, and the keys never go backwards, with ties kept in their original order
+            QVector<ZipEntry> sorted = entries;
+            QVector<int> indices = DiskOrder::sort(sorted, order);
+            QCOMPARE(indices.size(), entries.size());
+            quint64 previousKey = 0;
+            int previousIndex = -1;
+            for (int i = 0; i < indices.size(); i++) {
+                QCOMPARE(sorted[i].sourcePath, entries[indices[i]].sourcePath);
+                if (used == DiskOrder::NameOrder) {
+                    QCOMPARE(indices[i], i);
+                    continue;
+                }
+                bool supported = true;
+                quint64 key = DiskOrder::key(sorted[i].sourcePath, used, supported);
+                QVERIFY(key > previousKey || (key == previousKey && indices[i] > previousIndex));
+                previousKey = key;
+                previousIndex = indices[i];
+            }
+        }
+
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+        QVERIFY(mz_zip_writer_init_heap(&zip, 0, 0));
+        for (const char* name : {"c.txt", "a.txt", "b.txt"}) {
+            QVERIFY(mz_zip_writer_add_mem(&zip, name, name, strlen(name), MZ_DEFAULT_COMPRESSION));
+        }
+        const mz_uint badOrder[] = {1, 1, 0};
+        QVERIFY(!mz_zip_writer_reorder_central_dir(&zip, badOrder));
+        const mz_uint order[] = {1, 2, 0};
+        QVERIFY(mz_zip_writer_reorder_central_dir(&zip, order));
+        void* zipData = nullptr;
+        size_t zipSize = 0;
+        QVERIFY(mz_zip_writer_finalize_heap_archive(&zip, &zipData, &zipSize));
+        QVERIFY(mz_zip_writer_end(&zip));
+
+        memset(&zip, 0, sizeof(zip));
+        QVERIFY(mz_zip_reader_init_mem(&zip, zipData, zipSize, 0));
+        QCOMPARE(mz_zip_reader_get_num_files(&zip), mz_uint(3));
+        for (mz_uint i = 0; i < 3; i++) {
+            char name[16];
+            mz_zip_reader_get_filename(&zip, i, name, sizeof(name));
+            QCOMPARE(QString(name), QString("abc"[i]) + ".txt");
+            size_t size = 0;
+            void* data = mz_zip_reader_extract_to_heap(&zip, i, &size, 0);
+            QCOMPARE(QByteArray(static_cast<const char*>(data), static_cast<int>(size)), QByteArray(name));
+            mz_free(data);
+        }
+        QVERIFY(mz_zip_reader_end(&zip));
+        mz_free(zipData);
+    }
+
     /**
      * @brief Deletes the temporary directory and all files created in it.
      */